@@ -0,0 +1,66 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Stand-in for the common-embedded-platform logger, for the host-side benchmarks
+ */
+#ifndef BenchLog_h
+#define BenchLog_h
+
+#include <stdarg.h>
+#include <stdio.h>
+
+/**
+	@brief Minimal printf-style logger writing to stderr (stdout carries the JSON results)
+ */
+class BenchLogger
+{
+public:
+	void operator()(const char* format, ...) __attribute__((format(printf, 2, 3)))
+	{
+		va_list list;
+		va_start(list, format);
+		vfprintf(stderr, format, list);
+		va_end(list);
+	}
+};
+
+///@brief Indentation is not tracked, this only has to match the platform API
+class LogIndenter
+{
+public:
+	LogIndenter(BenchLogger& /*log*/)
+	{}
+};
+
+inline BenchLogger g_log;
+
+#endif
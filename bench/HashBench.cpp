@@ -0,0 +1,366 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+
+
+/**
+	@file
+	@brief Benchmark of socket table / address cache lookups
+
+	Compares the old byte-wise FNV-1 plus modulo against the word-at-a-time multiply-shift hash in util/Hash.h, for
+	distribution quality (how many entries spill out of a 2-way table) and cycles per lookup.
+
+	The new hash is measured through the real tables: TCPProtocolBase::GetSocketState() on a SizedTCPProtocol, and
+	ARPCacheBase::Lookup() on a SizedARPCache, so each lookup includes the hash and the probe of every way in the row.
+	The old hash no longer exists in the tree, so it's reproduced here and drives the same probe on the same tables.
+
+	Timing comes from util/CycleCounter.h: cycles from RDTSC on x86 or DWT->CYCCNT on Cortex-M (printf must be
+	retargeted to something useful by the firmware), nanoseconds anywhere else.
+ */
+
+#include <staticnet-config.h>
+#include <staticnet/stack/staticnet.h>
+#include <staticnet/util/CycleCounter.h>
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Key sets
+
+#define MAX_KEYS 1024
+#define WAYS 2
+
+struct Key
+{
+	IPv4Address m_ip;
+	uint16_t m_localPort;
+	uint16_t m_remotePort;
+};
+
+static Key g_keys[MAX_KEYS];
+
+static uint32_t g_prngState = 1;
+
+static uint32_t Random()
+{
+	//xorshift32, deterministic so runs are comparable
+	g_prngState ^= g_prngState << 13;
+	g_prngState ^= g_prngState >> 17;
+	g_prngState ^= g_prngState << 5;
+	return g_prngState;
+}
+
+enum KeySet
+{
+	KEYS_EPHEMERAL,		//One client opening lots of connections to us from sequential ephemeral ports
+	KEYS_SUBNET,		//One connection from each host on a /24, random source port
+	KEYS_RANDOM			//Random everything
+};
+
+static const char* g_keySetNames[] = { "ephemeral", "subnet", "random" };
+
+static void MakeKeys(KeySet set, uint32_t count)
+{
+	for(uint32_t i=0; i<count; i++)
+	{
+		auto& k = g_keys[i];
+		k.m_localPort = 22;
+		switch(set)
+		{
+			case KEYS_EPHEMERAL:
+				k.m_ip = {.m_octets{10, 0, 0, 2}};
+				k.m_remotePort = 49152 + i;
+				break;
+
+			case KEYS_SUBNET:
+				k.m_ip = {.m_octets{192, 168, static_cast<uint8_t>(i >> 8), static_cast<uint8_t>(i)}};
+				k.m_remotePort = 32768 + (Random() % 28232);
+				break;
+
+			case KEYS_RANDOM:
+			default:
+				{
+					uint32_t ip = Random();
+					memcpy(k.m_ip.m_octets, &ip, sizeof(ip));
+					k.m_localPort = Random();
+					k.m_remotePort = Random();
+				}
+				break;
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// The old hash
+
+//Constants for the old FNV-1 hash
+#define FNV_INITIAL	0x811c9dc5
+#define FNV_MULT	0x01000193
+
+/**
+	@brief The original ARPCache::Hash
+ */
+static uint32_t OldHash(IPv4Address ip, uint32_t lines)
+{
+	uint32_t hash = FNV_INITIAL;
+	for(size_t i=0; i<4; i++)
+		hash = (hash * FNV_MULT) ^ ip.m_octets[i];
+
+	return hash % lines;
+}
+
+/**
+	@brief The original TCPProtocol::Hash
+ */
+static uint32_t OldHash(const Key& k, uint32_t lines)
+{
+	uint32_t hash = FNV_INITIAL;
+	for(size_t i=0; i<4; i++)
+		hash = (hash * FNV_MULT) ^ k.m_ip.m_octets[i];
+	hash = (hash * FNV_MULT) ^ (k.m_localPort >> 8);
+	hash = (hash * FNV_MULT) ^ (k.m_localPort & 0xff);
+	hash = (hash * FNV_MULT) ^ (k.m_remotePort >> 8);
+	hash = (hash * FNV_MULT) ^ (k.m_remotePort & 0xff);
+
+	return hash % lines;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Tables under test
+
+/**
+	@brief A TCP socket table with nothing behind it, filled and probed directly
+
+	Insert<OLD>() and Lookup<OLD>() use the old hash if OLD is set, and the real table code otherwise.
+ */
+template<uint16_t LINES>
+class BenchTCPTable : public SizedTCPProtocol<WAYS, LINES, 1, 1, 0>
+{
+public:
+	BenchTCPTable()
+	: SizedTCPProtocol<WAYS, LINES, 1, 1, 0>(nullptr)
+	{}
+
+	virtual uint32_t GenerateInitialSequenceNumber() override
+	{ return 0; }
+
+	void Clear()
+	{
+		for(size_t i=0; i<WAYS*LINES; i++)
+			this->m_socketStorage[i].m_valid = false;
+	}
+
+	template<bool OLD>
+	void Insert(const Key& k)
+	{
+		auto hash = OLD ? OldHash(k, LINES) : this->Hash(k.m_ip, k.m_localPort, k.m_remotePort);
+
+		//If the row is full the key is dropped, and shows up as a miss later
+		auto state = this->AllocateSocketHandle(hash);
+		if(!state)
+			return;
+		state->m_remoteIP = k.m_ip;
+		state->m_localPort = k.m_localPort;
+		state->m_remotePort = k.m_remotePort;
+	}
+
+	template<bool OLD>
+	__attribute__((noinline)) bool Lookup(const Key& k)
+	{
+		if(!OLD)
+			return this->GetSocketState(k.m_ip, k.m_localPort, k.m_remotePort) != nullptr;
+
+		//Same probe as GetSocketState()
+		auto hash = OldHash(k, LINES);
+		for(size_t way=0; way < WAYS; way ++)
+		{
+			auto& row = this->GetRow(way, hash);
+			if(!row.m_valid)
+				continue;
+			if( (row.m_remoteIP == k.m_ip) &&
+				(row.m_localPort == k.m_localPort) && (row.m_remotePort == k.m_remotePort) )
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+/**
+	@brief An ARP cache, keyed on the IP address of each key
+
+	Insert<OLD>() and Lookup<OLD>() use the old hash if OLD is set, and the real cache code otherwise.
+ */
+template<uint32_t LINES>
+class BenchARPCache : public SizedARPCache<WAYS, LINES>
+{
+public:
+	template<bool OLD>
+	void Insert(const Key& k)
+	{
+		MACAddress mac = {{0x02, 0x00, 0x00, 0x00, 0x00, 0x01}};
+		if(!OLD)
+		{
+			ARPCacheBase::Insert(mac, k.m_ip);
+			return;
+		}
+
+		//Take the first free way. If there's none the key is dropped, and shows up as a miss later
+		//(the real Insert() evicts an older key instead, which loses the same number of entries)
+		auto hash = OldHash(k.m_ip, LINES);
+		for(size_t way=0; way < WAYS; way ++)
+		{
+			auto& row = this->GetRow(way, hash);
+			if(row.m_valid)
+				continue;
+			row.m_valid = true;
+			row.m_ip = k.m_ip;
+			row.m_mac = mac;
+			return;
+		}
+	}
+
+	template<bool OLD>
+	__attribute__((noinline)) bool Lookup(const Key& k)
+	{
+		MACAddress mac;
+		if(!OLD)
+			return ARPCacheBase::Lookup(mac, k.m_ip);
+
+		//Same probe as ARPCacheBase::Lookup()
+		auto hash = OldHash(k.m_ip, LINES);
+		for(size_t way=0; way < WAYS; way++)
+		{
+			auto& row = this->GetRow(way, hash);
+			if(row.m_valid && row.m_ip == k.m_ip)
+			{
+				mac = row.m_mac;
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Measurements
+
+struct Result
+{
+	///@brief Number of keys that didn't fit in the table
+	uint32_t m_spills;
+
+	///@brief Average time per lookup, x100 (for two decimal places without needing float printf)
+	uint32_t m_cycles;
+};
+
+/**
+	@brief Fills a table with the first `count` keys, then looks all of them up
+ */
+template<bool OLD, class Table>
+static Result Measure(Table& table, uint32_t count)
+{
+	const uint32_t passes = 16;
+	volatile uint32_t sink = 0;
+
+	table.Clear();
+	for(uint32_t i=0; i<count; i++)
+		table.template Insert<OLD>(g_keys[i]);
+
+	Result ret = {0, 0};
+	for(uint32_t i=0; i<count; i++)
+	{
+		if(!table.template Lookup<OLD>(g_keys[i]))
+			ret.m_spills ++;
+	}
+
+	uint32_t start = GetCycleCount();
+	for(uint32_t pass=0; pass<passes; pass++)
+	{
+		for(uint32_t i=0; i<count; i++)
+			sink = sink + table.template Lookup<OLD>(g_keys[i]);
+	}
+	uint32_t elapsed = GetCycleCount() - start;
+
+	ret.m_cycles = (static_cast<uint64_t>(elapsed) * 100) / (passes * count);
+	return ret;
+}
+
+/**
+	@brief Loads a table to full capacity with keys from one set, and prints a line comparing the two hashes
+ */
+template<class Table>
+static void Run(const char* tableName, Table& table, KeySet set, uint32_t lines)
+{
+	uint32_t count = lines * WAYS;
+	MakeKeys(set, count);
+
+	auto o = Measure<true>(table, count);
+	auto n = Measure<false>(table, count);
+	printf("%-5s %-10s %5u  %10u  %5u.%02u  %10u  %5u.%02u\n",
+		tableName,
+		g_keySetNames[set],
+		(unsigned)lines,
+		(unsigned)o.m_spills,
+		(unsigned)(o.m_cycles / 100),
+		(unsigned)(o.m_cycles % 100),
+		(unsigned)n.m_spills,
+		(unsigned)(n.m_cycles / 100),
+		(unsigned)(n.m_cycles % 100));
+}
+
+template<uint16_t LINES>
+static void RunSize(KeySet set)
+{
+	static_assert(LINES * WAYS <= MAX_KEYS, "Not enough keys to fill the table");
+
+	static BenchTCPTable<LINES> tcp;
+	Run("tcp", tcp, set, LINES);
+
+	//ARP keys are just the address, so the ephemeral port set is only one key
+	static BenchARPCache<LINES> arp;
+	if(set != KEYS_EPHEMERAL)
+		Run("arp", arp, set, LINES);
+}
+
+int main()
+{
+	EnableCycleCounter();
+
+	//Table sizes, in rows. Keys are loaded to the full capacity of the table.
+	printf("table keys       lines  old: spill  cyc/lookup  new: spill  cyc/lookup\n");
+	for(int set = KEYS_EPHEMERAL; set <= KEYS_RANDOM; set++)
+	{
+		auto s = static_cast<KeySet>(set);
+		RunSize<16>(s);
+		RunSize<61>(s);
+		RunSize<256>(s);
+		RunSize<512>(s);
+	}
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Implementation of OpenSSLCryptoEngine
+ */
+#include <staticnet-config.h>
+#include <staticnet/stack/staticnet.h>
+#include "OpenSSLCryptoEngine.h"
+
+#include <stdlib.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+OpenSSLCryptoEngine::OpenSSLCryptoEngine(bool client)
+	: m_client(client)
+	, m_hashContext(EVP_MD_CTX_new())
+	, m_cipherContext(EVP_CIPHER_CTX_new())
+{
+	if(!m_hashContext || !m_cipherContext)
+		abort();
+
+	SHA256_Init();
+}
+
+OpenSSLCryptoEngine::~OpenSSLCryptoEngine()
+{
+	EVP_CIPHER_CTX_free(m_cipherContext);
+	EVP_MD_CTX_free(m_hashContext);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// RNG
+
+void OpenSSLCryptoEngine::GenerateRandom(uint8_t* buf, size_t len)
+{
+	if(RAND_bytes(buf, len) != 1)
+		abort();
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Hashing
+
+void OpenSSLCryptoEngine::SHA256_Init()
+{
+	EVP_DigestInit_ex(m_hashContext, EVP_sha256(), nullptr);
+}
+
+void OpenSSLCryptoEngine::SHA256_Update(const uint8_t* data, uint16_t len)
+{
+	EVP_DigestUpdate(m_hashContext, data, len);
+}
+
+void OpenSSLCryptoEngine::SHA256_Final(uint8_t* digest)
+{
+	unsigned int len = SHA256_DIGEST_SIZE;
+	EVP_DigestFinal_ex(m_hashContext, digest, &len);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Encryption
+
+/**
+	@brief Increments the invocation counter of a GCM IV (RFC 5647 section 7.1)
+
+	The high 4 bytes stay constant, the low 8 bytes are a 64 bit big endian integer.
+ */
+void OpenSSLCryptoEngine::IncrementIV(uint8_t* iv)
+{
+	for(int i=GCM_IV_SIZE-1; i>=4; i--)
+	{
+		iv[i] ++;
+		if(iv[i] != 0)
+			break;
+	}
+}
+
+/**
+	@brief Decrypts a packet in place and checks the tag at the end of it
+
+	The packet length (len minus the tag size) is the AAD, as with aes128-gcm@openssh.com.
+ */
+bool OpenSSLCryptoEngine::DecryptAndVerify(uint8_t* data, uint16_t len)
+{
+	if(len < GCM_TAG_SIZE)
+		return false;
+	int reallen = len - GCM_TAG_SIZE;
+
+	auto key = m_client ? m_keyServerToClient : m_keyClientToServer;
+	auto iv = m_client ? m_ivServerToClient : m_ivClientToServer;
+
+	uint8_t aad[4];
+	uint32_t aadValue = __builtin_bswap32(reallen);
+	memcpy(aad, &aadValue, sizeof(aad));
+
+	int outlen;
+	EVP_DecryptInit_ex(m_cipherContext, EVP_aes_128_gcm(), nullptr, key, iv);
+	EVP_DecryptUpdate(m_cipherContext, nullptr, &outlen, aad, sizeof(aad));
+	EVP_DecryptUpdate(m_cipherContext, data, &outlen, data, reallen);
+	EVP_CIPHER_CTX_ctrl(m_cipherContext, EVP_CTRL_GCM_SET_TAG, GCM_TAG_SIZE, data + reallen);
+	if(EVP_DecryptFinal_ex(m_cipherContext, data + outlen, &outlen) <= 0)
+		return false;
+
+	IncrementIV(iv);
+	return true;
+}
+
+/**
+	@brief Encrypts a packet in place and appends the tag to it
+ */
+void OpenSSLCryptoEngine::EncryptAndMAC(uint8_t* data, uint16_t len)
+{
+	auto key = m_client ? m_keyClientToServer : m_keyServerToClient;
+	auto iv = m_client ? m_ivClientToServer : m_ivServerToClient;
+
+	uint8_t aad[4];
+	uint32_t aadValue = __builtin_bswap32(len);
+	memcpy(aad, &aadValue, sizeof(aad));
+
+	int outlen;
+	EVP_EncryptInit_ex(m_cipherContext, EVP_aes_128_gcm(), nullptr, key, iv);
+	EVP_EncryptUpdate(m_cipherContext, nullptr, &outlen, aad, sizeof(aad));
+	EVP_EncryptUpdate(m_cipherContext, data, &outlen, data, len);
+	EVP_EncryptFinal_ex(m_cipherContext, data + outlen, &outlen);
+	EVP_CIPHER_CTX_ctrl(m_cipherContext, EVP_CTRL_GCM_GET_TAG, GCM_TAG_SIZE, data + len);
+
+	IncrementIV(iv);
+}
@@ -0,0 +1,80 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Declaration of OpenSSLCryptoEngine
+ */
+#ifndef OpenSSLCryptoEngine_h
+#define OpenSSLCryptoEngine_h
+
+#include <stdint.h>
+#include <string.h>
+#include <staticnet/crypt/CryptoEngine.h>
+
+typedef struct evp_md_ctx_st EVP_MD_CTX;
+typedef struct evp_cipher_ctx_st EVP_CIPHER_CTX;
+
+/**
+	@brief Host crypto engine using OpenSSL for the RNG, SHA-256 and AES-GCM
+
+	Only meant for host-side benchmarking, where there's no hardware crypto block. X25519 and Ed25519 use the software
+	implementation in the base class, same as on the STM32.
+
+	The same class is used for both ends of a connection. A client-side engine swaps the keys and IVs so that
+	EncryptAndMAC() uses the client to server direction and DecryptAndVerify() the server to client direction.
+ */
+class OpenSSLCryptoEngine : public CryptoEngine
+{
+public:
+	OpenSSLCryptoEngine(bool client = false);
+	virtual ~OpenSSLCryptoEngine();
+
+	virtual void GenerateRandom(uint8_t* buf, size_t len) override;
+	virtual void SHA256_Init() override;
+	virtual void SHA256_Update(const uint8_t* data, uint16_t len) override;
+	virtual void SHA256_Final(uint8_t* digest) override;
+	virtual bool DecryptAndVerify(uint8_t* data, uint16_t len) override;
+	virtual void EncryptAndMAC(uint8_t* data, uint16_t len) override;
+
+protected:
+	static void IncrementIV(uint8_t* iv);
+
+	///@brief True if we're the client end of the connection
+	bool m_client;
+
+	///@brief Hash state
+	EVP_MD_CTX* m_hashContext;
+
+	///@brief Cipher state (reinitialized with the key and IV for every packet, like the hardware engine)
+	EVP_CIPHER_CTX* m_cipherContext;
+};
+
+#endif
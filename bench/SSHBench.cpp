@@ -0,0 +1,1588 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief End-to-end benchmark of the SSH and SFTP servers
+
+	Runs SSHTransportServer and an SFTPServer with an in-memory filesystem on top of the full stack, and measures the
+	three things users notice:
+		* Handshakes per second (TCP connect, key exchange, password authentication, disconnect)
+		* Interactive echo latency (one keystroke to the shell and back)
+		* SFTP write and read throughput
+
+	The client side is a small scripted SSH client in this file. It only speaks the one cipher suite the server
+	supports and checks the host key signature, but not the host key itself. Results are written to stdout as JSON.
+
+	Modes:
+		staticnet-sshbench [inproc]
+			Client and server in one thread. The client has its own minimal TCP implementation which exchanges frames
+			with the stack directly, so results are repeatable and measure nothing but the stack and crypto.
+
+		staticnet-sshbench tap <ifname>
+			The stack runs on a tap interface in a second thread and the same scripted client connects through the
+			kernel's TCP stack, so results include a real network path.
+
+		staticnet-sshbench serve <ifname>
+			Just runs the server on a tap interface, for benchmarking with the OpenSSH client, e.g.
+				time ssh -i throwaway_key -o StrictHostKeyChecking=no bench@10.0.0.1 true
+			The OpenSSH sftp client needs SSH_FXP_REALPATH, which SFTPServer doesn't implement, so SFTP throughput
+			can only be measured with the built-in client.
+
+	In the tap modes the interface must already exist and have the peer address, e.g.
+		ip tuntap add name sshbench0 mode tap
+		ip addr add 10.0.0.2/24 dev sshbench0
+		ip link set sshbench0 up
+
+	The server is 10.0.0.1, port 22. Password logins are accepted for bench / bench, and publickey logins for any
+	ssh-ed25519 key (the server only advertises publickey, which is what OpenSSH will use).
+
+	AES-GCM, SHA-256 and the RNG come from OpenSSL (OpenSSLCryptoEngine), since this tree has no software AES-GCM.
+ */
+
+#include <staticnet-config.h>
+#include <staticnet/stack/staticnet.h>
+#include <staticnet/drivers/tap/TapEthernetInterface.h>
+#include <staticnet/ssh/SSHTransportServer.h>
+#include <staticnet/ssh/SSHTransportPacket.h>
+#include <staticnet/sftp/SFTPServer.h>
+#include <staticnet/stack/MemoryBudget.h>
+#include "OpenSSLCryptoEngine.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static const MACAddress g_ourMac = {{0x02, 0x00, 0x00, 0x00, 0x00, 0x01}};
+static const MACAddress g_peerMac = {{0x02, 0x00, 0x00, 0x00, 0x00, 0x02}};
+static const IPv4Address g_ourIP = {.m_octets{10, 0, 0, 1}};
+static const IPv4Address g_peerIP = {.m_octets{10, 0, 0, 2}};
+
+#define SSH_PORT 22
+
+#define BENCH_USERNAME "bench"
+#define BENCH_PASSWORD "bench"
+
+//Size of each SFTP write request (writes smaller than the SFTP receive buffer aren't supported by the server)
+#define SFTP_WRITE_BLOCK 32768
+
+//SSH message types used by the client
+enum
+{
+	SSH_MSG_DISCONNECT				= 1,
+	SSH_MSG_IGNORE					= 2,
+	SSH_MSG_DEBUG					= 4,
+	SSH_MSG_SERVICE_REQUEST			= 5,
+	SSH_MSG_SERVICE_ACCEPT			= 6,
+	SSH_MSG_KEXINIT					= 20,
+	SSH_MSG_NEWKEYS					= 21,
+	SSH_MSG_KEX_ECDH_INIT			= 30,
+	SSH_MSG_KEX_ECDH_REPLY			= 31,
+	SSH_MSG_USERAUTH_REQUEST		= 50,
+	SSH_MSG_USERAUTH_SUCCESS		= 52,
+	SSH_MSG_CHANNEL_OPEN			= 90,
+	SSH_MSG_CHANNEL_OPEN_CONFIRM	= 91,
+	SSH_MSG_CHANNEL_WINDOW_ADJUST	= 93,
+	SSH_MSG_CHANNEL_DATA			= 94,
+	SSH_MSG_CHANNEL_REQUEST			= 98,
+	SSH_MSG_CHANNEL_SUCCESS			= 99
+};
+
+//SFTP message types and flags used by the client (version 3, as OpenSSH uses)
+enum
+{
+	SSH_FXP_INIT					= 1,
+	SSH_FXP_VERSION					= 2,
+	SSH_FXP_OPEN					= 3,
+	SSH_FXP_CLOSE					= 4,
+	SSH_FXP_READ					= 5,
+	SSH_FXP_WRITE					= 6,
+	SSH_FXP_STATUS					= 101,
+	SSH_FXP_HANDLE					= 102,
+	SSH_FXP_DATA					= 103,
+
+	SSH_FXF_READ					= 0x01,
+	SSH_FXF_WRITE					= 0x02,
+	SSH_FXF_CREAT					= 0x08,
+	SSH_FXF_TRUNC					= 0x10,
+
+	SSH_FX_OK						= 0,
+	SSH_FX_EOF						= 1
+};
+
+typedef chrono::steady_clock Clock;
+
+static double SecondsSince(Clock::time_point start)
+{ return chrono::duration<double>(Clock::now() - start).count(); }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Server side
+
+/**
+	@brief Accepts one fixed username and password
+ */
+class BenchPasswordAuthenticator : public SSHPasswordAuthenticator
+{
+public:
+	virtual bool TestLogin(
+		const char* username,
+		uint16_t username_len,
+		const char* password,
+		uint16_t password_len,
+		CryptoEngine* /*crypto*/) override
+	{
+		return
+			SSHTransportServer::StringMatchWithLength(BENCH_USERNAME, username, username_len) &&
+			SSHTransportServer::StringMatchWithLength(BENCH_PASSWORD, password, password_len);
+	}
+};
+
+/**
+	@brief Accepts any ssh-ed25519 key, so the OpenSSH client can log in with a throwaway key
+
+	Obviously not something to do outside of a benchmark.
+ */
+class BenchPubkeyAuthenticator : public SSHPubkeyAuthenticator
+{
+public:
+	virtual bool CanUseKey(
+		const char* /*username*/,
+		uint16_t /*username_len*/,
+		const SSHCurve25519KeyBlob* /*keyblob*/,
+		bool /*actualLoginAttempt*/) override
+	{ return true; }
+};
+
+/**
+	@brief SFTP server backed by files in RAM
+ */
+class MemorySFTPServer : public SFTPServer
+{
+protected:
+	virtual bool DoesFileExist(const char* path) override
+	{ return m_files.find(path) != m_files.end(); }
+
+	virtual bool CanOpenFile(const char* path, uint32_t accessMask, uint32_t /*flags*/) override
+	{ return (accessMask & WRITE_ACCESS) || DoesFileExist(path); }
+
+	/**
+		@brief Opens a file, creating or truncating it if opened for writing
+
+		Version 3 clients (OpenSSH) send their open flags where a version 6 client sends the access mask. Both use
+		bit 1 for write access, and we always create and truncate on write, so the difference doesn't matter here.
+	 */
+	virtual uint32_t OpenFile(const char* path, uint32_t accessMask, uint32_t /*flags*/) override
+	{
+		if(accessMask & WRITE_ACCESS)
+			m_files[path].clear();
+
+		for(uint32_t i=0; i<MAX_HANDLES; i++)
+		{
+			if(m_handles[i] == nullptr)
+			{
+				m_handles[i] = &m_files[path];
+				return i;
+			}
+		}
+
+		//Out of handles, reuse the last one
+		m_handles[MAX_HANDLES-1] = &m_files[path];
+		return MAX_HANDLES-1;
+	}
+
+	virtual void WriteFile(uint32_t handle, uint64_t offset, const uint8_t* data, uint32_t len) override
+	{
+		auto file = GetFile(handle);
+		if(!file)
+			return;
+
+		if(file->size() < offset + len)
+			file->resize(offset + len);
+		memcpy(file->data() + offset, data, len);
+	}
+
+	virtual uint32_t ReadFile(uint32_t handle, uint64_t offset, uint8_t* data, uint32_t len) override
+	{
+		auto file = GetFile(handle);
+		if(!file || (offset >= file->size()) )
+			return 0;
+
+		len = min<uint64_t>(len, file->size() - offset);
+		memcpy(data, file->data() + offset, len);
+		return len;
+	}
+
+	virtual uint64_t GetFileSize(const char* path) override
+	{
+		auto it = m_files.find(path);
+		if(it == m_files.end())
+			return 0;
+		return it->second.size();
+	}
+
+	virtual bool CloseFile(uint32_t handle) override
+	{
+		if(!GetFile(handle))
+			return false;
+		m_handles[handle] = nullptr;
+		return true;
+	}
+
+	vector<uint8_t>* GetFile(uint32_t handle)
+	{
+		if(handle >= MAX_HANDLES)
+			return nullptr;
+		return m_handles[handle];
+	}
+
+	///@brief Write access bit (SSH_FXF_WRITE in version 3, ACE4_WRITE_DATA in version 6)
+	static const uint32_t WRITE_ACCESS = 0x2;
+
+	static const uint32_t MAX_HANDLES = 8;
+
+	///@brief File contents, by path
+	map<string, vector<uint8_t> > m_files;
+
+	///@brief Open files, by handle
+	vector<uint8_t>* m_handles[MAX_HANDLES] = {nullptr};
+};
+
+/**
+	@brief SSH server whose shell echoes everything back, and whose exec requests do nothing
+ */
+class BenchSSHServer : public SSHTransportServer
+{
+public:
+	BenchSSHServer(TCPProtocol& tcp)
+	: SSHTransportServer(tcp)
+	{
+		for(int i=0; i<SSH_TABLE_SIZE; i++)
+		{
+			m_state[i].m_crypto = &m_crypto[i];
+			m_state[i].m_sftpState = &m_sftpState[i];
+		}
+
+		UsePasswordAuthenticator(&m_passwordAuth);
+		UsePubkeyAuthenticator(&m_pubkeyAuth);
+		UseSFTPServer(&m_sftp);
+	}
+
+protected:
+	virtual void DoExecRequest(int /*id*/, TCPTableEntry* /*socket*/, const char* /*cmd*/, uint16_t /*len*/) override
+	{}
+
+	virtual void InitializeShell(int /*id*/, TCPTableEntry* /*socket*/) override
+	{}
+
+	virtual void OnRxShellData(int id, TCPTableEntry* socket, char* data, uint16_t len) override
+	{ SendSessionData(id, socket, data, len); }
+
+	OpenSSLCryptoEngine m_crypto[SSH_TABLE_SIZE];
+	SFTPConnectionState m_sftpState[SSH_TABLE_SIZE];
+
+	BenchPasswordAuthenticator m_passwordAuth;
+	BenchPubkeyAuthenticator m_pubkeyAuth;
+	MemorySFTPServer m_sftp;
+};
+
+/**
+	@brief TCP stack which only accepts connections to registered servers
+ */
+class BenchTCPProtocol : public TCPProtocol
+{
+public:
+	BenchTCPProtocol(IPv4Protocol* ipv4)
+	: TCPProtocol(ipv4)
+	{}
+
+	virtual uint32_t GenerateInitialSequenceNumber() override
+	{ return rand(); }
+};
+
+/**
+	@brief A complete IPv4 stack with the SSH server, on some Ethernet interface
+ */
+class BenchStack
+{
+public:
+	BenchStack(EthernetInterface& iface)
+	: m_eth(iface, g_ourMac)
+	, m_ipv4(m_eth, m_config, m_cache)
+	, m_arp(m_eth, m_config.m_address, m_cache)
+	, m_icmpv4(m_ipv4)
+	, m_tcp(&m_ipv4)
+	, m_ssh(m_tcp)
+	{
+		m_config.m_address = g_ourIP;
+		m_config.m_netmask = {.m_octets{255, 255, 255, 0}};
+		m_config.m_broadcast = {.m_octets{10, 0, 0, 255}};
+		m_config.m_gateway = {.m_octets{10, 0, 0, 254}};
+
+		m_eth.UseARP(&m_arp);
+		m_eth.UseIPv4(&m_ipv4);
+		m_ipv4.UseICMPv4(&m_icmpv4);
+		m_ipv4.UseTCP(&m_tcp);
+
+		m_ssh.Listen(SSH_PORT);
+	}
+
+	///@brief Runs the 10 Hz (and every tenth call, the 1 Hz) timers
+	void OnAgingTick10x()
+	{
+		m_eth.OnAgingTick10x();
+		m_ssh.OnAgingTick10x();
+
+		if(++m_ticks == 10)
+		{
+			m_eth.OnAgingTick();
+			m_ticks = 0;
+		}
+	}
+
+	EthernetProtocol m_eth;
+	IPv4Config m_config;
+	ARPCache m_cache;
+	IPv4Protocol m_ipv4;
+	ARPProtocol m_arp;
+	ICMPv4Protocol m_icmpv4;
+	BenchTCPProtocol m_tcp;
+	BenchSSHServer m_ssh;
+	int m_ticks = 0;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Client transports
+
+/**
+	@brief A byte stream to the server
+ */
+class ClientTransport
+{
+public:
+	virtual ~ClientTransport() =default;
+
+	virtual bool Connect() =0;
+	virtual bool Send(const uint8_t* data, size_t len) =0;
+
+	///@brief Blocks until some data is available, then returns it. Returns 0 if the connection closed or stalled.
+	virtual size_t Receive(uint8_t* data, size_t len) =0;
+
+	virtual void Close() =0;
+};
+
+/**
+	@brief Kernel TCP socket (for running against the stack on a tap interface)
+ */
+class SocketTransport : public ClientTransport
+{
+public:
+	SocketTransport()
+	: m_socket(-1)
+	{}
+
+	virtual ~SocketTransport()
+	{ Close(); }
+
+	virtual bool Connect() override
+	{
+		m_socket = socket(AF_INET, SOCK_STREAM, 0);
+		if(m_socket < 0)
+			return false;
+
+		int one = 1;
+		setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		timeval timeout = {5, 0};
+		setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(SSH_PORT);
+		memcpy(&addr.sin_addr, g_ourIP.m_octets, 4);
+		return connect(m_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+	}
+
+	virtual bool Send(const uint8_t* data, size_t len) override
+	{
+		while(len > 0)
+		{
+			auto n = send(m_socket, data, len, 0);
+			if(n <= 0)
+				return false;
+			data += n;
+			len -= n;
+		}
+		return true;
+	}
+
+	virtual size_t Receive(uint8_t* data, size_t len) override
+	{
+		auto n = recv(m_socket, data, len, 0);
+		if(n <= 0)
+			return 0;
+		return n;
+	}
+
+	virtual void Close() override
+	{
+		if(m_socket >= 0)
+			close(m_socket);
+		m_socket = -1;
+	}
+
+protected:
+	int m_socket;
+};
+
+/**
+	@brief Ethernet interface which hands transmitted frames to LoopbackTransport instead of a wire
+ */
+class LoopbackInterface : public EthernetInterface
+{
+public:
+	virtual EthernetFrame* GetTxFrame() override
+	{ return new EthernetFrame; }
+
+	virtual bool IsTxBufferAvailable() override
+	{ return true; }
+
+	virtual void SendTxFrame(EthernetFrame* frame, bool markFree=true) override
+	{
+		m_sent.emplace_back(frame->RawData(), frame->RawData() + frame->Length());
+		if(markFree)
+			CancelTxFrame(frame);
+	}
+
+	virtual void CancelTxFrame(EthernetFrame* frame) override
+	{ delete frame; }
+
+	virtual EthernetFrame* GetRxFrame() override
+	{ return nullptr; }
+
+	//Received frames are owned by LoopbackTransport
+	virtual void ReleaseRxFrame(EthernetFrame* /*frame*/) override
+	{}
+
+	///@brief Frames sent by the stack which the client hasn't looked at yet
+	deque<vector<uint8_t> > m_sent;
+};
+
+/**
+	@brief Minimal TCP client which exchanges frames with the stack directly, in the same thread
+
+	The "network" is lossless and in order, and the stack handles every frame synchronously, so there is no
+	retransmission and a call to Receive() with nothing queued means the server has nothing more to say.
+ */
+class LoopbackTransport : public ClientTransport
+{
+public:
+	LoopbackTransport(LoopbackInterface& iface, BenchStack& stack, uint16_t port)
+	: m_iface(iface)
+	, m_stack(stack)
+	, m_port(port)
+	{}
+
+	virtual bool Connect() override
+	{
+		m_seq = 0x1000;
+		m_ack = 0;
+		m_remoteAcked = m_seq;
+		m_remoteWindow = 0;
+		m_established = false;
+		m_finReceived = false;
+		m_ackPending = false;
+		m_rx.clear();
+
+		//SYN with MSS option
+		static const uint8_t mss[4] = {2, 4, (TCP_IPV4_PAYLOAD_MTU >> 8), (TCP_IPV4_PAYLOAD_MTU & 0xff)};
+		SendSegment(TCP_SYN, nullptr, 0, mss, sizeof(mss));
+		m_seq ++;
+		Pump();
+
+		return m_established;
+	}
+
+	virtual bool Send(const uint8_t* data, size_t len) override
+	{
+		while(len > 0)
+		{
+			uint32_t window = m_remoteAcked + m_remoteWindow - m_seq;
+			if(window == 0)
+				return false;
+
+			uint32_t chunk = min<size_t>(len, min<uint32_t>(window, TCP_IPV4_PAYLOAD_MTU));
+			SendSegment(TCP_ACK | TCP_PSH, data, chunk);
+			m_seq += chunk;
+			data += chunk;
+			len -= chunk;
+			Pump();
+		}
+		return true;
+	}
+
+	virtual size_t Receive(uint8_t* data, size_t len) override
+	{
+		Pump();
+
+		len = min(len, m_rx.size());
+		copy(m_rx.begin(), m_rx.begin() + len, data);
+		m_rx.erase(m_rx.begin(), m_rx.begin() + len);
+		return len;
+	}
+
+	virtual void Close() override
+	{
+		if(!m_established)
+			return;
+
+		SendSegment(TCP_FIN | TCP_ACK, nullptr, 0);
+		m_seq ++;
+		Pump();
+		m_established = false;
+		m_port ++;
+	}
+
+protected:
+	enum
+	{
+		TCP_FIN = 0x01,
+		TCP_SYN = 0x02,
+		TCP_RST = 0x04,
+		TCP_PSH = 0x08,
+		TCP_ACK = 0x10
+	};
+
+	static uint16_t Read16(const uint8_t* p)
+	{ return (p[0] << 8) | p[1]; }
+
+	static uint32_t Read32(const uint8_t* p)
+	{ return (Read16(p) << 16) | Read16(p + 2); }
+
+	static void Write16(uint8_t* p, uint16_t v)
+	{
+		p[0] = v >> 8;
+		p[1] = v & 0xff;
+	}
+
+	static void Write32(uint8_t* p, uint32_t v)
+	{
+		Write16(p, v >> 16);
+		Write16(p + 2, v & 0xffff);
+	}
+
+	/**
+		@brief Builds a segment from the client and hands it to the stack
+	 */
+	void SendSegment(uint16_t flags, const uint8_t* data, uint16_t len, const uint8_t* opts = nullptr, uint8_t optlen = 0)
+	{
+		auto raw = m_frame.RawData();
+		memcpy(raw, g_ourMac.m_address, ETHERNET_MAC_SIZE);
+		memcpy(raw + 6, g_peerMac.m_address, ETHERNET_MAC_SIZE);
+		Write16(raw + 12, ETHERTYPE_IPV4);
+
+		//IPv4 header
+		auto ip = raw + 14;
+		uint16_t tcpLen = 20 + optlen + len;
+		memset(ip, 0, 20);
+		ip[0] = 0x45;
+		Write16(ip + 2, 20 + tcpLen);
+		ip[6] = 0x40;
+		ip[8] = 64;
+		ip[9] = IP_PROTO_TCP;
+		memcpy(ip + 12, g_peerIP.m_octets, 4);
+		memcpy(ip + 16, g_ourIP.m_octets, 4);
+		Write16(ip + 10, ~IPv4Protocol::InternetChecksum(ip, 20));
+
+		//TCP header, options, and data
+		auto tcp = ip + 20;
+		memset(tcp, 0, 20);
+		Write16(tcp, m_port);
+		Write16(tcp + 2, SSH_PORT);
+		Write32(tcp + 4, m_seq);
+		Write32(tcp + 8, (flags & TCP_ACK) ? m_ack : 0);
+		Write16(tcp + 12, ( (5 + optlen/4) << 12) | flags);
+		Write16(tcp + 14, 0xffff);
+		if(optlen)
+			memcpy(tcp + 20, opts, optlen);
+		if(len)
+			memcpy(tcp + 20 + optlen, data, len);
+
+		//Checksum over the pseudo-header then the segment
+		uint8_t pseudo[12];
+		memcpy(pseudo, ip + 12, 8);
+		pseudo[8] = 0;
+		pseudo[9] = IP_PROTO_TCP;
+		Write16(pseudo + 10, tcpLen);
+		Write16(tcp + 16, ~IPv4Protocol::InternetChecksum(tcp, tcpLen, IPv4Protocol::InternetChecksum(pseudo, 12)));
+
+		m_frame.SetLength(14 + 20 + tcpLen);
+		m_ackPending = false;
+		m_stack.m_eth.OnRxFrame(&m_frame);
+	}
+
+	/**
+		@brief Processes everything the stack sent, ACKing data, until it has nothing more to say
+	 */
+	void Pump()
+	{
+		while(!m_iface.m_sent.empty())
+		{
+			while(!m_iface.m_sent.empty())
+			{
+				auto frame = move(m_iface.m_sent.front());
+				m_iface.m_sent.pop_front();
+				OnServerFrame(frame.data(), frame.size());
+			}
+
+			//ACK what we got, which may let the server send more
+			if(m_ackPending)
+				SendSegment(TCP_ACK, nullptr, 0);
+		}
+	}
+
+	void OnServerFrame(const uint8_t* raw, size_t len)
+	{
+		//Only look at TCP from the server to our current port. Anything else (ARP etc) isn't interesting.
+		if( (len < 54) || (Read16(raw + 12) != ETHERTYPE_IPV4) )
+			return;
+		auto ip = raw + 14;
+		if(ip[9] != IP_PROTO_TCP)
+			return;
+		auto tcp = ip + 4*(ip[0] & 0xf);
+		if(Read16(tcp + 2) != m_port)
+			return;
+
+		uint16_t flags = Read16(tcp + 12) & 0x1ff;
+		uint32_t seq = Read32(tcp + 4);
+		auto payload = tcp + 4*(tcp[12] >> 4);
+		size_t payloadLen = (ip + Read16(ip + 2)) - payload;
+
+		if(flags & TCP_RST)
+		{
+			m_established = false;
+			return;
+		}
+
+		if(flags & TCP_ACK)
+		{
+			m_remoteAcked = Read32(tcp + 8);
+			m_remoteWindow = Read16(tcp + 14);
+		}
+
+		if(flags & TCP_SYN)
+		{
+			m_ack = seq + 1;
+			m_established = true;
+			m_ackPending = true;
+			return;
+		}
+
+		//In order data (anything else is a retransmit, which just gets ACKed again)
+		if( (payloadLen > 0) || (flags & TCP_FIN) )
+			m_ackPending = true;
+		if(seq != m_ack)
+			return;
+		m_rx.insert(m_rx.end(), payload, payload + payloadLen);
+		m_ack += payloadLen;
+
+		if(flags & TCP_FIN)
+		{
+			m_ack ++;
+			m_finReceived = true;
+		}
+	}
+
+	LoopbackInterface& m_iface;
+	BenchStack& m_stack;
+
+	///@brief Our port (incremented for each connection, so old ones can sit in TIME-WAIT)
+	uint16_t m_port;
+
+	///@brief Frame we build outbound segments in
+	EthernetFrame m_frame;
+
+	uint32_t m_seq;
+	uint32_t m_ack;
+	uint32_t m_remoteAcked;
+	uint32_t m_remoteWindow;
+	bool m_established;
+	bool m_finReceived;
+	bool m_ackPending;
+
+	///@brief Received data not yet read by the client
+	deque<uint8_t> m_rx;
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Scripted SSH client
+
+/**
+	@brief Builds SSH wire format data
+ */
+class Writer
+{
+public:
+	Writer& U8(uint8_t v)
+	{
+		m_buf.push_back(v);
+		return *this;
+	}
+
+	Writer& U32(uint32_t v)
+	{
+		for(int i=3; i>=0; i--)
+			m_buf.push_back(v >> (8*i));
+		return *this;
+	}
+
+	Writer& U64(uint64_t v)
+	{
+		U32(v >> 32);
+		return U32(v & 0xffffffff);
+	}
+
+	Writer& Bytes(const void* data, size_t len)
+	{
+		auto p = reinterpret_cast<const uint8_t*>(data);
+		m_buf.insert(m_buf.end(), p, p + len);
+		return *this;
+	}
+
+	Writer& String(const void* data, size_t len)
+	{
+		U32(len);
+		return Bytes(data, len);
+	}
+
+	Writer& String(const char* str)
+	{ return String(str, strlen(str)); }
+
+	Writer& String(const vector<uint8_t>& v)
+	{ return String(v.data(), v.size()); }
+
+	vector<uint8_t> m_buf;
+};
+
+/**
+	@brief Parses SSH wire format data, flagging (rather than overrunning) truncated input
+ */
+class Reader
+{
+public:
+	Reader(const vector<uint8_t>& buf, size_t start = 0)
+	: m_buf(buf)
+	, m_pos(start)
+	, m_ok(start <= buf.size())
+	{}
+
+	uint8_t U8()
+	{
+		if(!Have(1))
+			return 0;
+		return m_buf[m_pos++];
+	}
+
+	uint32_t U32()
+	{
+		if(!Have(4))
+			return 0;
+		uint32_t v = (m_buf[m_pos] << 24) | (m_buf[m_pos+1] << 16) | (m_buf[m_pos+2] << 8) | m_buf[m_pos+3];
+		m_pos += 4;
+		return v;
+	}
+
+	vector<uint8_t> String()
+	{
+		uint32_t len = U32();
+		if(!Have(len))
+			return vector<uint8_t>();
+		vector<uint8_t> ret(m_buf.begin() + m_pos, m_buf.begin() + m_pos + len);
+		m_pos += len;
+		return ret;
+	}
+
+	bool Have(size_t len)
+	{
+		if(m_ok && (m_buf.size() - m_pos >= len) )
+			return true;
+		m_ok = false;
+		return false;
+	}
+
+	const vector<uint8_t>& m_buf;
+	size_t m_pos;
+	bool m_ok;
+};
+
+/**
+	@brief Just enough of an SSH client to log in, run a shell or SFTP, and measure things
+ */
+class BenchSSHClient
+{
+public:
+	BenchSSHClient(ClientTransport& transport)
+	: m_transport(transport)
+	, m_crypto(true)
+	, m_encrypted(false)
+	{}
+
+	bool Connect();
+	bool OpenShell();
+	bool OpenSFTP();
+	void Disconnect();
+
+	bool SendChannelData(const uint8_t* data, size_t len);
+	bool ReadChannelData(vector<uint8_t>& data);
+
+	bool SendSFTP(const vector<uint8_t>& packet);
+	bool ReadSFTP(vector<uint8_t>& packet);
+
+protected:
+	bool ReadExact(uint8_t* data, size_t len);
+	bool SendPacket(const vector<uint8_t>& payload);
+	bool ReadPacket(vector<uint8_t>& payload);
+	bool ExpectPacket(uint8_t type, vector<uint8_t>& payload);
+	bool ChannelRequest(const Writer& request);
+
+	ClientTransport& m_transport;
+	OpenSSLCryptoEngine m_crypto;
+
+	///@brief True once we've switched to the negotiated keys
+	bool m_encrypted;
+
+	///@brief Data read from the transport but not yet parsed
+	vector<uint8_t> m_rxBuffer;
+
+	///@brief Channel data received but not yet parsed as SFTP packets
+	vector<uint8_t> m_sftpBuffer;
+};
+
+/**
+	@brief Reads exactly len bytes from the transport
+ */
+bool BenchSSHClient::ReadExact(uint8_t* data, size_t len)
+{
+	while(m_rxBuffer.size() < len)
+	{
+		uint8_t buf[4096];
+		auto n = m_transport.Receive(buf, sizeof(buf));
+		if(n == 0)
+			return false;
+		m_rxBuffer.insert(m_rxBuffer.end(), buf, buf + n);
+	}
+
+	memcpy(data, m_rxBuffer.data(), len);
+	m_rxBuffer.erase(m_rxBuffer.begin(), m_rxBuffer.begin() + len);
+	return true;
+}
+
+/**
+	@brief Frames (and once keys are negotiated, encrypts) a packet and sends it
+ */
+bool BenchSSHClient::SendPacket(const vector<uint8_t>& payload)
+{
+	//Pad to the block size (16 bytes, not counting the length, once encrypted) with at least 4 bytes of padding
+	size_t blockSize = m_encrypted ? 16 : 8;
+	size_t unpadded = 1 + payload.size() + (m_encrypted ? 0 : 4);
+	size_t padding = blockSize - (unpadded % blockSize);
+	if(padding < 4)
+		padding += blockSize;
+	uint32_t packetLength = 1 + payload.size() + padding;
+
+	vector<uint8_t> packet;
+	Writer w;
+	w.U32(packetLength).U8(padding).Bytes(payload.data(), payload.size());
+	packet.swap(w.m_buf);
+	packet.resize(4 + packetLength + (m_encrypted ? GCM_TAG_SIZE : 0));
+	m_crypto.GenerateRandom(&packet[5 + payload.size()], padding);
+
+	if(m_encrypted)
+		m_crypto.EncryptAndMAC(&packet[4], packetLength);
+
+	return m_transport.Send(packet.data(), packet.size());
+}
+
+/**
+	@brief Reads, decrypts and unframes a packet, returning the payload (starting with the message type)
+ */
+bool BenchSSHClient::ReadPacket(vector<uint8_t>& payload)
+{
+	uint8_t lenbuf[4];
+	if(!ReadExact(lenbuf, sizeof(lenbuf)))
+		return false;
+	uint32_t packetLength = (lenbuf[0] << 24) | (lenbuf[1] << 16) | (lenbuf[2] << 8) | lenbuf[3];
+	if( (packetLength < 5) || (packetLength > 65536) )
+		return false;
+
+	vector<uint8_t> packet(packetLength + (m_encrypted ? GCM_TAG_SIZE : 0));
+	if(!ReadExact(packet.data(), packet.size()))
+		return false;
+	if(m_encrypted && !m_crypto.DecryptAndVerify(packet.data(), packet.size()))
+		return false;
+
+	uint8_t padding = packet[0];
+	if(padding + 2u > packetLength)
+		return false;
+	payload.assign(packet.begin() + 1, packet.begin() + packetLength - padding);
+	return true;
+}
+
+/**
+	@brief Reads packets until one of the given type shows up, skipping over ones that don't need a response
+ */
+bool BenchSSHClient::ExpectPacket(uint8_t type, vector<uint8_t>& payload)
+{
+	while(ReadPacket(payload))
+	{
+		if(payload[0] == type)
+			return true;
+
+		switch(payload[0])
+		{
+			case SSH_MSG_IGNORE:
+			case SSH_MSG_DEBUG:
+			case SSH_MSG_CHANNEL_WINDOW_ADJUST:
+				continue;
+
+			default:
+				fprintf(stderr, "Expected SSH message %d, got %d\n", type, payload[0]);
+				return false;
+		}
+	}
+	return false;
+}
+
+/**
+	@brief Connects, does the key exchange, and logs in with a password
+ */
+bool BenchSSHClient::Connect()
+{
+	m_encrypted = false;
+	m_rxBuffer.clear();
+	m_sftpBuffer.clear();
+	m_crypto.Clear();
+
+	if(!m_transport.Connect())
+		return false;
+
+	//Exchange version banners
+	static const char clientBanner[] = "SSH-2.0-staticnet_bench";
+	if(!m_transport.Send(reinterpret_cast<const uint8_t*>(clientBanner), strlen(clientBanner)) ||
+		!m_transport.Send(reinterpret_cast<const uint8_t*>("\r\n"), 2))
+	{
+		return false;
+	}
+	string serverBanner;
+	while(true)
+	{
+		uint8_t c;
+		if(!ReadExact(&c, 1))
+			return false;
+		if(c == '\n')
+			break;
+		if(c != '\r')
+			serverBanner += c;
+	}
+
+	//Send our KEXINIT, offering only what the server supports
+	Writer kexinit;
+	uint8_t cookie[16];
+	m_crypto.GenerateRandom(cookie, sizeof(cookie));
+	kexinit.U8(SSH_MSG_KEXINIT).Bytes(cookie, sizeof(cookie))
+		.String("curve25519-sha256")
+		.String("ssh-ed25519")
+		.String("aes128-gcm@openssh.com")
+		.String("aes128-gcm@openssh.com")
+		.String("hmac-sha2-256")
+		.String("hmac-sha2-256")
+		.String("none")
+		.String("none")
+		.String("")
+		.String("")
+		.U8(0)
+		.U32(0);
+	if(!SendPacket(kexinit.m_buf))
+		return false;
+
+	vector<uint8_t> serverKexinit;
+	if(!ExpectPacket(SSH_MSG_KEXINIT, serverKexinit))
+		return false;
+
+	//ECDH key exchange
+	uint8_t clientPublic[ECDH_KEY_SIZE];
+	m_crypto.GenerateX25519KeyPair(clientPublic);
+	Writer ecdhInit;
+	ecdhInit.U8(SSH_MSG_KEX_ECDH_INIT).String(clientPublic, sizeof(clientPublic));
+	if(!SendPacket(ecdhInit.m_buf))
+		return false;
+
+	vector<uint8_t> reply;
+	if(!ExpectPacket(SSH_MSG_KEX_ECDH_REPLY, reply))
+		return false;
+	Reader r(reply, 1);
+	auto hostKeyBlob = r.String();
+	auto serverPublic = r.String();
+	auto signatureBlob = r.String();
+	if(!r.m_ok || (serverPublic.size() != ECDH_KEY_SIZE) )
+		return false;
+
+	Reader hostKey(hostKeyBlob);
+	hostKey.String();
+	auto hostPublic = hostKey.String();
+	Reader sig(signatureBlob);
+	sig.String();
+	auto signature = sig.String();
+	if(!hostKey.m_ok || !sig.m_ok || (hostPublic.size() != ECDSA_KEY_SIZE) || (signature.size() != ECDSA_SIG_SIZE) )
+		return false;
+
+	//Exchange hash (RFC 5656 section 4)
+	uint8_t sharedSecret[ECDH_KEY_SIZE];
+	m_crypto.SharedSecret(sharedSecret, serverPublic.data());
+	Writer hashInput;
+	hashInput.String(clientBanner)
+		.String(serverBanner.c_str())
+		.String(kexinit.m_buf)
+		.String(serverKexinit)
+		.String(hostKeyBlob)
+		.String(clientPublic, sizeof(clientPublic))
+		.String(serverPublic);
+	if(sharedSecret[0] & 0x80)
+		hashInput.U32(ECDH_KEY_SIZE + 1).U8(0);
+	else
+		hashInput.U32(ECDH_KEY_SIZE);
+	hashInput.Bytes(sharedSecret, sizeof(sharedSecret));
+
+	uint8_t exchangeHash[SHA256_DIGEST_SIZE];
+	m_crypto.SHA256_Init();
+	for(size_t off = 0; off < hashInput.m_buf.size(); off += 0x8000)
+		m_crypto.SHA256_Update(&hashInput.m_buf[off], min<size_t>(0x8000, hashInput.m_buf.size() - off));
+	m_crypto.SHA256_Final(exchangeHash);
+
+	//Check the server signed it with the key it sent (but we don't care whose key that is)
+	uint8_t signedHash[ECDSA_SIG_SIZE + SHA256_DIGEST_SIZE];
+	memcpy(signedHash, signature.data(), ECDSA_SIG_SIZE);
+	memcpy(signedHash + ECDSA_SIG_SIZE, exchangeHash, SHA256_DIGEST_SIZE);
+	if(!m_crypto.VerifySignature(signedHash, sizeof(signedHash), hostPublic.data()))
+	{
+		fprintf(stderr, "Bad exchange hash signature\n");
+		return false;
+	}
+
+	m_crypto.DeriveSessionKeys(sharedSecret, exchangeHash, exchangeHash);
+
+	//Switch to the new keys. Wait for the server's NEWKEYS before sending anything encrypted.
+	vector<uint8_t> payload;
+	if(!SendPacket(vector<uint8_t>{SSH_MSG_NEWKEYS}) || !ExpectPacket(SSH_MSG_NEWKEYS, payload))
+		return false;
+	m_encrypted = true;
+
+	//Log in
+	Writer service;
+	service.U8(SSH_MSG_SERVICE_REQUEST).String("ssh-userauth");
+	if(!SendPacket(service.m_buf) || !ExpectPacket(SSH_MSG_SERVICE_ACCEPT, payload))
+		return false;
+
+	Writer auth;
+	auth.U8(SSH_MSG_USERAUTH_REQUEST)
+		.String(BENCH_USERNAME)
+		.String("ssh-connection")
+		.String("password")
+		.U8(0)
+		.String(BENCH_PASSWORD);
+	return SendPacket(auth.m_buf) && ExpectPacket(SSH_MSG_USERAUTH_SUCCESS, payload);
+}
+
+/**
+	@brief Sends a channel request that wants a reply, and waits for it
+ */
+bool BenchSSHClient::ChannelRequest(const Writer& request)
+{
+	vector<uint8_t> payload;
+	return SendPacket(request.m_buf) && ExpectPacket(SSH_MSG_CHANNEL_SUCCESS, payload);
+}
+
+/**
+	@brief Opens a session channel with a PTY and shell
+
+	We use channel 0 on our side, same as the server (which checks incoming data against our channel number).
+ */
+bool BenchSSHClient::OpenShell()
+{
+	Writer open;
+	open.U8(SSH_MSG_CHANNEL_OPEN).String("session").U32(0).U32(0x7fffffff).U32(32768);
+	vector<uint8_t> payload;
+	if(!SendPacket(open.m_buf) || !ExpectPacket(SSH_MSG_CHANNEL_OPEN_CONFIRM, payload))
+		return false;
+
+	Writer pty;
+	pty.U8(SSH_MSG_CHANNEL_REQUEST).U32(0).String("pty-req").U8(1)
+		.String("xterm")
+		.U32(80)
+		.U32(24)
+		.U32(0)
+		.U32(0)
+		.String(vector<uint8_t>{0});
+	Writer shell;
+	shell.U8(SSH_MSG_CHANNEL_REQUEST).U32(0).String("shell").U8(1);
+	return ChannelRequest(pty) && ChannelRequest(shell);
+}
+
+/**
+	@brief Opens a session channel running the SFTP subsystem, and does the SFTP version exchange
+ */
+bool BenchSSHClient::OpenSFTP()
+{
+	Writer open;
+	open.U8(SSH_MSG_CHANNEL_OPEN).String("session").U32(0).U32(0x7fffffff).U32(32768);
+	vector<uint8_t> payload;
+	if(!SendPacket(open.m_buf) || !ExpectPacket(SSH_MSG_CHANNEL_OPEN_CONFIRM, payload))
+		return false;
+
+	Writer subsystem;
+	subsystem.U8(SSH_MSG_CHANNEL_REQUEST).U32(0).String("subsystem").U8(1).String("sftp");
+	if(!ChannelRequest(subsystem))
+		return false;
+
+	Writer init;
+	init.U8(SSH_FXP_INIT).U32(3);
+	return SendSFTP(init.m_buf) && ReadSFTP(payload) && (payload[0] == SSH_FXP_VERSION);
+}
+
+/**
+	@brief Sends a disconnect message and closes the connection
+ */
+void BenchSSHClient::Disconnect()
+{
+	Writer disconnect;
+	disconnect.U8(SSH_MSG_DISCONNECT).U32(11).String("").String("");
+	SendPacket(disconnect.m_buf);
+	m_transport.Close();
+}
+
+/**
+	@brief Sends data to the session channel, in packets no bigger than the server's 1024 byte maximum
+ */
+bool BenchSSHClient::SendChannelData(const uint8_t* data, size_t len)
+{
+	while(len > 0)
+	{
+		size_t chunk = min<size_t>(len, 1024);
+		Writer w;
+		w.U8(SSH_MSG_CHANNEL_DATA).U32(0).String(data, chunk);
+		if(!SendPacket(w.m_buf))
+			return false;
+		data += chunk;
+		len -= chunk;
+	}
+	return true;
+}
+
+/**
+	@brief Reads the next packet of session channel data
+ */
+bool BenchSSHClient::ReadChannelData(vector<uint8_t>& data)
+{
+	vector<uint8_t> payload;
+	if(!ExpectPacket(SSH_MSG_CHANNEL_DATA, payload))
+		return false;
+
+	Reader r(payload, 5);
+	data = r.String();
+	return r.m_ok;
+}
+
+/**
+	@brief Sends an SFTP packet (type byte onwards)
+ */
+bool BenchSSHClient::SendSFTP(const vector<uint8_t>& packet)
+{
+	Writer w;
+	w.String(packet);
+	return SendChannelData(w.m_buf.data(), w.m_buf.size());
+}
+
+/**
+	@brief Reads an SFTP packet (type byte onwards), which may span several channel data packets
+ */
+bool BenchSSHClient::ReadSFTP(vector<uint8_t>& packet)
+{
+	while(true)
+	{
+		if(m_sftpBuffer.size() >= 4)
+		{
+			Reader r(m_sftpBuffer);
+			uint32_t len = r.U32();
+			if(m_sftpBuffer.size() >= 4 + len)
+			{
+				packet.assign(m_sftpBuffer.begin() + 4, m_sftpBuffer.begin() + 4 + len);
+				m_sftpBuffer.erase(m_sftpBuffer.begin(), m_sftpBuffer.begin() + 4 + len);
+				return !packet.empty();
+			}
+		}
+
+		vector<uint8_t> data;
+		if(!ReadChannelData(data))
+			return false;
+		m_sftpBuffer.insert(m_sftpBuffer.end(), data.begin(), data.end());
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Benchmarks
+
+static bool g_firstResult = true;
+
+///@brief Starts a JSON result object (the caller prints the fields and closing brace)
+static void BeginResult(const char* name)
+{
+	printf("%s\n\t\t{ \"name\": \"%s\"", g_firstResult ? "" : ",", name);
+	g_firstResult = false;
+}
+
+/**
+	@brief Connects and disconnects repeatedly
+ */
+static bool BenchHandshakes(BenchSSHClient& client, int count)
+{
+	auto start = Clock::now();
+	for(int i=0; i<count; i++)
+	{
+		if(!client.Connect())
+		{
+			fprintf(stderr, "Handshake %d failed\n", i);
+			return false;
+		}
+		client.Disconnect();
+	}
+	double elapsed = SecondsSince(start);
+
+	BeginResult("handshake");
+	printf(", \"count\": %d, \"per_second\": %.2f, \"mean_ms\": %.3f }", count, count / elapsed, elapsed * 1000 / count);
+	return true;
+}
+
+/**
+	@brief Sends one character at a time to the shell and waits for each to come back
+ */
+static bool BenchEcho(BenchSSHClient& client, int count)
+{
+	if(!client.Connect() || !client.OpenShell())
+	{
+		fprintf(stderr, "Shell setup failed\n");
+		return false;
+	}
+
+	vector<double> samples;
+	vector<uint8_t> reply;
+	for(int i=0; i<count + 10; i++)
+	{
+		uint8_t c = 'a' + (i % 26);
+		auto start = Clock::now();
+		if(!client.SendChannelData(&c, 1) || !client.ReadChannelData(reply) || (reply.size() != 1) || (reply[0] != c) )
+		{
+			fprintf(stderr, "Echo %d failed\n", i);
+			return false;
+		}
+
+		//First few are warmup
+		if(i >= 10)
+			samples.push_back(SecondsSince(start) * 1e6);
+	}
+	client.Disconnect();
+
+	sort(samples.begin(), samples.end());
+	BeginResult("echo_latency");
+	printf(", \"count\": %d, \"min_us\": %.1f, \"median_us\": %.1f, \"p99_us\": %.1f }",
+		count,
+		samples[0],
+		samples[samples.size() / 2],
+		samples[samples.size() * 99 / 100]);
+	return true;
+}
+
+/**
+	@brief Waits for a SSH_FXP_STATUS reply and returns the status code (or -1 for anything else)
+ */
+static int ReadSFTPStatus(BenchSSHClient& client)
+{
+	vector<uint8_t> reply;
+	if(!client.ReadSFTP(reply) || (reply[0] != SSH_FXP_STATUS) )
+		return -1;
+	Reader r(reply, 5);
+	return r.U32();
+}
+
+/**
+	@brief Opens a file and returns the handle
+ */
+static bool OpenSFTPFile(BenchSSHClient& client, const char* path, uint32_t pflags, vector<uint8_t>& handle)
+{
+	Writer open;
+	open.U8(SSH_FXP_OPEN).U32(1).String(path).U32(pflags).U32(0);
+	vector<uint8_t> reply;
+	if(!client.SendSFTP(open.m_buf) || !client.ReadSFTP(reply) || (reply[0] != SSH_FXP_HANDLE) )
+		return false;
+
+	Reader r(reply, 5);
+	handle = r.String();
+	return r.m_ok;
+}
+
+static bool CloseSFTPFile(BenchSSHClient& client, const vector<uint8_t>& handle)
+{
+	Writer close;
+	close.U8(SSH_FXP_CLOSE).U32(2).String(handle);
+	return client.SendSFTP(close.m_buf) && (ReadSFTPStatus(client) == SSH_FX_OK);
+}
+
+/**
+	@brief Uploads a file, then downloads it again and checks it came back intact
+
+	One request is outstanding at a time. The server handles requests strictly in order and drops reads it has no
+	transmit buffer for, so pipelining wouldn't help (and could hang the benchmark).
+ */
+static bool BenchSFTP(BenchSSHClient& client, uint32_t size)
+{
+	if(!client.Connect() || !client.OpenSFTP())
+	{
+		fprintf(stderr, "SFTP setup failed\n");
+		return false;
+	}
+
+	vector<uint8_t> data(size);
+	for(uint32_t i=0; i<size; i++)
+		data[i] = (i * 7) ^ (i >> 8);
+
+	//Write
+	vector<uint8_t> handle;
+	auto start = Clock::now();
+	if(!OpenSFTPFile(client, "/bench.bin", SSH_FXF_WRITE | SSH_FXF_CREAT | SSH_FXF_TRUNC, handle))
+		return false;
+	for(uint32_t off=0; off<size; off += SFTP_WRITE_BLOCK)
+	{
+		Writer write;
+		write.U8(SSH_FXP_WRITE).U32(3).String(handle).U64(off).String(&data[off], SFTP_WRITE_BLOCK);
+		if(!client.SendSFTP(write.m_buf) || (ReadSFTPStatus(client) != SSH_FX_OK) )
+		{
+			fprintf(stderr, "SFTP write failed at offset %u\n", off);
+			return false;
+		}
+	}
+	if(!CloseSFTPFile(client, handle))
+		return false;
+	double writeTime = SecondsSince(start);
+
+	//Read it back
+	vector<uint8_t> readback;
+	start = Clock::now();
+	if(!OpenSFTPFile(client, "/bench.bin", SSH_FXF_READ, handle))
+		return false;
+	while(true)
+	{
+		Writer read;
+		read.U8(SSH_FXP_READ).U32(4).String(handle).U64(readback.size()).U32(SFTP_WRITE_BLOCK);
+		vector<uint8_t> reply;
+		if(!client.SendSFTP(read.m_buf) || !client.ReadSFTP(reply))
+			return false;
+
+		if(reply[0] == SSH_FXP_STATUS)
+			break;
+		Reader r(reply, 5);
+		auto block = r.String();
+		if( (reply[0] != SSH_FXP_DATA) || !r.m_ok || block.empty())
+			return false;
+		readback.insert(readback.end(), block.begin(), block.end());
+	}
+	if(!CloseSFTPFile(client, handle))
+		return false;
+	double readTime = SecondsSince(start);
+	client.Disconnect();
+
+	if(readback != data)
+	{
+		fprintf(stderr, "SFTP readback mismatch (%zu of %u bytes)\n", readback.size(), size);
+		return false;
+	}
+
+	BeginResult("sftp_write");
+	printf(", \"bytes\": %u, \"seconds\": %.4f, \"mbytes_per_second\": %.3f }", size, writeTime, size / writeTime / 1e6);
+	BeginResult("sftp_read");
+	printf(", \"bytes\": %u, \"seconds\": %.4f, \"mbytes_per_second\": %.3f }", size, readTime, size / readTime / 1e6);
+	return true;
+}
+
+static bool RunAll(const char* mode, BenchSSHClient& client, int handshakes, int echoes, uint32_t sftpSize)
+{
+	printf("{\n");
+	printf("\t\"benchmark\": \"staticnet-sshbench\",\n");
+	printf("\t\"mode\": \"%s\",\n", mode);
+	printf("\t\"config\": { \"SSH_RX_BUFFER_SIZE\": %d, \"SFTP_RX_BUFFER_SIZE\": %d, \"TCP_RX_WINDOW\": %d, "
+		"\"static_ram_bytes\": %zu },\n",
+		SSH_RX_BUFFER_SIZE, SFTP_RX_BUFFER_SIZE, TCP_RX_WINDOW, MemoryBudget::GetTotalBytes());
+	printf("\t\"results\":\n\t[");
+
+	bool ok =
+		BenchHandshakes(client, handshakes) &&
+		BenchEcho(client, echoes) &&
+		BenchSFTP(client, sftpSize);
+
+	printf("\n\t]\n}\n");
+	return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Entry point
+
+/**
+	@brief Runs the stack on a tap interface until told to stop
+ */
+static void ServeTap(TapEthernetInterface& iface, BenchStack& stack, atomic<bool>& stop)
+{
+	auto nextTick = Clock::now();
+	while(!stop)
+	{
+		//Handle everything that's come in
+		bool idle = true;
+		stack.m_eth.OnRxBurstStart();
+		while(auto frame = iface.GetRxFrame())
+		{
+			stack.m_eth.OnRxFrame(frame);
+			idle = false;
+		}
+		stack.m_eth.OnRxBurstEnd();
+
+		if(Clock::now() >= nextTick)
+		{
+			stack.OnAgingTick10x();
+			nextTick += chrono::milliseconds(100);
+		}
+
+		if(idle)
+			usleep(20);
+	}
+}
+
+static void Usage()
+{
+	fprintf(stderr,
+		"Usage: staticnet-sshbench [inproc | tap <ifname> | serve <ifname>] [options]\n"
+		"    --handshakes <n>    Number of connections for the handshake rate (default 50)\n"
+		"    --echoes <n>        Number of keystrokes for the echo latency (default 1000)\n"
+		"    --sftp-size <n>     Size of the SFTP test file in bytes, multiple of %d (default 1048576)\n",
+		SFTP_WRITE_BLOCK);
+}
+
+int main(int argc, char* argv[])
+{
+	string mode = "inproc";
+	string ifname;
+	int handshakes = 50;
+	int echoes = 1000;
+	uint32_t sftpSize = 1024 * 1024;
+
+	for(int i=1; i<argc; i++)
+	{
+		string arg = argv[i];
+		if( (arg == "inproc") || (arg == "tap") || (arg == "serve") )
+		{
+			mode = arg;
+			if( (mode != "inproc") && (i+1 < argc) )
+				ifname = argv[++i];
+		}
+		else if( (arg == "--handshakes") && (i+1 < argc) )
+			handshakes = atoi(argv[++i]);
+		else if( (arg == "--echoes") && (i+1 < argc) )
+			echoes = atoi(argv[++i]);
+		else if( (arg == "--sftp-size") && (i+1 < argc) )
+			sftpSize = strtoul(argv[++i], nullptr, 10);
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+	if( ( (mode != "inproc") && ifname.empty() ) || (handshakes < 1) || (echoes < 1) ||
+		(sftpSize == 0) || (sftpSize % SFTP_WRITE_BLOCK) )
+	{
+		Usage();
+		return 1;
+	}
+
+	OpenSSLCryptoEngine hostKeyGen;
+	hostKeyGen.GenerateHostKey();
+
+	if(mode == "inproc")
+	{
+		LoopbackInterface iface;
+		BenchStack stack(iface);
+		MACAddress peerMac = g_peerMac;
+		stack.m_cache.Insert(peerMac, g_peerIP);
+
+		LoopbackTransport transport(iface, stack, 40000);
+		BenchSSHClient client(transport);
+		return RunAll("inproc", client, handshakes, echoes, sftpSize) ? 0 : 1;
+	}
+
+	TapEthernetInterface iface(ifname.c_str());
+	BenchStack stack(iface);
+	atomic<bool> stop(false);
+
+	if(mode == "serve")
+	{
+		char fingerprint[64];
+		hostKeyGen.GetHostKeyFingerprint(fingerprint, sizeof(fingerprint));
+		fprintf(stderr, "Serving SSH on %s (10.0.0.1:%d), host key SHA256:%s\n", ifname.c_str(), SSH_PORT, fingerprint);
+		ServeTap(iface, stack, stop);
+		return 0;
+	}
+
+	thread server(ServeTap, ref(iface), ref(stack), ref(stop));
+	SocketTransport transport;
+	BenchSSHClient client(transport);
+	bool ok = RunAll("tap", client, handshakes, echoes, sftpSize);
+	stop = true;
+	server.join();
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,92 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Stack configuration for the host-side benchmarks
+
+	Sizes are representative of a typical firmware build. Override on the command line (e.g. -DARP_CACHE_LINES=64) to
+	benchmark a different configuration.
+ */
+#ifndef staticnet_config_h
+#define staticnet_config_h
+
+#include <string.h>
+
+#define SIMULATION
+
+//No common-embedded-platform on the host, use the stand-in logger
+#define STATICNET_LOG_HEADER "BenchLog.h"
+
+#ifndef ETHERNET_PAYLOAD_MTU
+#define ETHERNET_PAYLOAD_MTU 1500
+#endif
+
+#ifndef ARP_CACHE_WAYS
+#define ARP_CACHE_WAYS 4
+#endif
+
+#ifndef ARP_CACHE_LINES
+#define ARP_CACHE_LINES 256
+#endif
+
+#ifndef TCP_TABLE_WAYS
+#define TCP_TABLE_WAYS 2
+#endif
+
+#ifndef TCP_TABLE_LINES
+#define TCP_TABLE_LINES 16
+#endif
+
+#ifndef TX_BUFFER_FRAMES
+#define TX_BUFFER_FRAMES 8
+#endif
+
+#ifndef SSH_TABLE_SIZE
+#define SSH_TABLE_SIZE 2
+#endif
+
+#ifndef SSH_RX_BUFFER_SIZE
+#define SSH_RX_BUFFER_SIZE 4096
+#endif
+
+#ifndef SSH_MAX_USERNAME
+#define SSH_MAX_USERNAME 32
+#endif
+
+#ifndef SSH_MAX_PASSWORD
+#define SSH_MAX_PASSWORD 32
+#endif
+
+#ifndef CLI_TX_BUFFER_SIZE
+#define CLI_TX_BUFFER_SIZE 1024
+#endif
+
+#endif
@@ -60,6 +60,14 @@ public:
 
 	virtual void Disconnect();
 
+#ifdef STATICNET_PERFORMANCE_COUNTERS
+
+	///@brief Gets the most data the output buffer has held before being flushed
+	uint16_t GetTxBufferHighWatermark() const
+	{ return m_fifo.GetHighWatermark(); }
+
+#endif
+
 protected:
 	int m_sessid;
 	TCPTableEntry* m_socket;
@@ -53,6 +53,7 @@ DHCPClient::DHCPClient(UDPProtocol* udp)
 	, m_leaseValidTime(0)
 	, m_enabled(false)
 {
+	m_udp->RegisterPortHandler(DHCP_CLIENT_PORT, this);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -64,6 +64,11 @@ APBEthernetInterface::APBEthernetInterface(
 	for(int i=0; i<APB_RX_BUFCOUNT; i++)
 		m_rxFreeList.push_back(&m_rxBuffers[i]);
 
+	#ifdef STATICNET_PERFORMANCE_COUNTERS
+		m_perfCounters.m_txBuffers.m_capacity = APB_TX_BUFCOUNT;
+		m_perfCounters.m_rxBuffers.m_capacity = APB_RX_BUFCOUNT;
+	#endif
+
 	//TODO: hardware resets of peripherals?
 
 	#ifdef HAVE_MDMA
@@ -158,12 +163,20 @@ __attribute__((section(".tcmtext")))
 EthernetFrame* APBEthernetInterface::GetTxFrame()
 {
 	if(m_txFreeList.empty())
+	{
+		#ifdef STATICNET_PERFORMANCE_COUNTERS
+			m_perfCounters.m_txBuffers.OnAllocFailed();
+		#endif
 		return nullptr;
+	}
 
 	else
 	{
 		auto ret = m_txFreeList.back();
 		m_txFreeList.pop_back();
+		#ifdef STATICNET_PERFORMANCE_COUNTERS
+			m_perfCounters.m_txBuffers.OnAlloc();
+		#endif
 		return ret;
 	}
 }
@@ -220,7 +233,12 @@ void APBEthernetInterface::SendTxFrame(EthernetFrame* frame, bool markFree)
 
 		//Done, put on free list
 		if(markFree)
+		{
 			m_txFreeList.push_back(frame);
+			#ifdef STATICNET_PERFORMANCE_COUNTERS
+				m_perfCounters.m_txBuffers.OnFree();
+			#endif
+		}
 
 	#elif defined( HAVE_MDMA )
 
@@ -233,6 +251,9 @@ void APBEthernetInterface::SendTxFrame(EthernetFrame* frame, bool markFree)
 		{
 			m_txFreeList.push_back(m_dmaTxFrame);
 			m_dmaTxFrame = nullptr;
+			#ifdef STATICNET_PERFORMANCE_COUNTERS
+				m_perfCounters.m_txBuffers.OnFree();
+			#endif
 		}
 		g_ethPacketLen[0] = len;
 
@@ -291,7 +312,12 @@ void APBEthernetInterface::SendTxFrame(EthernetFrame* frame, bool markFree)
 
 		//Done, put on free list
 		if(markFree)
+		{
 			m_txFreeList.push_back(frame);
+			#ifdef STATICNET_PERFORMANCE_COUNTERS
+				m_perfCounters.m_txBuffers.OnFree();
+			#endif
+		}
 
 	#endif
 }
@@ -303,6 +329,9 @@ void APBEthernetInterface::CancelTxFrame(EthernetFrame* frame)
 {
 	//Return it to the free list
 	m_txFreeList.push_back(frame);
+	#ifdef STATICNET_PERFORMANCE_COUNTERS
+		m_perfCounters.m_txBuffers.OnFree();
+	#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -332,6 +361,11 @@ EthernetFrame* APBEthernetInterface::GetRxFrame()
 	{
 		g_log("Frame dropped due to lack of buffers\n");
 
+		#ifdef STATICNET_PERFORMANCE_COUNTERS
+			m_perfCounters.m_rxFramesDroppedBuffer ++;
+			m_perfCounters.m_rxBuffers.OnAllocFailed();
+		#endif
+
 		//Discard it
 		m_rxBuf->rx_pop = 1;
 		return nullptr;
@@ -342,6 +376,9 @@ EthernetFrame* APBEthernetInterface::GetRxFrame()
 	//Round transaction length up to an integer number of 32-bit words to force 32-bit copies
 	auto frame = m_rxFreeList.back();
 	m_rxFreeList.pop_back();
+	#ifdef STATICNET_PERFORMANCE_COUNTERS
+		m_perfCounters.m_rxBuffers.OnAlloc();
+	#endif
 	frame->SetLength(len);
 	uint32_t padlen = len;
 	if(padlen % 4)
@@ -349,6 +386,7 @@ EthernetFrame* APBEthernetInterface::GetRxFrame()
 	memcpy(frame->RawData(), (void*)&m_rxBuf->rx_buf, padlen);
 	m_rxBuf->rx_pop = 1;
 
+	LATENCY_BEGIN_FRAME();
 	return frame;
 }
 
@@ -358,4 +396,7 @@ __attribute__((section(".tcmtext")))
 void APBEthernetInterface::ReleaseRxFrame(EthernetFrame* frame)
 {
 	m_rxFreeList.push_back(frame);
+	#ifdef STATICNET_PERFORMANCE_COUNTERS
+		m_perfCounters.m_rxBuffers.OnFree();
+	#endif
 }
@@ -37,6 +37,7 @@
 
 #include "../../net/ethernet/EthernetFrame.h"
 #include "EthernetInterfacePerformanceCounters.h"
+#include "../../util/LatencyProfiler.h"
 
 /**
 	@brief Ethernet driver base class
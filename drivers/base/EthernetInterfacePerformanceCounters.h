@@ -37,6 +37,66 @@
 
 #ifdef STATICNET_PERFORMANCE_COUNTERS
 
+/**
+	@brief Usage statistics for a driver's pool of frame buffers
+
+	"In use" means owned by the stack or queued for DMA, i.e. not available to the next allocation. Drivers which
+	allocate from the heap leave m_capacity at zero.
+ */
+class BufferPoolCounters
+{
+public:
+	BufferPoolCounters()
+	: m_capacity(0)
+	, m_inUse(0)
+	, m_peakInUse(0)
+	, m_allocFailures(0)
+	{
+	}
+
+	///@brief Records a successful allocation
+	void OnAlloc()
+	{
+		m_inUse ++;
+		if(m_inUse > m_peakInUse)
+			m_peakInUse = m_inUse;
+	}
+
+	///@brief Records an allocation which failed because the pool was empty
+	void OnAllocFailed()
+	{ m_allocFailures ++; }
+
+	///@brief Records a buffer being returned to the pool
+	void OnFree()
+	{ m_inUse --; }
+
+	/**
+		@brief Gets the smallest number of free buffers the pool has ever had
+
+		Returns UINT32_MAX (unbounded) for heap-backed drivers which have no fixed pool (m_capacity is zero).
+	 */
+	uint32_t GetLowWatermark() const
+	{
+		if(m_capacity == 0)
+			return UINT32_MAX;
+		if(m_peakInUse >= m_capacity)
+			return 0;
+		return m_capacity - m_peakInUse;
+	}
+
+	///@brief Total number of buffers in the pool
+	uint32_t	m_capacity;
+
+	///@brief Number of buffers currently allocated
+	uint32_t	m_inUse;
+
+	///@brief Largest number of buffers which have been allocated at once
+	uint32_t	m_peakInUse;
+
+	///@brief Number of allocations which failed because no buffers were free
+	uint32_t	m_allocFailures;
+};
+
 /**
 	@brief Performance counters for an Ethernet interface
  */
@@ -74,6 +134,12 @@ public:
 
 	///@brief Number of incoming bytes (valid frames only), including headers but not preamble or FCS
 	uint32_t	m_rxBytesTotal;
+
+	///@brief Transmit buffer usage
+	BufferPoolCounters	m_txBuffers;
+
+	///@brief Receive buffer usage
+	BufferPoolCounters	m_rxBuffers;
 };
 
 #endif
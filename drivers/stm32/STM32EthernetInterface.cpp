@@ -84,6 +84,11 @@ STM32EthernetInterface::STM32EthernetInterface()
 	for(int i=0; i<TX_BUFFER_FRAMES; i++)
 		m_txFreeList.Push(&m_txBuffers[i]);
 
+	#ifdef STATICNET_PERFORMANCE_COUNTERS
+		m_perfCounters.m_txBuffers.m_capacity = TX_BUFFER_FRAMES;
+		m_perfCounters.m_rxBuffers.m_capacity = 4;
+	#endif
+
 	//Wait for this write to commit before polling DMA
 	asm("dmb st");
 
@@ -108,9 +113,17 @@ EthernetFrame* STM32EthernetInterface::GetTxFrame()
 
 	//Return the next buffer in the free list, or null if nothing is there
 	if(m_txFreeList.IsEmpty())
+	{
+		#ifdef STATICNET_PERFORMANCE_COUNTERS
+			m_perfCounters.m_txBuffers.OnAllocFailed();
+		#endif
 		return NULL;
+	}
 
 	auto frame = m_txFreeList.Pop();
+	#ifdef STATICNET_PERFORMANCE_COUNTERS
+		m_perfCounters.m_txBuffers.OnAlloc();
+	#endif
 
 	#ifdef ZEROIZE_BUFFERS_BEFORE_USE
 		memset(frame, 0, sizeof(EthernetFrame));
@@ -148,6 +161,9 @@ bool STM32EthernetInterface::CheckForFinishedFrames()
 	{
 		//EthernetFrame has 2 bytes of length before the buffer
 		m_txFreeList.Push(reinterpret_cast<EthernetFrame*>(m_txDmaDescriptors[m_nextTxDescriptorDone].TDES2 - 2));
+		#ifdef STATICNET_PERFORMANCE_COUNTERS
+			m_perfCounters.m_txBuffers.OnFree();
+		#endif
 
 		m_txDmaDescriptors[m_nextTxDescriptorDone].TDES2 = 0;
 
@@ -206,6 +222,9 @@ void STM32EthernetInterface::CancelTxFrame(EthernetFrame* frame)
 {
 	//Return it to the free list
 	m_txFreeList.Push(frame);
+	#ifdef STATICNET_PERFORMANCE_COUNTERS
+		m_perfCounters.m_txBuffers.OnFree();
+	#endif
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -230,6 +249,7 @@ EthernetFrame* STM32EthernetInterface::GetRxFrame()
 		return NULL;
 	len -= 4;
 	frame->SetLength(len);
+	LATENCY_BEGIN_FRAME();
 
 	#ifdef STATICNET_PERFORMANCE_COUNTERS
 
@@ -238,6 +258,7 @@ EthernetFrame* STM32EthernetInterface::GetRxFrame()
 		else
 			m_perfCounters.m_rxFramesMulticast ++;
 		m_perfCounters.m_rxBytesTotal += len;
+		m_perfCounters.m_rxBuffers.OnAlloc();
 
 	#endif
 
@@ -254,6 +275,10 @@ void STM32EthernetInterface::ReleaseRxFrame(EthernetFrame* frame)
 	if(numBuffer >= 4)
 		return;
 
+	#ifdef STATICNET_PERFORMANCE_COUNTERS
+		m_perfCounters.m_rxBuffers.OnFree();
+	#endif
+
 	//Mark the buffer as free for the DMA to use
 	m_rxDmaDescriptors[numBuffer].RDES0 |= 0x80000000;
 
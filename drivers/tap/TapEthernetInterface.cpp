@@ -90,6 +90,9 @@ TapEthernetInterface::~TapEthernetInterface()
 
 EthernetFrame* TapEthernetInterface::GetTxFrame()
 {
+	#ifdef STATICNET_PERFORMANCE_COUNTERS
+		m_perfCounters.m_txBuffers.OnAlloc();
+	#endif
 	return new EthernetFrame;
 }
 
@@ -98,11 +101,14 @@ void TapEthernetInterface::SendTxFrame(EthernetFrame* frame, bool markFree)
 	write(m_hTun, frame->RawData(), frame->Length());
 
 	if(markFree)
-		delete frame;
+		CancelTxFrame(frame);
 }
 
 void TapEthernetInterface::CancelTxFrame(EthernetFrame* frame)
 {
+	#ifdef STATICNET_PERFORMANCE_COUNTERS
+		m_perfCounters.m_txBuffers.OnFree();
+	#endif
 	delete frame;
 }
 
@@ -122,6 +128,8 @@ EthernetFrame* TapEthernetInterface::GetRxFrame()
 
 	else
 	{
+		LATENCY_BEGIN_FRAME();
+
 		#ifdef STATICNET_PERFORMANCE_COUNTERS
 
 			if(frame->DstMAC().IsUnicast())
@@ -129,6 +137,7 @@ EthernetFrame* TapEthernetInterface::GetRxFrame()
 			else
 				m_perfCounters.m_rxFramesMulticast ++;
 			m_perfCounters.m_rxBytesTotal += len;
+			m_perfCounters.m_rxBuffers.OnAlloc();
 
 		#endif
 
@@ -139,5 +148,8 @@ EthernetFrame* TapEthernetInterface::GetRxFrame()
 
 void TapEthernetInterface::ReleaseRxFrame(EthernetFrame* frame)
 {
+	#ifdef STATICNET_PERFORMANCE_COUNTERS
+		m_perfCounters.m_rxBuffers.OnFree();
+	#endif
 	delete frame;
 }
@@ -47,6 +47,11 @@ public:
 	virtual ~TapEthernetInterface();
 
 	virtual EthernetFrame* GetTxFrame() override;
+
+	//Frames come from the heap, so we never run out
+	virtual bool IsTxBufferAvailable() override
+	{ return true; }
+
 	virtual void SendTxFrame(EthernetFrame* frame, bool markFree=true) override;
 	virtual void CancelTxFrame(EthernetFrame* frame) override;
 	virtual EthernetFrame* GetRxFrame() override;
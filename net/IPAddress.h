@@ -0,0 +1,98 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Declaration of IPAddress
+ */
+
+#ifndef IPAddress_h
+#define IPAddress_h
+
+#include "ipv4/IPv4Address.h"
+#include "ipv6/IPv6Address.h"
+
+/**
+	@brief IP address families
+ */
+enum ipfamily_t : uint8_t
+{
+	IP_FAMILY_IPV4,
+	IP_FAMILY_IPV6
+};
+
+/**
+	@brief An IPv4 or IPv6 address, tagged with its family
+
+	Used where state for both families has to live in the same table (e.g. TCP sockets). Protocol code that knows the
+	family at compile time should use IPv4Address or IPv6Address directly.
+ */
+class IPAddress
+{
+public:
+	IPAddress& operator=(const IPv4Address& addr)
+	{
+		m_family = IP_FAMILY_IPV4;
+		m_v4 = addr;
+		return *this;
+	}
+
+	IPAddress& operator=(const IPv6Address& addr)
+	{
+		m_family = IP_FAMILY_IPV6;
+		m_v6 = addr;
+		return *this;
+	}
+
+	bool IsIPv6() const
+	{ return m_family == IP_FAMILY_IPV6; }
+
+	///@brief Which member of the union is valid
+	ipfamily_t m_family;
+
+	union
+	{
+		IPv4Address m_v4;
+		IPv6Address m_v6;
+	};
+};
+
+inline bool operator== (const IPAddress& a, const IPv4Address& b)
+{ return (a.m_family == IP_FAMILY_IPV4) && (a.m_v4.m_word == b.m_word); }
+
+inline bool operator== (const IPAddress& a, const IPv6Address& b)
+{
+	return (a.m_family == IP_FAMILY_IPV6) &&
+		(a.m_v6.m_words[0] == b.m_words[0]) &&
+		(a.m_v6.m_words[1] == b.m_words[1]) &&
+		(a.m_v6.m_words[2] == b.m_words[2]) &&
+		(a.m_v6.m_words[3] == b.m_words[3]);
+}
+
+#endif
@@ -33,30 +33,42 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
-ARPCache::ARPCache()
-	: m_nextWayToEvict(0)
+ARPCacheBase::ARPCacheBase(ARPCacheEntry* entries, uint32_t ways, uint32_t lines)
+	: m_entries(entries)
+	, m_wayTable(nullptr)
+	, m_ways(ways)
+	, m_lines(lines)
+	, m_nextWayToEvict(0)
 	, m_cacheLifetime(300)
 {
 }
 
+/**
+	@brief Points each entry of a way table at the entries of the corresponding way
+
+	Called by the derived class which owns the table, once it's been constructed.
+ */
+void ARPCacheBase::InitWayTable(ARPCacheWay* wayTable)
+{
+	for(uint32_t i=0; i<m_ways; i++)
+		wayTable[i].m_lines = m_entries + i*m_lines;
+	m_wayTable = wayTable;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Address hashing
 
 /**
 	@brief Hashes an IP address and returns a row index
 
-	32-bit FNV-1 for now. Simple and good mixing, but uses a bunch of multiplies so might be slow?
+	A single multiply-shift round, since the address is one word.
  */
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
-size_t ARPCache::Hash(IPv4Address ip)
+size_t ARPCacheBase::Hash(IPv4Address ip)
 {
-	size_t hash = FNV_INITIAL;
-	for(size_t i=0; i<4; i++)
-		hash = (hash * FNV_MULT) ^ ip.m_octets[i];
-
-	return hash % ARP_CACHE_LINES;
+	return HashToIndex(HashWord(0, HashLoad(ip.m_octets)), m_lines);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -68,12 +80,12 @@ size_t ARPCache::Hash(IPv4Address ip)
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
-bool ARPCache::Lookup(MACAddress& mac, IPv4Address ip)
+bool ARPCacheBase::Lookup(MACAddress& mac, IPv4Address ip)
 {
 	size_t hash = Hash(ip);
-	for(size_t way=0; way < ARP_CACHE_WAYS; way++)
+	for(size_t way=0; way < m_ways; way++)
 	{
-		auto& row = m_ways[way].m_lines[hash];
+		auto& row = GetRow(way, hash);
 		if(row.m_valid && row.m_ip == ip)
 		{
 			mac = row.m_mac;
@@ -88,12 +100,12 @@ bool ARPCache::Lookup(MACAddress& mac, IPv4Address ip)
 
 	Also checks for expiration
  */
-bool ARPCache::LookupAndExpiryCheck(MACAddress& mac, IPv4Address ip, uint16_t& expiry)
+bool ARPCacheBase::LookupAndExpiryCheck(MACAddress& mac, IPv4Address ip, uint16_t& expiry)
 {
 	size_t hash = Hash(ip);
-	for(size_t way=0; way < ARP_CACHE_WAYS; way++)
+	for(size_t way=0; way < m_ways; way++)
 	{
-		auto& row = m_ways[way].m_lines[hash];
+		auto& row = GetRow(way, hash);
 		if(row.m_valid && row.m_ip == ip)
 		{
 			mac = row.m_mac;
@@ -107,12 +119,12 @@ bool ARPCache::LookupAndExpiryCheck(MACAddress& mac, IPv4Address ip, uint16_t& e
 /**
 	@brief Checks if the ARP cache contains an entry for a given IP, and returns the validity lifetime if so
  */
-uint16_t ARPCache::GetExpiry(IPv4Address ip)
+uint16_t ARPCacheBase::GetExpiry(IPv4Address ip)
 {
 	size_t hash = Hash(ip);
-	for(size_t way=0; way < ARP_CACHE_WAYS; way++)
+	for(size_t way=0; way < m_ways; way++)
 	{
-		auto& row = m_ways[way].m_lines[hash];
+		auto& row = GetRow(way, hash);
 		if(row.m_valid && row.m_ip == ip)
 			return row.m_lifetime;
 	}
@@ -124,16 +136,16 @@ uint16_t ARPCache::GetExpiry(IPv4Address ip)
 
 	Calling this function if the entry is already present is a legal no-op.
  */
-void ARPCache::Insert(MACAddress& mac, IPv4Address ip)
+void ARPCacheBase::Insert(MACAddress& mac, IPv4Address ip)
 {
 	size_t hash = Hash(ip);
 
 	//Look for a free space or duplicate entry
 	bool foundEmpty = false;
 	size_t way = 0;
-	for(; way < ARP_CACHE_WAYS; way ++)
+	for(; way < m_ways; way ++)
 	{
-		auto& row = m_ways[way].m_lines[hash];
+		auto& row = GetRow(way, hash);
 
 		//There's something in the row. We can't insert here.
 		if(row.m_valid)
@@ -166,11 +178,13 @@ void ARPCache::Insert(MACAddress& mac, IPv4Address ip)
 
 		//Pick another way to use next time
 		//For now, sequential replacement policy
-		m_nextWayToEvict = (m_nextWayToEvict + 1) % ARP_CACHE_WAYS;
+		m_nextWayToEvict ++;
+		if(m_nextWayToEvict >= m_ways)
+			m_nextWayToEvict = 0;
 	}
 
 	//Insert the new entry
-	auto& row = m_ways[way].m_lines[hash];
+	auto& row = GetRow(way, hash);
 	row.m_valid = true;
 	row.m_ip = ip;
 	row.m_mac = mac;
@@ -182,13 +196,13 @@ void ARPCache::Insert(MACAddress& mac, IPv4Address ip)
 
 	Call this function at approximately 1 Hz.
  */
-void ARPCache::OnAgingTick()
+void ARPCacheBase::OnAgingTick()
 {
-	for(size_t i=0; i<ARP_CACHE_WAYS; i++)
+	for(size_t i=0; i<m_ways; i++)
 	{
-		for(size_t j=0; j<ARP_CACHE_LINES; j++)
+		for(size_t j=0; j<m_lines; j++)
 		{
-			auto& row = m_ways[i].m_lines[j];
+			auto& row = GetRow(i, j);
 			if(row.m_valid)
 			{
 				if(row.m_lifetime == 0)
@@ -203,11 +217,11 @@ void ARPCache::OnAgingTick()
 /**
 	@brief Marks the entire cache as invalid
  */
-void ARPCache::Clear()
+void ARPCacheBase::Clear()
 {
-	for(size_t i=0; i<ARP_CACHE_WAYS; i++)
+	for(size_t i=0; i<m_ways; i++)
 	{
-		for(size_t j=0; j<ARP_CACHE_LINES; j++)
-			m_ways[i].m_lines[j].m_valid = false;
+		for(size_t j=0; j<m_lines; j++)
+			GetRow(i, j).m_valid = false;
 	}
 }
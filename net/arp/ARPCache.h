@@ -29,7 +29,7 @@
 
 /**
 	@file
-	@brief Declaration of ARPCache
+	@brief Declaration of ARPCacheBase and SizedARPCache
  */
 
 #ifndef ARPCache_h
@@ -55,21 +55,27 @@ public:
 };
 
 /**
-	@brief A single bank of the ARP cache (direct mapped)
+	@brief One way of the cache, as returned by the deprecated ARPCacheBase::GetWay()
+
+	m_lines points to GetLines() entries, so existing code indexing GetWay(i)->m_lines[j] still works.
  */
 class ARPCacheWay
 {
 public:
-	ARPCacheEntry m_lines[ARP_CACHE_LINES];
+	const ARPCacheEntry* m_lines;
 };
 
 /**
 	@brief The ARP cache
+
+	Set-associative, with the geometry chosen by the derived class which owns the storage (see SizedARPCache). All
+	protocol code works with ARPCacheBase, so caches of different sizes can be used with different interfaces in the
+	same application.
  */
-class ARPCache
+class ARPCacheBase
 {
 public:
-	ARPCache();
+	ARPCacheBase(ARPCacheEntry* entries, uint32_t ways, uint32_t lines);
 
 	bool Lookup(MACAddress& mac, IPv4Address ip);
 	bool LookupAndExpiryCheck(MACAddress& mac, IPv4Address ip, uint16_t& expiry);
@@ -83,23 +89,44 @@ public:
 		@brief Returns the number of ways in the cache
 	 */
 	uint32_t GetWays()
-	{ return ARP_CACHE_WAYS; }
+	{ return m_ways; }
 
 	/**
 		@brief Returns the number of lines in each way of the cache
 	 */
 	uint32_t GetLines()
-	{ return ARP_CACHE_LINES; }
+	{ return m_lines; }
+
+	/**
+		@brief Returns the entry at a given way and line of the cache
+	 */
+	const ARPCacheEntry& GetEntry(uint32_t way, uint32_t line)
+	{ return m_entries[way*m_lines + line]; }
+
+	/**
+		@brief Returns one way of the cache
 
+		Kept for source compatibility with applications written before the geometry became a template parameter.
+	 */
+	[[deprecated("Use GetEntry(way, line)")]]
 	const ARPCacheWay* GetWay(uint32_t i)
-	{ return &m_ways[i]; }
+	{ return &m_wayTable[i]; }
 
 	uint16_t GetExpiry(IPv4Address ip);
 
 protected:
 
-	///@brief The actual cache data
-	ARPCacheWay m_ways[ARP_CACHE_WAYS];
+	///@brief The actual cache data (way-major, m_ways x m_lines)
+	ARPCacheEntry* m_entries;
+
+	///@brief Views of each way of m_entries, for GetWay()
+	ARPCacheWay* m_wayTable;
+
+	///@brief Number of ways in the cache
+	uint32_t m_ways;
+
+	///@brief Number of lines in each way
+	uint32_t m_lines;
 
 	///@brief Cache way to evict next time there's contention for space
 	size_t m_nextWayToEvict;
@@ -108,6 +135,45 @@ protected:
 	uint16_t m_cacheLifetime;
 
 	size_t Hash(IPv4Address ip);
+
+	void InitWayTable(ARPCacheWay* wayTable);
+
+	///@brief Gets the entry for a given way and row
+	ARPCacheEntry& GetRow(size_t way, size_t row)
+	{ return m_entries[way*m_lines + row]; }
+};
+
+/**
+	@brief An ARP cache with storage for WAYS x LINES entries
+
+	Defaults to the ARP_CACHE_WAYS / ARP_CACHE_LINES geometry from staticnet-config.h.
+ */
+template<uint32_t WAYS = ARP_CACHE_WAYS, uint32_t LINES = ARP_CACHE_LINES>
+class SizedARPCache : public ARPCacheBase
+{
+public:
+	SizedARPCache()
+	: ARPCacheBase(m_storage, WAYS, LINES)
+	{
+		//Members are constructed after the base class, so the way table can't be filled in until now
+		InitWayTable(m_wayStorage);
+	}
+
+protected:
+	///@brief The actual cache data
+	ARPCacheEntry m_storage[WAYS * LINES];
+
+	///@brief Storage for the views returned by GetWay()
+	ARPCacheWay m_wayStorage[WAYS];
+};
+
+/**
+	@brief ARP cache with the default geometry
+
+	A class rather than a typedef of SizedARPCache<>, so that it can be forward declared.
+ */
+class ARPCache : public SizedARPCache<>
+{
 };
 
 #endif
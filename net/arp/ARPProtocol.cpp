@@ -36,7 +36,7 @@
 /**
 	@brief Initializes the ARP protocol stack
  */
-ARPProtocol::ARPProtocol(EthernetProtocol& eth, IPv4Address& ip, ARPCache& cache)
+ARPProtocol::ARPProtocol(EthernetProtocol& eth, IPv4Address& ip, ARPCacheBase& cache)
 	: m_eth(eth)
 	, m_ip(ip)
 	, m_cache(cache)
@@ -45,7 +45,7 @@
 class ARPProtocol
 {
 public:
-	ARPProtocol(EthernetProtocol& eth, IPv4Address& ip, ARPCache& cache);
+	ARPProtocol(EthernetProtocol& eth, IPv4Address& ip, ARPCacheBase& cache);
 
 	void SendQuery(IPv4Address& ip);
 
@@ -68,7 +68,7 @@ public:
 	void OnAgingTick()
 	{ m_cache.OnAgingTick(); }
 
-	ARPCache* GetCache()
+	ARPCacheBase* GetCache()
 	{ return &m_cache; }
 
 protected:
@@ -83,7 +83,7 @@ protected:
 	IPv4Address& m_ip;
 
 	///@brief Cache for storing IP -> MAC associations
-	ARPCache& m_cache;
+	ARPCacheBase& m_cache;
 };
 
 #endif
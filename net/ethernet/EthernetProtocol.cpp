@@ -35,7 +35,7 @@
 /**
 	@brief Initializes the Ethernet protocol stack
  */
-EthernetProtocol::EthernetProtocol(EthernetInterface& iface, MACAddress our_mac)
+EthernetProtocol::EthernetProtocol(EthernetDriver& iface, MACAddress our_mac)
 	: m_iface(iface)
 	, m_mac(our_mac)
 	, m_arp(nullptr)
@@ -75,12 +75,17 @@ __attribute__((section(".tcmtext")))
 #endif
 void EthernetProtocol::OnRxFrame(EthernetFrame* frame)
 {
+	LATENCY_BEGIN_FRAME_IF_IDLE();
+	LATENCY_MARK(STAGE_ETHERNET);
+
 	//Discard anything that's not a broadcast or sent to us
 	//TODO: promiscuous mode
 	auto& dst = frame->DstMAC();
 	if( (dst != m_mac) && !dst.IsMulticast())
 	{
+		CountDrop(DROP_WRONG_MAC);
 		m_iface.ReleaseRxFrame(frame);
+		LATENCY_END_FRAME();
 		return;
 	}
 
@@ -101,7 +106,11 @@ void EthernetProtocol::OnRxFrame(EthernetFrame* frame)
 	{
 		//Process ARP frames if we have an attached ARP stack and the frame is big enough to hold a full ARP packet
 		case ETHERTYPE_ARP:
-			if(m_arp && (plen >= sizeof(ARPPacket)) )
+			if(!m_arp)
+				CountDrop(DROP_UNKNOWN_ETHERTYPE);
+			else if(plen < sizeof(ARPPacket))
+				CountDrop(DROP_SHORT_ARP);
+			else
 				m_arp->OnRxPacket(reinterpret_cast<ARPPacket*>(frame->Payload()));
 			break;
 
@@ -122,6 +131,8 @@ void EthernetProtocol::OnRxFrame(EthernetFrame* frame)
 				//then process it
 				m_ipv4->OnRxPacket(packet, plen);
 			}
+			else
+				CountDrop(DROP_UNKNOWN_ETHERTYPE);
 			break;
 
 		//Process IPv6 frames if we have an attached IPv6 stack.
@@ -129,14 +140,50 @@ void EthernetProtocol::OnRxFrame(EthernetFrame* frame)
 		case ETHERTYPE_IPV6:
 			if(m_ipv6)
 				m_ipv6->OnRxPacket(reinterpret_cast<IPv6Packet*>(frame->Payload()), plen);
+			else
+				CountDrop(DROP_UNKNOWN_ETHERTYPE);
 			break;
 
 		//unrecognized ethertype, ignore
 		default:
+			CountDrop(DROP_UNKNOWN_ETHERTYPE);
 			break;
 	}
 
 	m_iface.ReleaseRxFrame(frame);
+	LATENCY_END_FRAME();
+}
+
+/**
+	@brief Notifies upper layers that a burst of frames is about to be passed to OnRxFrame()
+
+	Typical use in the main loop:
+
+		eth.OnRxBurstStart();
+		while(auto frame = iface.GetRxFrame())
+			eth.OnRxFrame(frame);
+		eth.OnRxBurstEnd();
+
+	Lets TCP merge in-order segments on the same socket (see TCP_GRO_BUFFER_SIZE). Calling OnRxFrame() outside a
+	burst works exactly as before.
+ */
+void EthernetProtocol::OnRxBurstStart()
+{
+	if(m_ipv4)
+		m_ipv4->OnRxBurstStart();
+	if(m_ipv6)
+		m_ipv6->OnRxBurstStart();
+}
+
+/**
+	@brief Notifies upper layers that the current burst of received frames is complete
+ */
+void EthernetProtocol::OnRxBurstEnd()
+{
+	if(m_ipv4)
+		m_ipv4->OnRxBurstEnd();
+	if(m_ipv6)
+		m_ipv6->OnRxBurstEnd();
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -153,7 +200,10 @@ EthernetFrame* EthernetProtocol::GetTxFrame(ethertype_t type, const MACAddress&
 	//Allocate a new frame from the transmit driver
 	auto frame = m_iface.GetTxFrame();
 	if(!frame)
+	{
+		TRACE_EVENT(TRACE_FRAME_ALLOC_FAIL, type, 0, 0);
 		return nullptr;
+	}
 
 	//Fill in header fields (no VLAN tag support for now)
 	frame->DstMAC() = dest;
@@ -180,6 +230,8 @@ void EthernetProtocol::OnAgingTick()
 		if(m_ipv4)
 			m_ipv4->OnAgingTick();
 	}
+	if(m_ipv6)
+		m_ipv6->OnAgingTick();
 }
 
 /**
@@ -37,21 +37,59 @@
 
 #include "EthernetCommon.h"
 #include "../../drivers/base/EthernetInterface.h"
+#include "../../util/DropCounters.h"
+
+//By default the stack talks to its drivers through the virtual EthernetInterface API, so different MACs can share
+//one build. Firmware with a single kind of MAC can instead name its driver class in staticnet-config.h, turning every
+//per-frame driver call into a direct, inlinable one. The class must be final (derive a final class from the in-tree
+//driver if need be):
+//	#define STATICNET_ETHERNET_DRIVER			BoardEthernetInterface
+//	#define STATICNET_ETHERNET_DRIVER_HEADER	"BoardEthernetInterface.h"
+#ifdef STATICNET_ETHERNET_DRIVER
+
+#include <type_traits>
+#include STATICNET_ETHERNET_DRIVER_HEADER
+
+typedef STATICNET_ETHERNET_DRIVER EthernetDriver;
+
+static_assert(std::is_base_of<EthernetInterface, EthernetDriver>::value,
+	"STATICNET_ETHERNET_DRIVER must be derived from EthernetInterface");
+static_assert(std::is_final<EthernetDriver>::value,
+	"STATICNET_ETHERNET_DRIVER must be declared final for calls to it to be bound statically");
+
+#else
+
+typedef EthernetInterface EthernetDriver;
+
+#endif
 
 class ARPProtocol;
 class IPv4Protocol;
 class IPv6Protocol;
 
+///@brief Drop reasons for EthernetProtocol (see DropCounted)
+struct EthernetDropReasons
+{
+	///@brief Reasons for discarding a received frame
+	enum DropReason
+	{
+		DROP_WRONG_MAC,				//Unicast to some other MAC address
+		DROP_UNKNOWN_ETHERTYPE,		//No upper layer protocol attached for this ethertype
+		DROP_SHORT_ARP,				//Too small to hold an ARP packet
+		DROP_REASON_COUNT
+	};
+};
+
 /**
 	@brief Ethernet protocol handling
 
 	One instance of this class must be declared for each physical Ethernet interface on the system.
  */
-class EthernetProtocol
+class EthernetProtocol : public DropCounted<EthernetDropReasons>
 {
 public:
 
-	EthernetProtocol(EthernetInterface& iface, MACAddress our_mac);
+	EthernetProtocol(EthernetDriver& iface, MACAddress our_mac);
 
 	bool IsTxBufferAvailable()
 	{ return m_iface.IsTxBufferAvailable(); }
@@ -61,6 +99,7 @@ public:
 	///@brief Sends a frame to the driver
 	void SendTxFrame(EthernetFrame* frame, bool markFree = true)
 	{
+		LATENCY_MARK(STAGE_TX_SUBMIT);
 		frame->ByteSwap();
 		m_iface.SendTxFrame(frame, markFree);
 	}
@@ -74,6 +113,8 @@ public:
 	{ m_iface.CancelTxFrame(frame); }
 
 	void OnRxFrame(EthernetFrame* frame);
+	void OnRxBurstStart();
+	void OnRxBurstEnd();
 
 	void UseARP(ARPProtocol* arp)
 	{ m_arp = arp; }
@@ -102,7 +143,7 @@ public:
 protected:
 
 	///@brief Driver for the Ethernet MAC
-	EthernetInterface& m_iface;
+	EthernetDriver& m_iface;
 
 	///@brief Our MAC address
 	MACAddress m_mac;
@@ -53,8 +53,14 @@ public:
 
 	enum icmptype_t
 	{
-		TYPE_ECHO_REPLY		= 0,
-		TYPE_ECHO_REQUEST	= 8
+		TYPE_ECHO_REPLY			= 0,
+		TYPE_DEST_UNREACHABLE	= 3,
+		TYPE_ECHO_REQUEST		= 8
+	};
+
+	enum unreachable_code_t
+	{
+		CODE_PORT_UNREACHABLE	= 3
 	};
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -37,6 +37,7 @@
 
 ICMPv4Protocol::ICMPv4Protocol(IPv4Protocol& proto)
 	: m_ipv4(proto)
+	, m_errorTokens(ICMP_ERROR_RATE_LIMIT)
 {
 }
 
@@ -97,3 +98,48 @@ void ICMPv4Protocol::OnRxEchoRequest(ICMPv4Packet* packet, uint16_t ipPayloadLen
 	//Send the reply
 	m_ipv4.SendTxPacket(reply, ipPayloadLength);
 }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Error reporting
+
+/**
+	@brief Sends a destination unreachable message in response to a packet we couldn't deliver
+
+	Rate limited to ICMP_ERROR_RATE_LIMIT messages per second; anything over the limit is silently not sent.
+
+	@param original	The offending packet, with the IP header in host byte order as passed up the stack.
+					The upper layer header must still be in network byte order.
+	@param code		Reason for the error
+ */
+void ICMPv4Protocol::SendDestUnreachable(IPv4Packet* original, uint8_t code)
+{
+	if(m_errorTokens == 0)
+		return;
+
+	auto reply = m_ipv4.GetTxPacket(original->m_sourceAddress, IP_PROTO_ICMP);
+	if(reply == nullptr)
+		return;
+	m_errorTokens --;
+
+	//Format the header
+	auto payload = reinterpret_cast<ICMPv4Packet*>(reply->Payload());
+	payload->m_type = ICMPv4Packet::TYPE_DEST_UNREACHABLE;
+	payload->m_code = code;
+	payload->m_checksum = 0;	//filler for checksum calculation
+	memset(payload->m_headerBody, 0, sizeof(payload->m_headerBody));
+
+	//Quote the IP header and first 8 bytes of the original payload, back in network byte order
+	uint16_t plen = original->PayloadLength();
+	if(plen > 8)
+		plen = 8;
+	uint16_t quoteLen = original->HeaderLength() + plen;
+	auto quote = reinterpret_cast<uint8_t*>(payload) + sizeof(ICMPv4Packet);
+	memcpy(quote, original, quoteLen);
+	reinterpret_cast<IPv4Packet*>(quote)->ByteSwap();
+
+	//Calculate the checksum and send
+	uint16_t len = sizeof(ICMPv4Packet) + quoteLen;
+	payload->m_checksum = ~__builtin_bswap16(
+		IPv4Protocol::InternetChecksum(reinterpret_cast<uint8_t*>(payload), len));
+	m_ipv4.SendTxPacket(reply, len);
+}
@@ -37,6 +37,11 @@
 
 #include "ICMPv4Packet.h"
 
+//Default of 10 error messages per second
+#ifndef ICMP_ERROR_RATE_LIMIT
+#define ICMP_ERROR_RATE_LIMIT 10
+#endif
+
 /**
 	@brief ICMPv4 protocol driver
  */
@@ -50,6 +55,16 @@ public:
 		uint16_t ipPayloadLength,
 		IPv4Address sourceAddress);
 
+	void SendDestUnreachable(IPv4Packet* original, uint8_t code);
+
+	/**
+		@brief Timer handler for error rate limiting
+
+		Call this function at approximately 1 Hz.
+	 */
+	void OnAgingTick()
+	{ m_errorTokens = ICMP_ERROR_RATE_LIMIT; }
+
 protected:
 
 	void OnRxEchoRequest(
@@ -59,6 +74,9 @@ protected:
 
 	///The IPv4 protocol stack
 	IPv4Protocol& m_ipv4;
+
+	///@brief Number of error messages we can still send this second
+	uint16_t m_errorTokens;
 };
 
 #endif
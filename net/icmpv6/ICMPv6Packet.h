@@ -55,9 +55,15 @@ public:
 
 	enum icmptype_t
 	{
-		//TYPE_ECHO_REPLY		= 0,
-		//TYPE_ECHO_REQUEST	= 8
-		TYPE_ROUTER_ADVERTISEMENT	= 134
+		TYPE_DEST_UNREACHABLE		= 1,
+		TYPE_ROUTER_ADVERTISEMENT	= 134,
+		TYPE_NEIGHBOR_SOLICITATION	= 135,
+		TYPE_NEIGHBOR_ADVERTISEMENT	= 136
+	};
+
+	enum unreachable_code_t
+	{
+		CODE_PORT_UNREACHABLE		= 4
 	};
 
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
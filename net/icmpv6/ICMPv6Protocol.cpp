@@ -33,13 +33,20 @@
 #include "../../stack/staticnet.h"
 
 //DEBUG
+//Logging comes from common-embedded-platform, checked out next to staticnet. Builds without it (e.g. the host-side
+//benchmarks) name a header providing g_log and LogIndenter in staticnet-config.h instead
+#ifdef STATICNET_LOG_HEADER
+#include STATICNET_LOG_HEADER
+#else
 #include "../../../common-embedded-platform/core/platform.h"
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
 ICMPv6Protocol::ICMPv6Protocol(IPv6Protocol& proto)
 	: m_ipv6(proto)
+	, m_errorTokens(ICMP_ERROR_RATE_LIMIT)
 {
 }
 
@@ -53,6 +60,7 @@ void ICMPv6Protocol::OnRxPacket(
 	ICMPv6Packet* packet,
 	uint16_t ipPayloadLength,
 	IPv6Address sourceAddress,
+	uint8_t hopLimit,
 	uint16_t pseudoHeaderChecksum)
 {
 	//g_log("ICMPv6Protocol::OnRxPacket\n");
@@ -73,8 +81,20 @@ void ICMPv6Protocol::OnRxPacket(
 	//See what we've got
 	switch(packet->m_type)
 	{
+		//Neighbor discovery messages must come from on link (hop limit not decremented, RFC 4861 section 6.1.2)
 		case ICMPv6Packet::TYPE_ROUTER_ADVERTISEMENT:
-			OnRxRouterAdvertisement(packet, ipPayloadLength, sourceAddress);
+			if( (hopLimit == 255) && (packet->m_code == 0) )
+				OnRxRouterAdvertisement(packet, ipPayloadLength, sourceAddress);
+			break;
+
+		case ICMPv6Packet::TYPE_NEIGHBOR_SOLICITATION:
+			if( (hopLimit == 255) && (packet->m_code == 0) )
+				OnRxNeighborSolicitation(packet, ipPayloadLength, sourceAddress);
+			break;
+
+		case ICMPv6Packet::TYPE_NEIGHBOR_ADVERTISEMENT:
+			if( (hopLimit == 255) && (packet->m_code == 0) )
+				OnRxNeighborAdvertisement(packet, ipPayloadLength);
 			break;
 
 		/*case ICMPv6Packet::TYPE_ECHO_REQUEST:
@@ -120,10 +140,10 @@ void ICMPv6Protocol::OnRxRouterAdvertisement(
 
 	//12 and up = options
 	uint8_t* popt = payload + 12;
-	uint8_t* pend = payload + ipPayloadLength;
-	while(popt < pend)
+	uint8_t* pend = reinterpret_cast<uint8_t*>(packet) + ipPayloadLength;
+	while( (popt + 2) <= pend)
 	{
-		auto type = static_cast<RouterAdvertisementOption>(popt[0]);
+		auto type = static_cast<NeighborDiscoveryOption>(popt[0]);
 
 		//abort on invalid length rather than infinite looping
 		uint16_t len = popt[1] * 8;
@@ -134,7 +154,7 @@ void ICMPv6Protocol::OnRxRouterAdvertisement(
 
 		switch(type)
 		{
-			case RouterAdvertisementOption::SourceLinkLayerAddress:
+			case NeighborDiscoveryOption::SourceLinkLayerAddress:
 				{
 					//Validate option length
 					if(len != 8)
@@ -142,10 +162,14 @@ void ICMPv6Protocol::OnRxRouterAdvertisement(
 
 					g_log("Router MAC address: %02x:%02x:%02x:%02x:%02x:%02x\n",
 						popt[2], popt[3], popt[4], popt[5], popt[6], popt[7]);
+
+					//Save it so we don't have to solicit the router
+					auto mac = MACAddress::FromBytes(popt + 2);
+					m_ipv6.GetCache()->Insert(mac, sourceAddress);
 				}
 				break;
 
-			case RouterAdvertisementOption::PrefixInformation:
+			case NeighborDiscoveryOption::PrefixInformation:
 				{
 					//Validate option length
 					if(len != 32)
@@ -197,6 +221,236 @@ void ICMPv6Protocol::OnRxRouterAdvertisement(
 	}
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Neighbor discovery
+
+/**
+	@brief Looks for a source or target link-layer address option in a neighbor discovery message
+
+	@param popt	Start of the options
+	@param pend	End of the packet
+	@param type	Option to look for
+	@param mac	The address, if found
+
+	@return True if the option was found
+ */
+bool ICMPv6Protocol::FindLinkLayerAddress(uint8_t* popt, uint8_t* pend, NeighborDiscoveryOption type, MACAddress& mac)
+{
+	while( (popt + 2) <= pend)
+	{
+		//abort on invalid length rather than infinite looping
+		uint16_t len = popt[1] * 8;
+		if(len == 0)
+			return false;
+		if( (popt + len) > pend)
+			return false;
+
+		if( (static_cast<NeighborDiscoveryOption>(popt[0]) == type) && (len == 8) )
+		{
+			mac = MACAddress::FromBytes(popt + 2);
+			return true;
+		}
+
+		popt += len;
+	}
+
+	return false;
+}
+
+/**
+	@brief Handles an incoming neighbor solicitation
+ */
+void ICMPv6Protocol::OnRxNeighborSolicitation(
+	ICMPv6Packet* packet,
+	uint16_t ipPayloadLength,
+	IPv6Address sourceAddress)
+{
+	//Need at least the reserved field and target address
+	if(ipPayloadLength < 24)
+		return;
+
+	//[0-3] = reserved
+	//[4-19] = target address, must be us
+	uint8_t* payload = packet->Payload();
+	IPv6Address target;
+	memcpy(target.m_octets, payload + 4, IPV6_ADDR_SIZE);
+	if(target != m_ipv6.GetOurAddress())
+		return;
+
+	//Duplicate address detection probe from someone trying to use our address.
+	//Defend it by advertising to all nodes (RFC 4861 section 7.2.4)
+	if(IsUnspecified(sourceAddress))
+	{
+		IPv6Address allNodes = {{0xff, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01}};
+		SendNeighborAdvertisement(allNodes, false);
+		return;
+	}
+
+	//Add entry for sender to our neighbor cache if they told us who they are,
+	//so the reply (and whatever they send next) doesn't need a solicitation of its own
+	MACAddress mac;
+	if(FindLinkLayerAddress(
+		payload + 20,
+		reinterpret_cast<uint8_t*>(packet) + ipPayloadLength,
+		NeighborDiscoveryOption::SourceLinkLayerAddress,
+		mac))
+	{
+		m_ipv6.GetCache()->Insert(mac, sourceAddress);
+	}
+
+	SendNeighborAdvertisement(sourceAddress, true);
+}
+
+/**
+	@brief Handles an incoming neighbor advertisement
+ */
+void ICMPv6Protocol::OnRxNeighborAdvertisement(
+	ICMPv6Packet* packet,
+	uint16_t ipPayloadLength)
+{
+	//Need at least the flags and target address
+	if(ipPayloadLength < 24)
+		return;
+
+	//[0-3] = flags and reserved, ignore
+	//[4-19] = target address
+	uint8_t* payload = packet->Payload();
+	IPv6Address target;
+	memcpy(target.m_octets, payload + 4, IPV6_ADDR_SIZE);
+
+	//No filtering needed, same as ARP: any advertisement with a link-layer address gets in our table
+	MACAddress mac;
+	if(FindLinkLayerAddress(
+		payload + 20,
+		reinterpret_cast<uint8_t*>(packet) + ipPayloadLength,
+		NeighborDiscoveryOption::TargetLinkLayerAddress,
+		mac))
+	{
+		m_ipv6.GetCache()->Insert(mac, target);
+	}
+}
+
+/**
+	@brief Sends a neighbor solicitation for the given address to its solicited-node multicast group
+ */
+void ICMPv6Protocol::SendNeighborSolicitation(IPv6Address target)
+{
+	//Nothing to look up if we don't have a gateway etc configured
+	if(IsUnspecified(target))
+		return;
+
+	//Solicited-node multicast address is ff02::1:ff00:0/104 plus the low 24 bits of the target (RFC 4291 section 2.7.1)
+	IPv6Address dest =
+	{{
+		0xff, 0x02, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x01, 0xff,
+		target.m_octets[13], target.m_octets[14], target.m_octets[15]
+	}};
+
+	auto packet = m_ipv6.GetTxPacket(dest, IP_PROTO_ICMPV6);
+	if(!packet)
+		return;
+
+	auto icmp = reinterpret_cast<ICMPv6Packet*>(packet->Payload());
+	icmp->m_type = ICMPv6Packet::TYPE_NEIGHBOR_SOLICITATION;
+	icmp->m_code = 0;
+
+	//Reserved, then the target address
+	uint8_t* payload = icmp->Payload();
+	memset(payload, 0, 4);
+	memcpy(payload + 4, target.m_octets, IPV6_ADDR_SIZE);
+
+	//Source link-layer address option so the target can reply without soliciting us
+	payload[20] = static_cast<uint8_t>(NeighborDiscoveryOption::SourceLinkLayerAddress);
+	payload[21] = 1;
+	memcpy(payload + 22, m_ipv6.GetEthernet()->GetMACAddress().m_address, ETHERNET_MAC_SIZE);
+
+	SendTxPacket(packet, sizeof(ICMPv6Packet) + 28);
+}
+
+/**
+	@brief Sends a neighbor advertisement for our address
+ */
+void ICMPv6Protocol::SendNeighborAdvertisement(IPv6Address dest, bool solicited)
+{
+	auto packet = m_ipv6.GetTxPacket(dest, IP_PROTO_ICMPV6);
+	if(!packet)
+		return;
+
+	auto icmp = reinterpret_cast<ICMPv6Packet*>(packet->Payload());
+	icmp->m_type = ICMPv6Packet::TYPE_NEIGHBOR_ADVERTISEMENT;
+	icmp->m_code = 0;
+
+	//Flags: solicited (if it was), and always override since this is our own address
+	uint8_t* payload = icmp->Payload();
+	payload[0] = solicited ? 0x60 : 0x20;
+	payload[1] = 0;
+	payload[2] = 0;
+	payload[3] = 0;
+	auto addr = m_ipv6.GetOurAddress();
+	memcpy(payload + 4, addr.m_octets, IPV6_ADDR_SIZE);
+
+	//Target link-layer address option
+	payload[20] = static_cast<uint8_t>(NeighborDiscoveryOption::TargetLinkLayerAddress);
+	payload[21] = 1;
+	memcpy(payload + 22, m_ipv6.GetEthernet()->GetMACAddress().m_address, ETHERNET_MAC_SIZE);
+
+	SendTxPacket(packet, sizeof(ICMPv6Packet) + 28);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Error reporting
+
+/**
+	@brief Sends a destination unreachable message in response to a packet we couldn't deliver
+
+	Rate limited to ICMP_ERROR_RATE_LIMIT messages per second; anything over the limit is silently not sent.
+
+	@param original	The offending packet, with the IP header in host byte order as passed up the stack.
+					The upper layer header must still be in network byte order.
+	@param code		Reason for the error
+ */
+void ICMPv6Protocol::SendDestUnreachable(IPv6Packet* original, uint8_t code)
+{
+	if(m_errorTokens == 0)
+		return;
+
+	auto packet = m_ipv6.GetTxPacket(original->m_sourceAddress, IP_PROTO_ICMPV6);
+	if(!packet)
+		return;
+	m_errorTokens --;
+
+	auto icmp = reinterpret_cast<ICMPv6Packet*>(packet->Payload());
+	icmp->m_type = ICMPv6Packet::TYPE_DEST_UNREACHABLE;
+	icmp->m_code = code;
+
+	//4 bytes unused
+	uint8_t* payload = icmp->Payload();
+	memset(payload, 0, 4);
+
+	//Quote as much of the original as fits without the error exceeding the minimum MTU (RFC 4443 section 3.1)
+	uint32_t quoteLen = sizeof(IPv6Packet) + original->m_payloadLength;
+	uint32_t maxQuote = 1280 - sizeof(IPv6Packet) - sizeof(ICMPv6Packet) - 4;
+	if(quoteLen > maxQuote)
+		quoteLen = maxQuote;
+	memcpy(payload + 4, original, quoteLen);
+	reinterpret_cast<IPv6Packet*>(payload + 4)->ByteSwap();
+
+	SendTxPacket(packet, sizeof(ICMPv6Packet) + 4 + quoteLen);
+}
+
+/**
+	@brief Fills in the checksum of an outbound ICMPv6 packet and sends it
+ */
+void ICMPv6Protocol::SendTxPacket(IPv6Packet* packet, uint16_t icmpLength)
+{
+	auto icmp = reinterpret_cast<ICMPv6Packet*>(packet->Payload());
+	icmp->m_checksum = 0;
+	icmp->m_checksum = ~__builtin_bswap16(IPv4Protocol::InternetChecksum(
+		reinterpret_cast<uint8_t*>(icmp), icmpLength, m_ipv6.PseudoHeaderChecksum(packet, icmpLength)));
+
+	m_ipv6.SendTxPacket(packet, icmpLength);
+}
+
 /**
 	@brief Handles an incoming echo request (ping) packet
  */
@@ -37,6 +37,11 @@
 
 #include "ICMPv6Packet.h"
 
+//Default of 10 error messages per second
+#ifndef ICMP_ERROR_RATE_LIMIT
+#define ICMP_ERROR_RATE_LIMIT 10
+#endif
+
 /**
 	@brief ICMPv6 protocol driver
  */
@@ -49,20 +54,54 @@ public:
 		ICMPv6Packet* packet,
 		uint16_t ipPayloadLength,
 		IPv6Address sourceAddress,
+		uint8_t hopLimit,
 		uint16_t pseudoHeaderChecksum);
 
+	void SendNeighborSolicitation(IPv6Address target);
+
+	void SendDestUnreachable(IPv6Packet* original, uint8_t code);
+
+	/**
+		@brief Timer handler for error rate limiting
+
+		Call this function at approximately 1 Hz.
+	 */
+	void OnAgingTick()
+	{ m_errorTokens = ICMP_ERROR_RATE_LIMIT; }
+
 protected:
 	void OnRxRouterAdvertisement(
 		ICMPv6Packet* packet,
 		uint16_t ipPayloadLength,
 		IPv6Address sourceAddress);
 
-	enum class RouterAdvertisementOption
+	void OnRxNeighborSolicitation(
+		ICMPv6Packet* packet,
+		uint16_t ipPayloadLength,
+		IPv6Address sourceAddress);
+
+	void OnRxNeighborAdvertisement(
+		ICMPv6Packet* packet,
+		uint16_t ipPayloadLength);
+
+	void SendNeighborAdvertisement(IPv6Address dest, bool solicited);
+
+	void SendTxPacket(IPv6Packet* packet, uint16_t icmpLength);
+
+	///@brief Options which can appear in neighbor discovery messages (RFC 4861 section 4.6)
+	enum class NeighborDiscoveryOption
 	{
 		SourceLinkLayerAddress = 1,
+		TargetLinkLayerAddress = 2,
 		PrefixInformation = 3
 	};
 
+	static bool FindLinkLayerAddress(uint8_t* popt, uint8_t* pend, NeighborDiscoveryOption type, MACAddress& mac);
+
+	///@brief Returns true if an address is the unspecified address (::)
+	static bool IsUnspecified(IPv6Address addr)
+	{ return (addr.m_words[0] | addr.m_words[1] | addr.m_words[2] | addr.m_words[3]) == 0; }
+
 /*
 	void OnRxEchoRequest(
 		ICMPv6Packet* packet,
@@ -71,6 +110,9 @@ protected:
 
 	///The IPv6 protocol stack
 	IPv6Protocol& m_ipv6;
+
+	///@brief Number of error messages we can still send this second
+	uint16_t m_errorTokens;
 };
 
 #endif
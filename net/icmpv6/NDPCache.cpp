@@ -0,0 +1,206 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+#include <staticnet-config.h>
+#include <staticnet/stack/staticnet.h>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Construction / destruction
+
+NDPCacheBase::NDPCacheBase(NDPCacheEntry* entries, uint32_t ways, uint32_t lines)
+	: m_entries(entries)
+	, m_wayTable(nullptr)
+	, m_ways(ways)
+	, m_lines(lines)
+	, m_nextWayToEvict(0)
+	, m_cacheLifetime(300)
+{
+}
+
+/**
+	@brief Points each entry of a way table at the entries of the corresponding way
+
+	Called by the derived class which owns the table, once it's been constructed.
+ */
+void NDPCacheBase::InitWayTable(NDPCacheWay* wayTable)
+{
+	for(uint32_t i=0; i<m_ways; i++)
+		wayTable[i].m_lines = m_entries + i*m_lines;
+	m_wayTable = wayTable;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Address hashing
+
+/**
+	@brief Hashes an IP address and returns a row index
+
+	Same multiply-shift hash as the ARP cache. Only the interface identifier (low 64 bits) is hashed, since everything on the
+	link normally shares the same prefix.
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+size_t NDPCacheBase::Hash(IPv6Address ip)
+{
+	uint32_t hash = HashWord(0, HashLoad(ip.m_octets + 8));
+	hash = HashWord(hash, HashLoad(ip.m_octets + 12));
+
+	return HashToIndex(hash, m_lines);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Cache operations
+
+/**
+	@brief Checks if the neighbor cache contains an entry for a given IP, and looks up the corresponding MAC if so
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+bool NDPCacheBase::Lookup(MACAddress& mac, IPv6Address ip)
+{
+	size_t hash = Hash(ip);
+	for(size_t way=0; way < m_ways; way++)
+	{
+		auto& row = GetRow(way, hash);
+		if(row.m_valid && row.m_ip == ip)
+		{
+			mac = row.m_mac;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+	@brief Checks if the neighbor cache contains an entry for a given IP, and returns the validity lifetime if so
+ */
+uint16_t NDPCacheBase::GetExpiry(IPv6Address ip)
+{
+	size_t hash = Hash(ip);
+	for(size_t way=0; way < m_ways; way++)
+	{
+		auto& row = GetRow(way, hash);
+		if(row.m_valid && row.m_ip == ip)
+			return row.m_lifetime;
+	}
+	return 0;
+}
+
+/**
+	@brief Inserts a new entry into the neighbor cache.
+
+	Calling this function if the entry is already present updates the MAC and refreshes the lifetime.
+ */
+void NDPCacheBase::Insert(MACAddress& mac, IPv6Address ip)
+{
+	size_t hash = Hash(ip);
+
+	//Look for a free space or duplicate entry
+	bool foundEmpty = false;
+	size_t way = 0;
+	for(; way < m_ways; way ++)
+	{
+		auto& row = GetRow(way, hash);
+
+		//There's something in the row. We can't insert here.
+		if(row.m_valid)
+		{
+			//Does the row already have an entry for this IP? Update the MAC and lifetime, then we're done
+			if(row.m_ip == ip)
+			{
+				row.m_mac = mac;
+				row.m_lifetime = m_cacheLifetime;
+				return;
+			}
+
+			//Nope, it's another IP. Ignore it.
+		}
+
+		//Unoccupied! Report this way as available for insertion
+		else
+		{
+			foundEmpty = true;
+			break;
+		}
+	}
+
+	//If we get here, it's not already in the cache. Did we have space to insert?
+	//If no space, pick an entry to overwrite (sequential replacement policy, same as ARP)
+	if(!foundEmpty)
+	{
+		way = m_nextWayToEvict;
+		m_nextWayToEvict ++;
+		if(m_nextWayToEvict >= m_ways)
+			m_nextWayToEvict = 0;
+	}
+
+	//Insert the new entry
+	auto& row = GetRow(way, hash);
+	row.m_valid = true;
+	row.m_ip = ip;
+	row.m_mac = mac;
+	row.m_lifetime = m_cacheLifetime;
+}
+
+/**
+	@brief Timer handler for aging out stale cache entries
+
+	Call this function at approximately 1 Hz.
+ */
+void NDPCacheBase::OnAgingTick()
+{
+	for(size_t i=0; i<m_ways; i++)
+	{
+		for(size_t j=0; j<m_lines; j++)
+		{
+			auto& row = GetRow(i, j);
+			if(row.m_valid)
+			{
+				if(row.m_lifetime == 0)
+					row.m_valid = false;
+				else
+					row.m_lifetime --;
+			}
+		}
+	}
+}
+
+/**
+	@brief Marks the entire cache as invalid
+ */
+void NDPCacheBase::Clear()
+{
+	for(size_t i=0; i<m_ways; i++)
+	{
+		for(size_t j=0; j<m_lines; j++)
+			GetRow(i, j).m_valid = false;
+	}
+}
@@ -0,0 +1,189 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Declaration of NDPCacheBase and SizedNDPCache
+ */
+
+#ifndef NDPCache_h
+#define NDPCache_h
+
+#include "../ipv6/IPv6Address.h"
+#include "../ethernet/MACAddress.h"
+
+//Default to the same geometry as the ARP cache
+#ifndef NDP_CACHE_WAYS
+#define NDP_CACHE_WAYS ARP_CACHE_WAYS
+#endif
+
+#ifndef NDP_CACHE_LINES
+#define NDP_CACHE_LINES ARP_CACHE_LINES
+#endif
+
+/**
+	@brief A single entry in an IPv6 neighbor cache
+ */
+class NDPCacheEntry
+{
+public:
+	NDPCacheEntry()
+	: m_valid(false)
+	{}
+
+	bool m_valid;
+	uint16_t m_lifetime;
+	IPv6Address m_ip;
+	MACAddress m_mac;
+};
+
+/**
+	@brief One way of the cache, as returned by the deprecated NDPCacheBase::GetWay()
+
+	m_lines points to GetLines() entries, so existing code indexing GetWay(i)->m_lines[j] still works.
+ */
+class NDPCacheWay
+{
+public:
+	const NDPCacheEntry* m_lines;
+};
+
+/**
+	@brief The IPv6 neighbor cache
+
+	Same set-associative layout and replacement policy as ARPCacheBase, keyed by IPv6 address. The geometry is chosen
+	by the derived class which owns the storage (see SizedNDPCache).
+
+	Entries are simply valid or not: we don't implement the full RFC 4861 reachability state machine. An entry is
+	refreshed whenever we hear from the neighbor via NS/NA and ages out after a fixed lifetime.
+ */
+class NDPCacheBase
+{
+public:
+	NDPCacheBase(NDPCacheEntry* entries, uint32_t ways, uint32_t lines);
+
+	bool Lookup(MACAddress& mac, IPv6Address ip);
+	void Insert(MACAddress& mac, IPv6Address ip);
+
+	void OnAgingTick();
+
+	void Clear();
+
+	/**
+		@brief Returns the number of ways in the cache
+	 */
+	uint32_t GetWays()
+	{ return m_ways; }
+
+	/**
+		@brief Returns the number of lines in each way of the cache
+	 */
+	uint32_t GetLines()
+	{ return m_lines; }
+
+	/**
+		@brief Returns the entry at a given way and line of the cache
+	 */
+	const NDPCacheEntry& GetEntry(uint32_t way, uint32_t line)
+	{ return m_entries[way*m_lines + line]; }
+
+	/**
+		@brief Returns one way of the cache
+
+		Kept for source compatibility with applications written before the geometry became a template parameter.
+	 */
+	[[deprecated("Use GetEntry(way, line)")]]
+	const NDPCacheWay* GetWay(uint32_t i)
+	{ return &m_wayTable[i]; }
+
+	uint16_t GetExpiry(IPv6Address ip);
+
+protected:
+
+	///@brief The actual cache data (way-major, m_ways x m_lines)
+	NDPCacheEntry* m_entries;
+
+	///@brief Views of each way of m_entries, for GetWay()
+	NDPCacheWay* m_wayTable;
+
+	///@brief Number of ways in the cache
+	uint32_t m_ways;
+
+	///@brief Number of lines in each way
+	uint32_t m_lines;
+
+	///@brief Cache way to evict next time there's contention for space
+	size_t m_nextWayToEvict;
+
+	///@brief Lifetime of cache entries, in seconds
+	uint16_t m_cacheLifetime;
+
+	size_t Hash(IPv6Address ip);
+
+	void InitWayTable(NDPCacheWay* wayTable);
+
+	///@brief Gets the entry for a given way and row
+	NDPCacheEntry& GetRow(size_t way, size_t row)
+	{ return m_entries[way*m_lines + row]; }
+};
+
+/**
+	@brief A neighbor cache with storage for WAYS x LINES entries
+
+	Defaults to the NDP_CACHE_WAYS / NDP_CACHE_LINES geometry.
+ */
+template<uint32_t WAYS = NDP_CACHE_WAYS, uint32_t LINES = NDP_CACHE_LINES>
+class SizedNDPCache : public NDPCacheBase
+{
+public:
+	SizedNDPCache()
+	: NDPCacheBase(m_storage, WAYS, LINES)
+	{
+		//Members are constructed after the base class, so the way table can't be filled in until now
+		InitWayTable(m_wayStorage);
+	}
+
+protected:
+	///@brief The actual cache data
+	NDPCacheEntry m_storage[WAYS * LINES];
+
+	///@brief Storage for the views returned by GetWay()
+	NDPCacheWay m_wayStorage[WAYS];
+};
+
+/**
+	@brief Neighbor cache with the default geometry
+
+	A class rather than a typedef of SizedNDPCache<>, so that it can be forward declared.
+ */
+class NDPCache : public SizedNDPCache<>
+{
+};
+
+#endif
@@ -42,7 +42,7 @@
 /**
 	@brief Initializes the IPv4 protocol stack
  */
-IPv4Protocol::IPv4Protocol(EthernetProtocol& eth, IPv4Config& config, ARPCache& cache)
+IPv4Protocol::IPv4Protocol(EthernetProtocol& eth, IPv4Config& config, ARPCacheBase& cache)
 	: m_eth(eth)
 	, m_config(config)
 	, m_cache(cache)
@@ -154,34 +154,46 @@ __attribute__((section(".tcmtext")))
 #endif
 void IPv4Protocol::OnRxPacket(IPv4Packet* packet, uint16_t ethernetPayloadLength)
 {
+	LATENCY_MARK(STAGE_IPV4);
+
 	//Compute the checksum before doing byte swapping, since it expects network byte order
 	//OK to do this before sanity checking the length, because the packet buffer is always a full MTU in size.
 	//Worst case a corrupted length field will lead to us checksumming garbage data after the end of the packet,
 	//but it's guaranteed to be a readable memory address.
 	if(0xffff != InternetChecksum(reinterpret_cast<uint8_t*>(packet), packet->HeaderLength()))
+	{
+		CountDrop(DROP_BAD_CHECKSUM);
 		return;
+	}
 
 	//Swap header fields to host byte order
 	packet->ByteSwap();
 
 	//Must be a well formed packet with no header options
 	if(packet->m_versionAndHeaderLen != 0x45)
+	{
+		CountDrop(DROP_BAD_HEADER);
 		return;
+	}
 
 	//ignore DSCP / ECN
 
 	//Length must be plausible (enough to hold headers and not more than the received packet size)
 	if( (packet->m_totalLength < 20) || (packet->m_totalLength > ethernetPayloadLength) )
+	{
+		CountDrop(DROP_BAD_LENGTH);
 		return;
+	}
 
 	//Ignore fragment ID
 
 	//Flags must have evil bit and more-fragments bit clear, and no frag offset (not a fragment)
 	//Ignore DF bit.
-	if( (packet->m_flagsFragOffHigh & 0xbf) != 0)
-		return;
-	if(packet->m_fragOffLow != 0)
+	if( ( (packet->m_flagsFragOffHigh & 0xbf) != 0) || (packet->m_fragOffLow != 0) )
+	{
+		CountDrop(DROP_FRAGMENT);
 		return;
+	}
 
 	//Ignore TTL
 
@@ -192,7 +204,10 @@ void IPv4Protocol::OnRxPacket(IPv4Packet* packet, uint16_t ethernetPayloadLength
 	//TODO: discard anything directed to a multicast group we're not interested in?
 	auto type = GetAddressType(packet->m_destAddress );
 	if( (type == ADDR_UNICAST_OTHER) && !m_allowUnknownUnicasts)
+	{
+		CountDrop(DROP_UNKNOWN_UNICAST);
 		return;
+	}
 
 	//Figure out the upper layer protocol
 	uint16_t plen = packet->PayloadLength();
@@ -201,7 +216,11 @@ void IPv4Protocol::OnRxPacket(IPv4Packet* packet, uint16_t ethernetPayloadLength
 		//We respond to pings sent to unicast or broadcast addresses only.
 		//Ignore any multicast destinations for ICMP traffic.
 		case IP_PROTO_ICMP:
-			if(m_icmpv4 && ( (type == ADDR_UNICAST_US) || (type == ADDR_BROADCAST) ) )
+			if(!m_icmpv4)
+				CountDrop(DROP_UNKNOWN_PROTOCOL);
+			else if( (type != ADDR_UNICAST_US) && (type != ADDR_BROADCAST) )
+				CountDrop(DROP_WRONG_ADDRESS_TYPE);
+			else
 			{
 				m_icmpv4->OnRxPacket(
 					reinterpret_cast<ICMPv4Packet*>(packet->Payload()),
@@ -214,7 +233,11 @@ void IPv4Protocol::OnRxPacket(IPv4Packet* packet, uint16_t ethernetPayloadLength
 		//TCP segments must be directed at our unicast address.
 		//The connection oriented flow makes no sense to be broadcast/multicast.
 		case IP_PROTO_TCP:
-			if(m_tcp && (type == ADDR_UNICAST_US) )
+			if(!m_tcp)
+				CountDrop(DROP_UNKNOWN_PROTOCOL);
+			else if(type != ADDR_UNICAST_US)
+				CountDrop(DROP_WRONG_ADDRESS_TYPE);
+			else
 			{
 				m_tcp->OnRxPacket(
 					reinterpret_cast<TCPSegment*>(packet->Payload()),
@@ -226,7 +249,11 @@ void IPv4Protocol::OnRxPacket(IPv4Packet* packet, uint16_t ethernetPayloadLength
 
 		//Allow unknown unicasts on request for UDP to enable e.g. DHCP
 		case IP_PROTO_UDP:
-			if(m_udp && ( (type == ADDR_UNICAST_US) || m_allowUnknownUnicasts) )
+			if(!m_udp)
+				CountDrop(DROP_UNKNOWN_PROTOCOL);
+			else if( (type != ADDR_UNICAST_US) && !m_allowUnknownUnicasts)
+				CountDrop(DROP_WRONG_ADDRESS_TYPE);
+			else
 			{
 				m_udp->OnRxPacket(
 					reinterpret_cast<UDPPacket*>(packet->Payload()),
@@ -238,6 +265,7 @@ void IPv4Protocol::OnRxPacket(IPv4Packet* packet, uint16_t ethernetPayloadLength
 
 		//ignore any unknown protocols
 		default:
+			CountDrop(DROP_UNKNOWN_PROTOCOL);
 			break;
 	}
 }
@@ -271,6 +299,8 @@ void IPv4Protocol::OnAgingTick()
 {
 	if(m_udp)
 		m_udp->OnAgingTick();
+	if(m_icmpv4)
+		m_icmpv4->OnAgingTick();
 
 	auto expiry = m_cache.GetExpiry(m_config.m_gateway);
 
@@ -283,6 +313,24 @@ void IPv4Protocol::OnAgingTick()
 	}
 }
 
+/**
+	@brief Called before a burst of received packets
+ */
+void IPv4Protocol::OnRxBurstStart()
+{
+	if(m_tcp)
+		m_tcp->OnRxBurstStart();
+}
+
+/**
+	@brief Called after a burst of received packets, to flush any data coalesced during the burst
+ */
+void IPv4Protocol::OnRxBurstEnd()
+{
+	if(m_tcp)
+		m_tcp->OnRxBurstEnd();
+}
+
 /**
 	@brief Called at 10 Hz to handle retransmit aging
  */
@@ -39,6 +39,7 @@
 #include "IPv4Address.h"
 #include "IPv4Packet.h"
 #include "../IPProtocols.h"
+#include "../../util/DropCounters.h"
 
 inline bool operator!= (const IPv4Address& a, const IPv4Address& b)
 { return a.m_word != b.m_word; }
@@ -59,18 +60,35 @@ public:
 };
 
 class ICMPv4Protocol;
-class TCPProtocol;
+class TCPProtocolBase;
 class UDPProtocol;
 
 #define IPV4_PAYLOAD_MTU (ETHERNET_PAYLOAD_MTU - 20)
 
+///@brief Drop reasons for IPv4Protocol (see DropCounted)
+struct IPv4DropReasons
+{
+	///@brief Reasons for discarding a received packet
+	enum DropReason
+	{
+		DROP_BAD_CHECKSUM,			//Header checksum failed
+		DROP_BAD_HEADER,			//Not version 4, or has header options
+		DROP_BAD_LENGTH,			//Total length too small, or bigger than the frame
+		DROP_FRAGMENT,				//Fragments are not supported
+		DROP_UNKNOWN_UNICAST,		//Unicast to some other IP address
+		DROP_WRONG_ADDRESS_TYPE,	//Destination address type not allowed for this protocol (e.g. TCP to broadcast)
+		DROP_UNKNOWN_PROTOCOL,		//No upper layer protocol attached for this protocol number
+		DROP_REASON_COUNT
+	};
+};
+
 /**
 	@brief IPv4 protocol driver
  */
-class IPv4Protocol
+class IPv4Protocol : public DropCounted<IPv4DropReasons>
 {
 public:
-	IPv4Protocol(EthernetProtocol& eth, IPv4Config& config, ARPCache& cache);
+	IPv4Protocol(EthernetProtocol& eth, IPv4Config& config, ARPCacheBase& cache);
 
 	bool IsTxBufferAvailable()
 	{ return m_eth.IsTxBufferAvailable(); }
@@ -94,6 +112,8 @@ public:
 	{ m_eth.CancelTxFrame(reinterpret_cast<EthernetFrame*>(reinterpret_cast<uint8_t*>(packet) - ETHERNET_PAYLOAD_OFFSET)); }
 
 	void OnRxPacket(IPv4Packet* packet, uint16_t ethernetPayloadLength);
+	void OnRxBurstStart();
+	void OnRxBurstEnd();
 
 	void OnLinkUp();
 	void OnLinkDown();
@@ -114,7 +134,7 @@ public:
 	void UseICMPv4(ICMPv4Protocol* icmpv4)
 	{ m_icmpv4 = icmpv4; }
 
-	void UseTCP(TCPProtocol* tcp)
+	void UseTCP(TCPProtocolBase* tcp)
 	{ m_tcp = tcp; }
 
 	void UseUDP(UDPProtocol* udp)
@@ -129,6 +149,9 @@ public:
 	IPv4Address GetOurAddress()
 	{ return m_config.m_address; }
 
+	ICMPv4Protocol* GetICMPv4()
+	{ return m_icmpv4; }
+
 protected:
 
 	///@brief The Ethernet protocol stack
@@ -138,13 +161,13 @@ protected:
 	IPv4Config& m_config;
 
 	///@brief Cache for storing IP -> MAC associations
-	ARPCache& m_cache;
+	ARPCacheBase& m_cache;
 
 	///@brief ICMPv4 protocol
 	ICMPv4Protocol* m_icmpv4;
 
 	///@brief TCP protocol
-	TCPProtocol* m_tcp;
+	TCPProtocolBase* m_tcp;
 
 	///@brief UDP protocol
 	UDPProtocol* m_udp;
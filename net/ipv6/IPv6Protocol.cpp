@@ -37,7 +37,13 @@
 #endif
 
 //DEBUG
+//Logging comes from common-embedded-platform, checked out next to staticnet. Builds without it (e.g. the host-side
+//benchmarks) name a header providing g_log and LogIndenter in staticnet-config.h instead
+#ifdef STATICNET_LOG_HEADER
+#include STATICNET_LOG_HEADER
+#else
 #include "../../../common-embedded-platform/core/platform.h"
+#endif
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
@@ -45,12 +51,13 @@
 /**
 	@brief Initializes the IPv6 protocol stack
  */
-IPv6Protocol::IPv6Protocol(EthernetProtocol& eth, IPv6Config& config)
+IPv6Protocol::IPv6Protocol(EthernetProtocol& eth, IPv6Config& config, NDPCacheBase& cache)
 	: m_eth(eth)
 	, m_config(config)
+	, m_cache(cache)
 	, m_icmpv6(nullptr)
-	//, m_tcp(nullptr)
-	//, m_udp(nullptr)
+	, m_tcp(nullptr)
+	, m_udp(nullptr)
 	, m_allowUnknownUnicasts(false)
 {
 
@@ -60,12 +67,25 @@ IPv6Protocol::IPv6Protocol(EthernetProtocol& eth, IPv6Config& config)
 // Checksum calculation
 
 /**
-	@brief Calculates the TCP/UDP pseudoheader checksum for a packet
+	@brief Calculates the TCP/UDP pseudoheader checksum for a received packet (header in host byte order)
  */
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
 uint16_t IPv6Protocol::PseudoHeaderChecksum(IPv6Packet* packet)
+{
+	return PseudoHeaderChecksum(packet, packet->m_payloadLength);
+}
+
+/**
+	@brief Calculates the TCP/UDP pseudoheader checksum for a packet with a given upper layer length
+
+	Used for outbound packets, since the payload length isn't filled in until SendTxPacket().
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+uint16_t IPv6Protocol::PseudoHeaderChecksum(IPv6Packet* packet, uint16_t length)
 {
 	uint16_t workingChecksum = IPv4Protocol::InternetChecksum(packet->m_sourceAddress.m_octets, 16);
 	workingChecksum = IPv4Protocol::InternetChecksum(packet->m_destAddress.m_octets, 16, workingChecksum);
@@ -74,8 +94,8 @@ uint16_t IPv6Protocol::PseudoHeaderChecksum(IPv6Packet* packet)
 	{
 		0x0,
 		packet->m_nextHeader,
-		static_cast<uint8_t>(packet->m_payloadLength >> 8),
-		static_cast<uint8_t>(packet->m_payloadLength & 0xff)
+		static_cast<uint8_t>(length >> 8),
+		static_cast<uint8_t>(length & 0xff)
 	};
 
 	return IPv4Protocol::InternetChecksum(pseudoheader, sizeof(pseudoheader), workingChecksum);
@@ -93,9 +113,9 @@ IPv6Protocol::AddressType IPv6Protocol::GetAddressType(IPv6Address addr)
 	if(addr.m_octets[0] == 0xff)
 		return ADDR_MULTICAST;
 
-	//TODO: check for match to our link local or globally routable addresses
-	//if(addr == m_config.m_address)
-	//	return ADDR_UNICAST_US;
+	//TODO: check for match to our link local address too
+	if(addr == m_config.m_address)
+		return ADDR_UNICAST_US;
 
 	//For anything else
 	else
@@ -104,13 +124,24 @@ IPv6Protocol::AddressType IPv6Protocol::GetAddressType(IPv6Address addr)
 
 /**
 	@brief Checks if an address is in our local subnet or not
+
+	Link-local addresses (fe80::/10) are always on link.
  */
-/*
 bool IPv6Protocol::IsLocalSubnet(IPv6Address addr)
 {
-	return (addr.m_word & m_config.m_netmask.m_word) == (m_config.m_address.m_word & m_config.m_netmask.m_word);
+	if( (addr.m_octets[0] == 0xfe) && ( (addr.m_octets[1] & 0xc0) == 0x80) )
+		return true;
+
+	for(size_t i=0; i<4; i++)
+	{
+		if( (addr.m_words[i] & m_config.m_netmask.m_words[i]) !=
+			(m_config.m_address.m_words[i] & m_config.m_netmask.m_words[i]) )
+		{
+			return false;
+		}
+	}
+	return true;
 }
-*/
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Handler for incoming packets
@@ -120,6 +151,8 @@ bool IPv6Protocol::IsLocalSubnet(IPv6Address addr)
  */
 void IPv6Protocol::OnRxPacket(IPv6Packet* packet, uint16_t ethernetPayloadLength)
 {
+	LATENCY_MARK(STAGE_IPV6);
+
 	//See what we got
 /*	g_log("IPv6Protocol::OnRxPacket(%u bytes)\n", (uint32_t)ethernetPayloadLength);
 	LogIndenter li(g_log);*/
@@ -131,11 +164,17 @@ void IPv6Protocol::OnRxPacket(IPv6Packet* packet, uint16_t ethernetPayloadLength
 
 	//Must be IPv6, ignore traffic class and flow label
 	if( (packet->m_versionTrafficClassFlowLabel & 0xf0000000) != 0x60000000)
+	{
+		CountDrop(DROP_BAD_HEADER);
 		return;
+	}
 
 	//Length must be plausible (not more than the MTU, we don't support fragmentation)
-	if( (packet->m_payloadLength + 36) > ethernetPayloadLength)
+	if( (packet->m_payloadLength + sizeof(IPv6Packet)) > ethernetPayloadLength)
+	{
+		CountDrop(DROP_BAD_LENGTH);
 		return;
+	}
 
 	//Ignore hop limit
 
@@ -165,55 +204,68 @@ void IPv6Protocol::OnRxPacket(IPv6Packet* packet, uint16_t ethernetPayloadLength
 	//TODO: discard anything directed to a multicast group we're not interested in?
 	auto type = GetAddressType(packet->m_destAddress );
 	if( (type == ADDR_UNICAST_OTHER) && !m_allowUnknownUnicasts)
+	{
+		CountDrop(DROP_UNKNOWN_UNICAST);
 		return;
+	}
 
 	//Figure out the upper layer protocol
 	switch(packet->m_nextHeader)
 	{
 		//ICMPv6 can be unicast (ping) or multicast (router advertisement)
 		case IP_PROTO_ICMPV6:
-			if(m_icmpv6 && ( (type == ADDR_UNICAST_US) || (type == ADDR_MULTICAST) ) )
+			if(!m_icmpv6)
+				CountDrop(DROP_UNKNOWN_PROTOCOL);
+			else if( (type != ADDR_UNICAST_US) && (type != ADDR_MULTICAST) )
+				CountDrop(DROP_WRONG_ADDRESS_TYPE);
+			else
 			{
 				m_icmpv6->OnRxPacket(
 					reinterpret_cast<ICMPv6Packet*>(packet->Payload()),
 					packet->m_payloadLength,
 					packet->m_sourceAddress,
+					packet->m_hopLimit,
+					PseudoHeaderChecksum(packet));
+			}
+			break;
+
+		//TCP segments must be directed at our unicast address.
+		//The connection oriented flow makes no sense to be broadcast/multicast.
+		case IP_PROTO_TCP:
+			if(!m_tcp)
+				CountDrop(DROP_UNKNOWN_PROTOCOL);
+			else if(type != ADDR_UNICAST_US)
+				CountDrop(DROP_WRONG_ADDRESS_TYPE);
+			else
+			{
+				m_tcp->OnRxPacket(
+					reinterpret_cast<TCPSegment*>(packet->Payload()),
+					packet->m_payloadLength,
+					packet->m_sourceAddress,
 					PseudoHeaderChecksum(packet));
 			}
 			break;
 
+		//UDP can be unicast or multicast
+		case IP_PROTO_UDP:
+			if(m_udp)
+			{
+				m_udp->OnRxPacket(
+					reinterpret_cast<UDPPacket*>(packet->Payload()),
+					packet->m_payloadLength,
+					packet->m_sourceAddress,
+					PseudoHeaderChecksum(packet));
+			}
+			else
+				CountDrop(DROP_UNKNOWN_PROTOCOL);
+			break;
+
 		//Drop anything unrecognized
 		default:
 			g_log("Unknown next header %d, ignoring\n", packet->m_nextHeader);
+			CountDrop(DROP_UNKNOWN_PROTOCOL);
 			break;
 	}
-
-	/*
-	//TCP segments must be directed at our unicast address.
-	//The connection oriented flow makes no sense to be broadcast/multicast.
-	case IP_PROTO_TCP:
-		if(m_tcp && (type == ADDR_UNICAST_US) )
-		{
-			m_tcp->OnRxPacket(
-				reinterpret_cast<TCPSegment*>(packet->Payload()),
-				plen,
-				packet->m_sourceAddress,
-				PseudoHeaderChecksum(packet, plen));
-		}
-		break;
-
-	//Allow unknown unicasts on request for UDP to enable e.g. DHCP
-	case IP_PROTO_UDP:
-		if(m_udp && ( (type == ADDR_UNICAST_US) || m_allowUnknownUnicasts) )
-		{
-			m_udp->OnRxPacket(
-				reinterpret_cast<UDPPacket*>(packet->Payload()),
-				plen,
-				packet->m_sourceAddress,
-				PseudoHeaderChecksum(packet, plen));
-		}
-		break;
-	*/
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -224,12 +276,9 @@ void IPv6Protocol::OnRxPacket(IPv6Packet* packet, uint16_t ethernetPayloadLength
  */
 void IPv6Protocol::OnLinkUp()
 {
-	/*
-	//Send an ARP query for the default gateway
-	auto arp = m_eth.GetARP();
-	if(arp)
-		arp->SendQuery(m_config.m_gateway);
-	*/
+	//Send a neighbor solicitation for the default gateway
+	if(m_icmpv6)
+		m_icmpv6->SendNeighborSolicitation(m_config.m_gateway);
 }
 
 /**
@@ -237,144 +286,115 @@ void IPv6Protocol::OnLinkUp()
  */
 void IPv6Protocol::OnLinkDown()
 {
-	//m_cache.Clear();
+	m_cache.Clear();
 }
 
 /**
 	@brief Called at 1 Hz to handle cache aging
  */
-/*
 void IPv6Protocol::OnAgingTick()
 {
-	if(m_udp)
-		m_udp->OnAgingTick();
+	m_cache.OnAgingTick();
+	if(m_icmpv6)
+		m_icmpv6->OnAgingTick();
 
 	auto expiry = m_cache.GetExpiry(m_config.m_gateway);
 
 	//If it expires soon, send a query
-	if(expiry < 15)
-	{
-		auto arp = m_eth.GetARP();
-		if(arp)
-			arp->SendQuery(m_config.m_gateway);
-	}
+	if( (expiry < 15) && m_icmpv6)
+		m_icmpv6->SendNeighborSolicitation(m_config.m_gateway);
 }
-*/
 
 /**
-	@brief Called at 10 Hz to handle retransmit aging
+	@brief Called before a burst of received packets
  */
-/*
-void IPv6Protocol::OnAgingTick10x()
+void IPv6Protocol::OnRxBurstStart()
 {
-	//Check the TCP stack for anything we might have to retransmit etc
 	if(m_tcp)
-		m_tcp->OnAgingTick10x();
+		m_tcp->OnRxBurstStart();
+}
+
+/**
+	@brief Called after a burst of received packets, to flush any data coalesced during the burst
+ */
+void IPv6Protocol::OnRxBurstEnd()
+{
+	if(m_tcp)
+		m_tcp->OnRxBurstEnd();
 }
-*/
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Handler for outbound packets
 
 /**
-	@brief Allocates an outbound packet and prepare to send it
+	@brief Figures out the destination MAC address for a packet
 
-	Returns nullptr if we don't have an ARP entry for the destination yet and it's not a broadcast
+	Multicasts map directly to a MAC address (RFC 2464 section 7). Unicasts are looked up in the neighbor cache, using
+	the default gateway for anything off link.
+
+	@return True if the MAC address is known, false if we can't send to this destination yet
  */
-/*
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
-IPv6Packet* IPv6Protocol::GetTxPacket(IPv6Address dest, ipproto_t proto)
+bool IPv6Protocol::ResolveNextHop(IPv6Address dest, MACAddress& mac)
 {
-	auto arp = m_eth.GetARP();
+	if(GetAddressType(dest) == ADDR_MULTICAST)
+	{
+		mac = MACAddress{{0x33, 0x33, dest.m_octets[12], dest.m_octets[13], dest.m_octets[14], dest.m_octets[15]}};
+		return true;
+	}
 
-	//Find target MAC address
 	//If not in our subnet, send it to the default gateway
-	MACAddress destmac = {{0, 0, 0, 0, 0, 0}};
+	IPv6Address nextHop = dest;
 	if(!IsLocalSubnet(dest))
-	{
-		if(!m_cache.Lookup(destmac, m_config.m_gateway))
-		{
-			//Send an ARP query for the default gateway
-			if(arp)
-				arp->SendQuery(m_config.m_gateway);
+		nextHop = m_config.m_gateway;
 
-			//But  for now, nothing we can do
-			return nullptr;
-		}
-	}
+	if(m_cache.Lookup(mac, nextHop))
+		return true;
 
-	//It's in the local subnet. Either broadcast or ARP
-	else
-	{
-		auto type = GetAddressType(dest);
-		uint16_t expiry;
-		switch(type)
-		{
-			//TODO: use well known mac for some multicasts
-			//For now, just fall through to broadcast MAC
-			case ADDR_MULTICAST:
-
-			//If it's a broadcast, set it to a layer-2 broadcast MAC
-			case ADDR_BROADCAST:
-				destmac = MACAddress{{0xff, 0xff, 0xff, 0xff, 0xff, 0xff}};
-				break;
-
-			//Unicast? Check the ARP table
-			case ADDR_UNICAST_OTHER:
-
-				//Not in ARP cache? Send a query, but nothing we can do right now
-				if(!m_cache.LookupAndExpiryCheck(destmac, dest, expiry))
-				{
-					if(arp)
-						arp->SendQuery(dest);
-					return nullptr;
-				}
-
-				//In cache, but expiring soon? Send a query to refresh the cache entry
-				else if(expiry < 15)
-				{
-					if(arp)
-						arp->SendQuery(dest);
-				}
-
-				break;
-
-			//invalid destination (can't send to ourself)
-			default:
-				return nullptr;
-		}
-	}
+	//Not in cache? Send a solicitation, but nothing we can do right now
+	if(m_icmpv6)
+		m_icmpv6->SendNeighborSolicitation(nextHop);
+	return false;
+}
+
+/**
+	@brief Allocates an outbound packet and prepare to send it
+
+	Returns nullptr if we don't know the MAC address for the destination yet
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+IPv6Packet* IPv6Protocol::GetTxPacket(IPv6Address dest, ipproto_t proto)
+{
+	MACAddress destmac;
+	if(!ResolveNextHop(dest, destmac))
+		return nullptr;
 
 	//Allocate the frame and fill headers
-	auto frame = m_eth.GetTxFrame(ETHERTYPE_IPV4, destmac);
+	auto frame = m_eth.GetTxFrame(ETHERTYPE_IPV6, destmac);
 	if(!frame)
 		return nullptr;
 
 	auto reply = reinterpret_cast<IPv6Packet*>(frame->Payload());
-	reply->m_versionAndHeaderLen = 0x45;
-	reply->m_dscpAndECN = 0;
-	reply->m_fragID = 0;
-	reply->m_flagsFragOffHigh = 0x40;	//DF
-	reply->m_fragOffLow = 0;
-	reply->m_ttl = 0xff;
-	reply->m_protocol = proto;
+	reply->m_versionTrafficClassFlowLabel = 0x60000000;
+	reply->m_payloadLength = 0;
+	reply->m_nextHeader = proto;
+	reply->m_hopLimit = 0xff;
 	reply->m_sourceAddress = m_config.m_address;
 	reply->m_destAddress = dest;
-	reply->m_headerChecksum = 0;
 
 	//Done
 	return reply;
 }
-*/
 
 /**
 	@brief Sends a packet to the driver
 
 	The packet MUST have been allocated by GetTxPacket().
  */
-/*
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
@@ -385,20 +405,17 @@ void IPv6Protocol::SendTxPacket(IPv6Packet* packet, size_t upperLayerLength, boo
 	auto frame = reinterpret_cast<EthernetFrame*>(reinterpret_cast<uint8_t*>(packet) - ETHERNET_PAYLOAD_OFFSET);
 
 	//Update length in both IP header and Ethernet frame metadata
-	packet->m_totalLength = packet->HeaderLength() + upperLayerLength;
-	frame->SetPayloadLength(packet->m_totalLength);
+	packet->m_payloadLength = upperLayerLength;
+	frame->SetPayloadLength(sizeof(IPv6Packet) + upperLayerLength);
 
-	//Final fixup of checksum and byte ordering before sending it out
+	//No header checksum in IPv6, just fix byte ordering before sending it out
 	packet->ByteSwap();
-	packet->m_headerChecksum = ~__builtin_bswap16(InternetChecksum(reinterpret_cast<uint8_t*>(packet), 20));
 	m_eth.SendTxFrame(frame, markFree);
 }
-*/
 
 /**
 	@brief Re-sends a packet without touching the checksums or doing any byte swapping etc
  */
-/*
 void IPv6Protocol::ResendTxPacket(IPv6Packet* packet, bool markFree)
 {
 	//Get the full frame given the packet
@@ -408,4 +425,3 @@ void IPv6Protocol::ResendTxPacket(IPv6Packet* packet, bool markFree)
 	//Send it
 	m_eth.ResendTxFrame(frame, markFree);
 }
-*/
@@ -39,14 +39,18 @@
 #include "IPv6Address.h"
 #include "IPv6Packet.h"
 #include "../IPProtocols.h"
-
-/*
-inline bool operator!= (const IPv6Address& a, const IPv6Address& b)
-{ return a.m_word != b.m_word; }
+#include "../../util/DropCounters.h"
 
 inline bool operator== (const IPv6Address& a, const IPv6Address& b)
-{ return a.m_word == b.m_word; }
-*/
+{
+	return (a.m_words[0] == b.m_words[0]) &&
+		(a.m_words[1] == b.m_words[1]) &&
+		(a.m_words[2] == b.m_words[2]) &&
+		(a.m_words[3] == b.m_words[3]);
+}
+
+inline bool operator!= (const IPv6Address& a, const IPv6Address& b)
+{ return !(a == b); }
 
 /**
 	@brief IPv6 address configuration
@@ -61,46 +65,62 @@ public:
 };
 
 class ICMPv6Protocol;
-class TCPProtocol;
+class TCPProtocolBase;
 class UDPProtocol;
 
-//#define IPV4_PAYLOAD_MTU (ETHERNET_PAYLOAD_MTU - 20)
+#define IPV6_PAYLOAD_MTU (ETHERNET_PAYLOAD_MTU - 40)
+
+///@brief Drop reasons for IPv6Protocol (see DropCounted)
+struct IPv6DropReasons
+{
+	///@brief Reasons for discarding a received packet
+	enum DropReason
+	{
+		DROP_BAD_HEADER,			//Not version 6
+		DROP_BAD_LENGTH,			//Payload length bigger than the frame
+		DROP_UNKNOWN_UNICAST,		//Unicast to some other IP address
+		DROP_WRONG_ADDRESS_TYPE,	//Destination address type not allowed for this protocol (e.g. TCP to multicast)
+		DROP_UNKNOWN_PROTOCOL,		//No upper layer protocol attached for this next header value
+		DROP_REASON_COUNT
+	};
+};
 
 /**
 	@brief IPv6 protocol driver
  */
-class IPv6Protocol
+class IPv6Protocol : public DropCounted<IPv6DropReasons>
 {
 public:
-	IPv6Protocol(EthernetProtocol& eth, IPv6Config& config);
+	IPv6Protocol(EthernetProtocol& eth, IPv6Config& config, NDPCacheBase& cache);
 
 	IPv6Protocol(const IPv6Protocol& rhs) =delete;
 
+	bool IsTxBufferAvailable()
+	{ return m_eth.IsTxBufferAvailable(); }
+
 	/**
 		@brief Enables reception of unicast IPv6 packets to addresses other than what we currently have configured
 	 */
 	void SetAllowUnknownUnicasts(bool allow)
 	{ m_allowUnknownUnicasts = allow; }
 
-	/*
 	IPv6Packet* GetTxPacket(IPv6Address dest, ipproto_t proto);
 	void SendTxPacket(IPv6Packet* packet, size_t upperLayerLength, bool markFree = true);
 	void ResendTxPacket(IPv6Packet* packet, bool markFree = false);
-	*/
 
 	///@brief Cancels sending of a packet
 	void CancelTxPacket(IPv6Packet* packet)
 	{ m_eth.CancelTxFrame(reinterpret_cast<EthernetFrame*>(reinterpret_cast<uint8_t*>(packet) - ETHERNET_PAYLOAD_OFFSET)); }
 
 	void OnRxPacket(IPv6Packet* packet, uint16_t ethernetPayloadLength);
+	void OnRxBurstStart();
+	void OnRxBurstEnd();
 
 	void OnLinkUp();
 	void OnLinkDown();
-	/*
 	void OnAgingTick();
-	void OnAgingTick10x();
-	*/
 	uint16_t PseudoHeaderChecksum(IPv6Packet* packet);
+	uint16_t PseudoHeaderChecksum(IPv6Packet* packet, uint16_t length);
 
 	enum AddressType
 	{
@@ -111,16 +131,14 @@ public:
 
 	void UseICMPv6(ICMPv6Protocol* icmpv6)
 	{ m_icmpv6 = icmpv6; }
-	/*
-	void UseTCP(TCPProtocol* tcp)
+
+	void UseTCP(TCPProtocolBase* tcp)
 	{ m_tcp = tcp; }
 
 	void UseUDP(UDPProtocol* udp)
 	{ m_udp = udp; }
-	*/
 
 	AddressType GetAddressType(IPv6Address addr);
-	/*
 	bool IsLocalSubnet(IPv6Address addr);
 
 	EthernetProtocol* GetEthernet()
@@ -129,23 +147,32 @@ public:
 	IPv6Address GetOurAddress()
 	{ return m_config.m_address; }
 
+	NDPCacheBase* GetCache()
+	{ return &m_cache; }
+
+	ICMPv6Protocol* GetICMPv6()
+	{ return m_icmpv6; }
+
 protected:
-	*/
+	bool ResolveNextHop(IPv6Address dest, MACAddress& mac);
+
 	///@brief The Ethernet protocol stack
 	EthernetProtocol& m_eth;
 
 	///@brief Our local IP address configuration
 	IPv6Config& m_config;
 
+	///@brief Cache for storing IP -> MAC associations
+	NDPCacheBase& m_cache;
+
 	///@brief ICMPv6 protocol
 	ICMPv6Protocol* m_icmpv6;
-	/*
+
 	///@brief TCP protocol
-	TCPProtocol* m_tcp;
+	TCPProtocolBase* m_tcp;
 
 	///@brief UDP protocol
 	UDPProtocol* m_udp;
-	*/
 
 	///@brief True to forward unicasts to unknown addresses to us
 	bool m_allowUnknownUnicasts;
@@ -30,98 +30,482 @@
 #include <staticnet-config.h>
 #include <staticnet/stack/staticnet.h>
 
+//The statically bound server type (see TCPServerType) has to be complete to call its handlers
+#ifdef STATICNET_TCP_SERVER
+
+#include STATICNET_TCP_SERVER_HEADER
+
+static_assert(std::is_base_of<TCPServerBase, TCPServerType>::value,
+	"STATICNET_TCP_SERVER must be derived from TCPServerBase");
+static_assert(std::is_final<TCPServerType>::value,
+	"STATICNET_TCP_SERVER must be declared final for calls to it to be bound statically");
+
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
-TCPProtocol::TCPProtocol(IPv4Protocol* ipv4)
+TCPProtocolBase::TCPProtocolBase(
+	IPv4Protocol* ipv4,
+	IPv6Protocol* ipv6,
+	TCPTableEntry* socketTable,
+	uint16_t tableWays,
+	uint16_t tableLines,
+	TCPTimeWaitEntry* timeWaitTable,
+	uint16_t timeWaitTableSize)
 	: m_ipv4(ipv4)
+	, m_ipv6(ipv6)
+	, m_socketTable(socketTable)
+	, m_tableWays(tableWays)
+	, m_tableLines(tableLines)
+	, m_numListenPorts(0)
+	, m_freeSegments(nullptr)
+	, m_timeWaitTable(timeWaitTable)
+	, m_timeWaitTableSize(timeWaitTableSize)
+	, m_keepaliveIdle(TCP_DECISECONDS_TO_TICKS(TCP_KEEPALIVE_IDLE))
+	, m_keepaliveInterval(TCP_DECISECONDS_TO_TICKS(TCP_KEEPALIVE_INTERVAL))
+	, m_keepaliveMaxProbes(TCP_KEEPALIVE_PROBES)
+	, m_cookieSecretValid(false)
+	, m_inRxBurst(false)
+	, m_groSocket(nullptr)
+	, m_groLength(0)
+	, m_groBuffer(nullptr)
+	, m_groBufferSize(0)
+{
+}
+
+/**
+	@brief Puts all of the segment tracking entries in a pool on the free list
+
+	Called by the derived class which owns the pool, once it's been constructed.
+ */
+void TCPProtocolBase::InitSegmentPool(TCPSentSegment* pool, uint16_t size)
+{
+	for(uint16_t i=0; i<size; i++)
+	{
+		pool[i].m_next = m_freeSegments;
+		m_freeSegments = &pool[i];
+	}
+}
+
+/**
+	@brief Sets the buffer used for receive coalescing (see OnRxBurstStart())
+
+	Called by the derived class which owns the buffer. A size of zero disables coalescing.
+ */
+void TCPProtocolBase::InitCoalescingBuffer(uint8_t* buf, uint16_t size)
 {
+	m_groBuffer = buf;
+	m_groBufferSize = size;
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Initialization
+// Listen table
+
+/**
+	@brief Registers a server to handle connections on a local port
+
+	Registration is expected to happen at startup, so this is a simple insertion into the sorted table.
+
+	@return False if the port already has a server or the table is full
+ */
+bool TCPProtocolBase::RegisterServer(uint16_t port, TCPServerType* server)
+{
+	if( (m_numListenPorts >= TCP_MAX_LISTEN_PORTS) || GetServer(port) )
+		return false;
+
+	//Shift larger ports up to make room, keeping the table sorted
+	uint16_t i = m_numListenPorts;
+	for(; (i > 0) && (m_listenPorts[i-1].m_port > port); i--)
+		m_listenPorts[i] = m_listenPorts[i-1];
+
+	m_listenPorts[i].m_port = port;
+	m_listenPorts[i].m_server = server;
+	m_numListenPorts ++;
+	return true;
+}
+
+/**
+	@brief Stops accepting new connections for a server
 
+	Connections which are already open stay with the server they were accepted by.
+ */
+void TCPProtocolBase::UnregisterServer(uint16_t port)
+{
+	for(uint16_t i=0; i<m_numListenPorts; i++)
+	{
+		if(m_listenPorts[i].m_port != port)
+			continue;
+
+		for(; i+1 < m_numListenPorts; i++)
+			m_listenPorts[i] = m_listenPorts[i+1];
+		m_numListenPorts --;
+		return;
+	}
+}
+
+/**
+	@brief Looks up the server registered on a local port
+
+	@return The server, or null if there isn't one
+ */
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
-TCPSegment* TCPProtocol::GetTxSegment(TCPTableEntry* state)
+TCPServerType* TCPProtocolBase::GetServer(uint16_t port)
 {
-	//Make sure we have space in the outbox for it
-	bool ok = false;
-	for(size_t i=0; i<TCP_MAX_UNACKED; i++)
+	uint16_t lo = 0;
+	uint16_t hi = m_numListenPorts;
+	while(lo < hi)
 	{
-		if(state->m_unackedFrames[i].m_segment == nullptr)
-		{
-			ok = true;
-			break;
-		}
+		uint16_t mid = (lo + hi) / 2;
+		if(m_listenPorts[mid].m_port < port)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if( (lo < m_numListenPorts) && (m_listenPorts[lo].m_port == port) )
+		return m_listenPorts[lo].m_server;
+	return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Socket table introspection
+
+/**
+	@brief Iterates over open sockets, for dumping connection state and statistics
+
+	Pass null to get the first socket, then the previous return value to get the next, until null is returned.
+
+	The cursor is just a position in the table, so it's fine to keep handling traffic between calls (e.g. when the
+	dump is itself being sent over TCP). Sockets opened or closed in the meantime may or may not be returned.
+ */
+const TCPTableEntry* TCPProtocolBase::GetNextSocket(const TCPTableEntry* prev)
+{
+	//Figure out where to resume
+	size_t i = 0;
+	if(prev)
+		i = (prev - m_socketTable) + 1;
+
+	//The table is flat, so it's just a linear scan
+	for(size_t count = m_tableWays * m_tableLines; i < count; i++)
+	{
+		if(m_socketTable[i].m_valid)
+			return &m_socketTable[i];
 	}
-	if(!ok)
+
+	return nullptr;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Initialization
+
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+TCPSegment* TCPProtocolBase::GetTxSegment(TCPTableEntry* state)
+{
+	//Can't send data once we've closed our half of the connection
+	if( (state->m_state != TCPTableEntry::STATE_ESTABLISHED) && (state->m_state != TCPTableEntry::STATE_CLOSE_WAIT) )
 		return nullptr;
 
-	//Allocate the frame and fail if we couldn't allocate one
-	auto reply = CreateReply(state);
-	if(!reply)
+	//Make sure we have space in the outbox for it
+	if( (state->m_unackedCount >= TCP_MAX_UNACKED) || (m_freeSegments == nullptr) )
+		return nullptr;
+
+	//Allocate the frame (null if we couldn't allocate one)
+	auto segment = CreateReply(state);
+	if(!segment)
 		return nullptr;
 
-	//All good, allocate the reply
-	return reinterpret_cast<TCPSegment*>(reply->Payload());
+	//Reserve its tracking entry now, so other sockets can't drain the pool before it's sent
+	auto s = m_freeSegments;
+	m_freeSegments = s->m_next;
+	s->m_segment = segment;
+	s->m_next = state->m_reservedHead;
+	state->m_reservedHead = s;
+	state->m_unackedCount ++;
+
+	return segment;
 }
 
-void TCPProtocol::CancelTxSegment(TCPSegment* segment, TCPTableEntry* state)
+/**
+	@brief Removes the tracking entry GetTxSegment() reserved for a segment from the socket's reserved list
+
+	@return The entry, or null if the segment has none
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+TCPSentSegment* TCPProtocolBase::TakeReservation(TCPTableEntry* state, TCPSegment* segment)
 {
-	//Remove the segment from the list of unacked frames
-	for(size_t i=0; i<TCP_MAX_UNACKED; i++)
+	TCPSentSegment* prev = nullptr;
+	for(auto s = state->m_reservedHead; s != nullptr; prev = s, s = s->m_next)
 	{
-		if(state->m_unackedFrames[i].m_segment == segment)
-		{
-			//Clear it
-			state->m_unackedFrames[i].m_segment = nullptr;
+		if(s->m_segment != segment)
+			continue;
 
-			//For now, don't check for subsequent unacked frames
-			//We can only cancel the most recently allocated frame
-			break;
-		}
+		if(prev)
+			prev->m_next = s->m_next;
+		else
+			state->m_reservedHead = s->m_next;
+		s->m_next = nullptr;
+		return s;
+	}
+
+	return nullptr;
+}
+
+/**
+	@brief Checks if a socket can send a burst of segments right away
+
+	The socket must be open for sending, have room under TCP_MAX_UNACKED and in the shared segment pool for all of
+	them, and the remote side's window must fit all of the data. TX buffers aren't checked.
+
+	@param state	The socket
+	@param segments	Number of segments in the burst
+	@param bytes	Total payload bytes across all of the segments
+ */
+bool TCPProtocolBase::CanSendBurst(TCPTableEntry* state, uint16_t segments, uint32_t bytes)
+{
+	if( (state->m_state != TCPTableEntry::STATE_ESTABLISHED) && (state->m_state != TCPTableEntry::STATE_CLOSE_WAIT) )
+		return false;
+	if( (state->m_unackedCount + segments > TCP_MAX_UNACKED) || (GetSendWindow(state) < bytes) )
+		return false;
+
+	uint16_t free = 0;
+	for(auto s = m_freeSegments; s && (free < segments); s = s->m_next)
+		free ++;
+	return (free >= segments);
+}
+
+void TCPProtocolBase::CancelTxSegment(TCPSegment* segment, TCPTableEntry* state)
+{
+	//Give back its tracking entry, if it still has one
+	auto s = TakeReservation(state, segment);
+	if(s)
+	{
+		state->m_unackedCount --;
+		s->m_next = m_freeSegments;
+		m_freeSegments = s;
+	}
+
+	//Remove the segment from the list of unacked frames, if it got that far
+	TCPSentSegment* prev = nullptr;
+	for(s = state->m_unackedHead; s != nullptr; prev = s, s = s->m_next)
+	{
+		if(s->m_segment != segment)
+			continue;
+
+		if(prev)
+			prev->m_next = s->m_next;
+		else
+			state->m_unackedHead = s->m_next;
+		if(state->m_unackedTail == s)
+			state->m_unackedTail = prev;
+		state->m_unackedCount --;
+
+		s->m_next = m_freeSegments;
+		m_freeSegments = s;
+		break;
 	}
 
 	//Cancel the packet in the upper layer
-	m_ipv4->CancelTxPacket(reinterpret_cast<IPv4Packet*>(reinterpret_cast<uint8_t*>(segment) - sizeof(IPv4Packet)));
+	FreeTxSegment(state, segment);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-// Handle aging of packets
+// Timers
+
+/**
+	@brief Called at 10 Hz to drive the timers, if TCP_TIMER_HZ is 10.
+
+	If TCP_TIMER_HZ is set to anything else this does nothing, and OnTimerTick() must be called at that rate instead.
+ */
+void TCPProtocolBase::OnAgingTick10x()
+{
+	#if TCP_TIMER_HZ == 10
+		OnTimerTick();
+	#endif
+}
+
+/**
+	@brief Called at TCP_TIMER_HZ to determine if we need to retransmit anything, send keepalives, or time out idle,
+	half-open and closing sockets
+
+	Only timers which expire on this tick are touched, so idle sockets cost nothing.
+ */
+void TCPProtocolBase::OnTimerTick()
+{
+	//Don't let coalesced data sit around if the driver never ends the burst
+	if(m_groLength)
+		FlushCoalescedData();
+
+	m_timers.Tick();
+
+	while(auto timer = m_timers.PopExpired())
+	{
+		switch(timer->m_type)
+		{
+			case TCPTimer::TYPE_RETRANSMIT:
+				OnRetransmitTimer(reinterpret_cast<TCPTableEntry*>(timer->m_owner));
+				break;
+
+			case TCPTimer::TYPE_SOCKET:
+				OnSocketTimer(reinterpret_cast<TCPTableEntry*>(timer->m_owner));
+				break;
+
+			case TCPTimer::TYPE_TIME_WAIT:
+				reinterpret_cast<TCPTimeWaitEntry*>(timer->m_owner)->m_valid = false;
+				break;
+
+			default:
+				break;
+		}
+	}
+}
 
 /**
-	@brief Called at 10 Hz to determine if we need to retransmit anything
+	@brief Resends any segments which have gone unacknowledged for too long
  */
-void TCPProtocol::OnAgingTick10x()
+void TCPProtocolBase::OnRetransmitTimer(TCPTableEntry* state)
 {
-	//Go through all open sockets and look to see if we have anything due to retransmit
-	for(size_t way=0; way<TCP_TABLE_WAYS; way++)
+	auto now = GetTime();
+
+	//Resend anything that's due, and figure out when the next segment will be
+	bool pending = false;
+	uint32_t next = TCP_RETRANSMIT_TICKS;
+	for(auto f = state->m_unackedHead; f != nullptr; f = f->m_next)
 	{
-		for(size_t line=0; line<TCP_TABLE_LINES; line++)
+		//Segment has aged out, resend it
+		auto age = now - f->m_sentTime;
+		if(age >= TCP_RETRANSMIT_TICKS)
 		{
-			auto& sock = m_socketTable[way].m_lines[line];
+			f->m_sentTime = now;
+			f->m_retransmitted = true;
+			age = 0;
+
+			#ifdef STATICNET_PERFORMANCE_COUNTERS
+				state->m_perfCounters.m_txSegmentsRetransmitted ++;
+			#endif
+			TRACE_EVENT(TRACE_TCP_RETRANSMIT, state->m_remotePort, f->m_endSeq - f->m_length, f->m_length);
+
+			if(f->m_segment)
+				ResendTxSegment(state, f->m_segment);
+
+			//No frame to resend, have the application rebuild it.
+			//If it can't, there's a hole in the stream that will never be filled so the connection is dead.
+			else if(!ResendRegeneratedSegment(state, f))
+			{
+				SendReset(state);
+				ReleaseSocket(state);
+				return;
+			}
+		}
 
-			//Age all of our queued frames
-			for(size_t i=0; i<TCP_MAX_UNACKED; i++)
+		pending = true;
+		if( (TCP_RETRANSMIT_TICKS - age) < next)
+			next = TCP_RETRANSMIT_TICKS - age;
+	}
+
+	if(pending)
+		m_timers.Arm(&state->m_retransmitTimer, next);
+}
+
+/**
+	@brief Handles handshake, keepalive, and close timeouts for a socket
+ */
+void TCPProtocolBase::OnSocketTimer(TCPTableEntry* state)
+{
+	auto idle = GetTime() - state->m_lastActivity;
+	uint32_t next = 0;
+
+	switch(state->m_state)
+	{
+		//Discard half-open sockets if the handshake never completed.
+		//The upper layer was never told about them, so no need to notify anyone.
+		case TCPTableEntry::STATE_SYN_RECEIVED:
+			if(idle >= TCP_DECISECONDS_TO_TICKS(TCP_SYN_RECEIVED_TIMEOUT))
 			{
-				auto& f = sock.m_unackedFrames[i];
-				if(!f.m_segment)
-					continue;
+				ReleaseSocket(state);
+				return;
+			}
+			next = TCP_DECISECONDS_TO_TICKS(TCP_SYN_RECEIVED_TIMEOUT) - idle;
+			break;
 
-				//Valid frame, age it
-				f.m_agingTicks ++;
+		//Open connection. Probe it if it's been idle a while, and drop it if the remote side went away
+		case TCPTableEntry::STATE_ESTABLISHED:
+		case TCPTableEntry::STATE_CLOSE_WAIT:
+			{
+				if(!m_keepaliveIdle)
+					return;
 
-				//Segment has aged out, resend it
-				if(f.m_agingTicks >= TCP_RETRANSMIT_TIMEOUT)
+				uint32_t due = m_keepaliveIdle + state->m_keepaliveProbes * m_keepaliveInterval;
+				if(idle >= due)
 				{
-					f.m_agingTicks = 0;
-					m_ipv4->ResendTxPacket(reinterpret_cast<IPv4Packet*>(
-						reinterpret_cast<uint8_t*>(f.m_segment) - sizeof(IPv4Packet)));
+					if(state->m_keepaliveProbes >= m_keepaliveMaxProbes)
+					{
+						SendReset(state);
+						ReleaseSocket(state);
+						return;
+					}
+
+					SendKeepalive(state);
+					state->m_keepaliveProbes ++;
+					due += m_keepaliveInterval;
 				}
+				next = due - idle;
 			}
-		}
+			break;
+
+		//Waiting on an ACK for our FIN. Resend it periodically, and give up if the remote side went away
+		case TCPTableEntry::STATE_FIN_WAIT_1:
+		case TCPTableEntry::STATE_CLOSING:
+		case TCPTableEntry::STATE_LAST_ACK:
+			if(idle >= TCP_DECISECONDS_TO_TICKS(TCP_CLOSE_TIMEOUT))
+			{
+				ReleaseSocket(state);
+				return;
+			}
+			SendFIN(state);
+			next = TCP_RETRANSMIT_TICKS;
+			break;
+
+		//Waiting on the remote side to close. Don't let a half-closed connection hold the socket forever
+		case TCPTableEntry::STATE_FIN_WAIT_2:
+			if(idle >= TCP_DECISECONDS_TO_TICKS(TCP_FIN_WAIT_2_TIMEOUT))
+			{
+				ReleaseSocket(state);
+				return;
+			}
+			next = TCP_DECISECONDS_TO_TICKS(TCP_FIN_WAIT_2_TIMEOUT) - idle;
+			break;
+
+		default:
+			return;
+	}
+
+	m_timers.Arm(&state->m_stateTimer, next);
+}
+
+/**
+	@brief Configures keepalive for all sockets
+ */
+void TCPProtocolBase::SetKeepalive(uint32_t idle, uint32_t interval, uint8_t probes)
+{
+	m_keepaliveIdle = TCP_DECISECONDS_TO_TICKS(idle);
+	m_keepaliveInterval = TCP_DECISECONDS_TO_TICKS(interval);
+	m_keepaliveMaxProbes = probes;
+
+	//Open sockets may not have a timer armed if keepalive was previously disabled, so have them all take another look
+	for(size_t i=0; i < m_tableWays * m_tableLines; i++)
+	{
+		auto& sock = m_socketTable[i];
+		if(!sock.m_valid)
+			continue;
+		if( (sock.m_state == TCPTableEntry::STATE_ESTABLISHED) || (sock.m_state == TCPTableEntry::STATE_CLOSE_WAIT) )
+			m_timers.Arm(&sock.m_stateTimer, 1);
 	}
 }
 
@@ -129,20 +513,52 @@ void TCPProtocol::OnAgingTick10x()
 // Handler for incoming packets
 
 /**
-	@brief Handles an incoming TCP packet
+	@brief Handles an incoming TCP packet over IPv4
+ */
+void TCPProtocolBase::OnRxPacket(
+	TCPSegment* segment,
+	uint16_t ipPayloadLength,
+	IPv4Address sourceAddress,
+	uint16_t pseudoHeaderChecksum)
+{
+	OnRxSegment(segment, ipPayloadLength, sourceAddress, pseudoHeaderChecksum);
+}
+
+/**
+	@brief Handles an incoming TCP packet over IPv6
+ */
+void TCPProtocolBase::OnRxPacket(
+	TCPSegment* segment,
+	uint16_t ipPayloadLength,
+	IPv6Address sourceAddress,
+	uint16_t pseudoHeaderChecksum)
+{
+	OnRxSegment(segment, ipPayloadLength, sourceAddress, pseudoHeaderChecksum);
+}
+
+/**
+	@brief Handles an incoming TCP packet from either family
+
+	@param pseudoHeaderChecksum	Checksum of the family specific pseudo-header, computed by the IP layer
  */
+template<class AddressType>
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
-void TCPProtocol::OnRxPacket(
+void TCPProtocolBase::OnRxSegment(
 	TCPSegment* segment,
 	uint16_t ipPayloadLength,
-	IPv4Address sourceAddress,
+	AddressType sourceAddress,
 	uint16_t pseudoHeaderChecksum)
 {
+	LATENCY_MARK(STAGE_TCP);
+
 	//Drop any packets too small for a complete TCP header
 	if(ipPayloadLength < 20)
+	{
+		CountDrop(DROP_SHORT);
 		return;
+	}
 
 	//Verify checksum of packet body
 	if(0xffff != IPv4Protocol::InternetChecksum(
@@ -150,6 +566,7 @@ void TCPProtocol::OnRxPacket(
 		ipPayloadLength,
 		pseudoHeaderChecksum))
 	{
+		CountDrop(DROP_BAD_CHECKSUM);
 		return;
 	}
 	segment->ByteSwap();
@@ -157,9 +574,19 @@ void TCPProtocol::OnRxPacket(
 	//Sanity check that the data offset points within the segment and not after the end
 	uint16_t off = segment->GetDataOffsetBytes();
 	if(off > ipPayloadLength)
+	{
+		CountDrop(DROP_BAD_OFFSET);
 		return;
+	}
 	uint16_t payloadLen = ipPayloadLength - off;
 
+	TRACE_EVENT(TRACE_TCP_SEGMENT_RECEIVED, segment->m_sourcePort, segment->m_sequence,
+		payloadLen | ((segment->m_offsetAndFlags & 0x1ff) << 16));
+
+	//Deliver coalesced data before anything other than more in-order data for the same socket is processed
+	if(m_groLength && !CanCoalesce(segment, sourceAddress, payloadLen))
+		FlushCoalescedData();
+
 	//Check flags to see what it is
 	if(segment->m_offsetAndFlags & TCPSegment::FLAG_SYN)
 	{
@@ -173,18 +600,25 @@ void TCPProtocol::OnRxPacket(
 
 	else if(segment->m_offsetAndFlags & TCPSegment::FLAG_ACK)
 		OnRxACK(segment, sourceAddress, payloadLen);
+
+	else
+		CountDrop(DROP_NO_FLAGS);
 }
 
 /**
 	@brief Handles an incoming SYN
  */
-void TCPProtocol::OnRxSYN(TCPSegment* segment, IPv4Address sourceAddress)
+template<class AddressType>
+void TCPProtocolBase::OnRxSYN(TCPSegment* segment, AddressType sourceAddress)
 {
 	//If port is not open, send a RST
-	if(!IsPortOpen(segment->m_destPort))
+	auto server = GetServer(segment->m_destPort);
+	if(!server && !IsPortOpen(segment->m_destPort))
 	{
+		CountDrop(DROP_CLOSED_PORT);
+
 		//Get ready to send a reply, if no free buffers give up
-		auto reply = m_ipv4->GetTxPacket(sourceAddress, IP_PROTO_TCP);
+		auto reply = GetTxPacket(sourceAddress);
 		if(reply == nullptr)
 			return;
 
@@ -196,6 +630,7 @@ void TCPProtocol::OnRxSYN(TCPSegment* segment, IPv4Address sourceAddress)
 		payload->m_ack = segment->m_sequence + 1;
 		payload->m_offsetAndFlags = (5 << 12) | TCPSegment::FLAG_RST | TCPSegment::FLAG_ACK;
 		payload->m_windowSize = 1;
+		payload->m_checksum = 0;
 		payload->m_urgent = 0;
 
 		//Done
@@ -203,19 +638,64 @@ void TCPProtocol::OnRxSYN(TCPSegment* segment, IPv4Address sourceAddress)
 		return;
 	}
 
-	//TODO: See if we already have open state for this hash.
-	//If so, this is a repeated SYN for an open socket (our ACK didn't make it)
+	//A new SYN for a connection in TIME-WAIT is allowed to reopen it if it's past the end of the old connection
+	//(RFC 1122 section 4.2.2.13). Otherwise it's an old duplicate, so drop it.
+	auto tw = GetTimeWaitState(sourceAddress, segment->m_destPort, segment->m_sourcePort);
+	if(tw != nullptr)
+	{
+		if(static_cast<int32_t>(segment->m_sequence - tw->m_remoteSeq) <= 0)
+		{
+			OnRxTimeWait(segment, tw, sourceAddress);
+			return;
+		}
+		m_timers.Cancel(&tw->m_timer);
+		tw->m_valid = false;
+	}
+
+	//See if we already have open state for this connection.
+	//If so, this is a repeated SYN for an open socket (our SYN+ACK didn't make it)
+	auto state = GetSocketState(sourceAddress, segment->m_destPort, segment->m_sourcePort);
+	if(state != nullptr)
+	{
+		//Still waiting on the handshake? Resend the SYN+ACK
+		if(state->m_state == TCPTableEntry::STATE_SYN_RECEIVED)
+		{
+			state->m_lastActivity = GetTime();
+
+			auto payload = CreateReply(state);
+			if(!payload)
+				return;
+			payload->m_sequence = state->m_localInitialSeq;
+			payload->m_offsetAndFlags |= TCPSegment::FLAG_SYN;
+			payload->SetMaxSegmentSize(GetPayloadMTU(sourceAddress));
+			SendSegment(state, payload, payload->GetDataOffsetBytes());
+		}
+
+		//Connection is already open, so this is bogus (or an attempt to inject a reset).
+		//Send a challenge ACK with our current sequence numbers (RFC 5961 section 4)
+		else
+		{
+			auto payload = CreateReply(state);
+			if(payload)
+				SendSegment(state, payload);
+		}
+		return;
+	}
 
 	//Figure out which socket table entry to use
-	auto state = AllocateSocketHandle(Hash(sourceAddress, segment->m_destPort, segment->m_sourcePort));
+	state = AllocateSocketHandle(Hash(sourceAddress, segment->m_destPort, segment->m_sourcePort));
 	if(state == nullptr)
 	{
 		//No free socket handles available.
-		//Silently drop the connection request
+		//Reply with a SYN cookie and don't allocate any state until the handshake completes
+		SendSYNCookie(segment, sourceAddress);
 		return;
 	}
 
 	//Fill out the initial table entry
+	state->m_state = TCPTableEntry::STATE_SYN_RECEIVED;
+	state->m_lastActivity = GetTime();
+	state->m_keepaliveProbes = 0;
 	state->m_remoteIP = sourceAddress;
 	state->m_localPort = segment->m_destPort;
 	state->m_remotePort = segment->m_sourcePort;
@@ -223,56 +703,87 @@ void TCPProtocol::OnRxSYN(TCPSegment* segment, IPv4Address sourceAddress)
 	state->m_localSeq = GenerateInitialSequenceNumber();
 	state->m_remoteInitialSeq = segment->m_sequence;
 	state->m_localInitialSeq = state->m_localSeq;
+	state->m_localAckedSeq = state->m_localSeq;
+	state->m_remoteWindow = segment->m_windowSize;
+	state->m_remoteMSS = segment->GetMaxSegmentSize(TCP_DEFAULT_REMOTE_MSS);
+	if(state->m_remoteMSS < TCP_MIN_REMOTE_MSS)
+		state->m_remoteMSS = TCP_MIN_REMOTE_MSS;
+	state->m_server = server;
 
 	//Prepare the reply
-	auto reply = CreateReply(state);
-	if(!reply)
+	auto payload = CreateReply(state);
+	if(!payload)
+	{
+		//Don't hold on to the socket if we couldn't answer, the client will retry
+		ReleaseSocket(state);
 		return;
-	auto payload = reinterpret_cast<TCPSegment*>(reply->Payload());
+	}
+	m_timers.Arm(&state->m_stateTimer, TCP_DECISECONDS_TO_TICKS(TCP_SYN_RECEIVED_TIMEOUT));
 	payload->m_offsetAndFlags |= TCPSegment::FLAG_SYN;
+	payload->SetMaxSegmentSize(GetPayloadMTU(sourceAddress));
 
 	//Send it
-	SendSegment(state, payload, reply);
+	SendSegment(state, payload, payload->GetDataOffsetBytes());
 
 	//The SYN flag counts as a byte in the stream, so we expect the next ACK to be one greater than what we sent
 	state->m_localSeq ++;
 
-	//Notify upper layer stuff
-	OnConnectionAccepted(state);
+	//Don't notify upper layer stuff until the handshake completes
 }
 
 /**
 	@brief Handles an incoming RST
  */
-void TCPProtocol::OnRxRST(TCPSegment* segment, IPv4Address sourceAddress)
+template<class AddressType>
+void TCPProtocolBase::OnRxRST(TCPSegment* segment, AddressType sourceAddress)
 {
-	//Look up the socket handle for this segment. Drop silently if not a valid segment
+	//Look up the socket handle for this segment. Drop silently if not a valid segment.
+	//Connections in TIME-WAIT are not in the socket table, so RSTs to them are ignored (RFC 1337).
 	//TODO: should we send a RST?
 	auto state = GetSocketState(sourceAddress, segment->m_destPort, segment->m_sourcePort);
 	if(state == nullptr)
+	{
+		CountDrop(DROP_NO_SOCKET);
 		return;
+	}
 
-	//Notify the upper layer protocol
-	OnConnectionClosed(state);
-
-	//Connection is getting torn down, so close our socket state.
-	//Normally we'd go to TIME-WAIT but just close it right away so we can reuse the table entry.
-	state->m_valid = false;
+	//Connection is getting torn down, so close our socket state right away. No TIME-WAIT after a reset.
+	ReleaseSocket(state);
 }
 
 /**
 	@brief Handles an incoming frame during a connection
  */
+template<class AddressType>
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
-void TCPProtocol::OnRxACK(TCPSegment* segment, IPv4Address sourceAddress, uint16_t payloadLen)
+void TCPProtocolBase::OnRxACK(TCPSegment* segment, AddressType sourceAddress, uint16_t payloadLen)
 {
-	//Look up the socket handle for this segment. Drop silently if not a valid segment
+	//Look up the socket handle for this segment.
+	//If we don't have one, it might be the final ACK of a handshake we answered with a SYN cookie.
+	//Drop silently if not a valid segment
 	//TODO: should we send a RST?
 	auto state = GetSocketState(sourceAddress, segment->m_destPort, segment->m_sourcePort);
 	if(state == nullptr)
-		return;
+	{
+		//Retransmitted FIN for a connection we already closed?
+		auto tw = GetTimeWaitState(sourceAddress, segment->m_destPort, segment->m_sourcePort);
+		if(tw != nullptr)
+		{
+			OnRxTimeWait(segment, tw, sourceAddress);
+			return;
+		}
+
+		state = ValidateSYNCookie(segment, sourceAddress);
+		if(state == nullptr)
+		{
+			CountDrop(DROP_NO_SOCKET);
+			return;
+		}
+	}
+	state->m_lastActivity = GetTime();
+	state->m_keepaliveProbes = 0;
 
 	bool isFin = (segment->m_offsetAndFlags & TCPSegment::FLAG_FIN) == TCPSegment::FLAG_FIN;
 
@@ -281,148 +792,581 @@ void TCPProtocol::OnRxACK(TCPSegment* segment, IPv4Address sourceAddress, uint16
 	//Send an ACK for the last packet we *did* get
 	if(state->m_remoteSeq != segment->m_sequence)
 	{
+		CountDrop(DROP_BAD_SEQUENCE);
+
+		#ifdef STATICNET_PERFORMANCE_COUNTERS
+			if(static_cast<int32_t>(segment->m_sequence - state->m_remoteSeq) > 0)
+				state->m_perfCounters.m_rxSegmentsOutOfOrder ++;
+		#endif
+
 		auto reply = CreateReply(state);
 		if(!reply)
 			return;
-		auto payload = reinterpret_cast<TCPSegment*>(reply->Payload());
-		SendSegment(state, payload, reply);
+		SendSegment(state, reply);
 		return;
 	}
 
 	//If we get here, it's the next packet in line.
 
-	//Remove the segment from the list of unacked frames
-	for(size_t i=0; i<TCP_MAX_UNACKED; i++)
+	//Final ACK of the handshake? The connection is now open
+	if(state->m_state == TCPTableEntry::STATE_SYN_RECEIVED)
 	{
-		auto frame = state->m_unackedFrames[i].m_segment;
-		if(!frame)
-			continue;
-
-		//Get the sequence number of the frame (already in network byte order so have to munge a bit)
-		auto seq = __builtin_bswap32(frame->m_sequence);
-		//auto end = ack + __builtin_bswap32(frame->m_sequence);
-		auto v4 = reinterpret_cast<IPv4Packet*>(reinterpret_cast<uint8_t*>(frame) - sizeof(IPv4Packet));
-		auto ipPayloadLength = __builtin_bswap16(v4->m_totalLength) - 20;
-		auto segmentLength = ipPayloadLength - 20;
-		auto endSeq = seq + segmentLength;
-
-		//If ACK number is >= the end of the frame, we can clear it
-		if(segment->m_ack >= endSeq)
+		//Must be ACKing our SYN, anything else is bogus
+		if(segment->m_ack != state->m_localSeq)
 		{
-			//Remove the segment from the list of unacked frames
-			state->m_unackedFrames[i].m_segment = nullptr;
-
-			//Free it in the upper layer
-			m_ipv4->CancelTxPacket(v4);
+			CountDrop(DROP_BAD_HANDSHAKE);
+			return;
 		}
+
+		state->m_state = TCPTableEntry::STATE_ESTABLISHED;
+		if(m_keepaliveIdle)
+			m_timers.Arm(&state->m_stateTimer, m_keepaliveIdle);
 		else
-			break;
+			m_timers.Cancel(&state->m_stateTimer);
+		NotifyConnectionAccepted(state);
 	}
 
-	//Clear empty slots in the list of unacked frames
-	size_t iwrite = 0;
-	for(size_t i=0; i<TCP_MAX_UNACKED; i++)
-	{
-		auto frame = state->m_unackedFrames[i];
-		if(!frame.m_segment)
-			continue;
+	#if defined(STATICNET_PERFORMANCE_COUNTERS) || defined(STATICNET_TRACE)
 
-		//Move the frame to the earliest unused slot in the list
-		state->m_unackedFrames[i] = nullptr;
-		state->m_unackedFrames[iwrite] = frame;
-		iwrite ++;
-	}
+		//Duplicate ACK (RFC 5681): no data, no new ACK or window update, while we have data outstanding
+		if( (payloadLen == 0) && !isFin && (segment->m_ack == state->m_localAckedSeq) &&
+			(segment->m_windowSize == state->m_remoteWindow) && (state->m_localSeq != state->m_localAckedSeq) )
+		{
+			#ifdef STATICNET_PERFORMANCE_COUNTERS
+				state->m_perfCounters.m_rxDuplicateAcks ++;
+			#endif
+			TRACE_EVENT(TRACE_TCP_DUP_ACK, state->m_remotePort, segment->m_ack, segment->m_windowSize);
+		}
+
+	#endif
+
+	//Update the send window if this ACKs something new (but not more than we've sent)
+	if( (static_cast<int32_t>(segment->m_ack - state->m_localAckedSeq) >= 0) &&
+		(static_cast<int32_t>(state->m_localSeq - segment->m_ack) >= 0) )
+	{
+		state->m_localAckedSeq = segment->m_ack;
+		state->m_remoteWindow = segment->m_windowSize;
+	}
+
+	//Remove fully ACKed segments from the head of the list of unacked frames.
+	//The list is in sequence order so we can stop at the first one that's still outstanding.
+	while(state->m_unackedHead)
+	{
+		auto s = state->m_unackedHead;
+
+		//If ACK number is >= the end of the frame (mod 2^32), we can clear it
+		if(static_cast<int32_t>(segment->m_ack - s->m_endSeq) < 0)
+			break;
+
+		//Update the smoothed RTT (srtt += (sample - srtt) / 8, but srtt is stored times 8)
+		#ifdef STATICNET_PERFORMANCE_COUNTERS
+			if(!s->m_retransmitted)
+			{
+				auto& srtt = state->m_perfCounters.m_smoothedRTT;
+				uint32_t sample = (GetTime() - s->m_sentTime) * 8;
+				if(srtt == 0)
+					srtt = sample;
+				else
+					srtt = srtt + (sample / 8) - (srtt / 8);
+			}
+		#endif
+
+		//Free it in the upper layer (if we kept it)
+		if(s->m_segment)
+			FreeTxSegment(state, s->m_segment);
+		state->m_unackedCount --;
+
+		//Remove the segment from the list of unacked frames and return it to the pool
+		state->m_unackedHead = s->m_next;
+		s->m_next = m_freeSegments;
+		m_freeSegments = s;
+	}
+	if(state->m_unackedHead == nullptr)
+	{
+		state->m_unackedTail = nullptr;
+		m_timers.Cancel(&state->m_retransmitTimer);
+	}
+
+	//If we've sent a FIN, see if this ACKs it (the FIN is the last byte we sent)
+	if(segment->m_ack == state->m_localSeq)
+	{
+		switch(state->m_state)
+		{
+			//Our half of the connection is closed, wait for the remote side to finish
+			case TCPTableEntry::STATE_FIN_WAIT_1:
+				state->m_state = TCPTableEntry::STATE_FIN_WAIT_2;
+				m_timers.Arm(&state->m_stateTimer, TCP_DECISECONDS_TO_TICKS(TCP_FIN_WAIT_2_TIMEOUT));
+				break;
+
+			//Simultaneous close
+			case TCPTableEntry::STATE_CLOSING:
+				EnterTimeWait(state);
+				return;
+
+			//Remote side closed first, so we're done and don't need to wait around
+			case TCPTableEntry::STATE_LAST_ACK:
+				ReleaseSocket(state);
+				return;
+
+			default:
+				break;
+		}
+	}
 
 	//Process the data
 	if(payloadLen > 0)
 	{
 		//Update our ACK number to the end of this segment
 		state->m_remoteSeq += payloadLen;
+		#ifdef STATICNET_PERFORMANCE_COUNTERS
+			state->m_perfCounters.m_rxBytes += payloadLen;
+		#endif
+
+		//During an RX burst, save in-order data to deliver (and ACK) all at once when the burst ends
+		if( m_inRxBurst && !isFin && (state->m_state == TCPTableEntry::STATE_ESTABLISHED) &&
+			( (m_groLength == 0) || (m_groSocket == state) ) &&
+			(m_groLength + payloadLen <= m_groBufferSize) )
+		{
+			memcpy(m_groBuffer + m_groLength, segment->Payload(), payloadLen);
+			m_groLength += payloadLen;
+			m_groSocket = state;
+			return;
+		}
 
 		//Call the RX data handler
-		OnRxData(state, segment->Payload(), payloadLen);
+		NotifyRxData(state, segment->Payload(), payloadLen);
 	}
 
 	//If no data, and not a FIN, no action needed (duplicate ACK?)
 	else if(!isFin)
 		return;
 
+	//Remote side is closing its half of the connection
+	if(isFin)
+	{
+		//FIN counts as a data byte so increment our ACK number
+		state->m_remoteSeq ++;
+
+		switch(state->m_state)
+		{
+			//Passive close: notify the upper layer protocol, then close our half right away.
+			//Our FIN also ACKs theirs.
+			case TCPTableEntry::STATE_ESTABLISHED:
+				state->m_state = TCPTableEntry::STATE_CLOSE_WAIT;
+				NotifyConnectionClosed(state);
+				CloseSocket(state);
+				return;
+
+			//Both sides closed at the same time, ACK their FIN and wait for ours to be ACKed
+			case TCPTableEntry::STATE_FIN_WAIT_1:
+				state->m_state = TCPTableEntry::STATE_CLOSING;
+				break;
+
+			//Active close is complete
+			case TCPTableEntry::STATE_FIN_WAIT_2:
+				EnterTimeWait(state);
+				return;
+
+			default:
+				break;
+		}
+	}
+
 	//At this point we had data and should send an ACK.
 	//But if OnRxData() sent payload data, we might have already sent the new ACK number in that segment.
 	//Don't send an ACK-only segment in that case.
-	if( (state->m_remoteSeq == state->m_remoteSeqSent) && !isFin)
+	if(state->m_remoteSeq == state->m_remoteSeqSent)
 		return;
 
 	//Send our reply
 	auto reply = CreateReply(state);
 	if(!reply)
 		return;
+	SendSegment(state, reply);
+}
+
+/**
+	@brief Handles an incoming segment for a connection in TIME-WAIT
+
+	The only thing we expect to see is a retransmission of the remote FIN (because our final ACK was lost), so re-ACK
+	it and restart the timer (RFC 793 page 73). Anything else is dropped.
+ */
+template<class AddressType>
+void TCPProtocolBase::OnRxTimeWait(TCPSegment* segment, TCPTimeWaitEntry* tw, AddressType sourceAddress)
+{
+	if(!(segment->m_offsetAndFlags & TCPSegment::FLAG_FIN))
+		return;
+
+	tw->m_startTime = GetTime();
+	m_timers.Arm(&tw->m_timer, TCP_DECISECONDS_TO_TICKS(TCP_TIME_WAIT_TIMEOUT));
+
+	//Get ready to send a reply, if no free buffers give up
+	auto reply = GetTxPacket(sourceAddress);
+	if(reply == nullptr)
+		return;
+
+	//Format the reply
 	auto payload = reinterpret_cast<TCPSegment*>(reply->Payload());
-	if(segment->m_offsetAndFlags & TCPSegment::FLAG_FIN)
-	{
-		//Set the FIN flag on the outgoing packet.
-		//FIN counts as a data byte so increment our ACK number
-		payload->m_offsetAndFlags |= TCPSegment::FLAG_FIN;
-		payload->m_ack ++;
+	payload->m_sourcePort = tw->m_localPort;
+	payload->m_destPort = tw->m_remotePort;
+	payload->m_sequence = tw->m_localSeq;
+	payload->m_ack = tw->m_remoteSeq;
+	payload->m_offsetAndFlags = (5 << 12) | TCPSegment::FLAG_ACK;
+	payload->m_windowSize = TCP_RX_WINDOW;
+	payload->m_urgent = 0;
+	payload->m_checksum = 0;
 
-		//Notify the upper layer protocol
-		OnConnectionClosed(state);
+	//Done
+	SendSegment(nullptr, payload, reply);
+}
 
-		//Connection is getting torn down, so close our socket state.
-		//Normally we'd go to TIME-WAIT but just close it right away so we can reuse the table entry.
-		state->m_valid = false;
-	}
-	SendSegment(state, payload, reply);
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Receive coalescing
+
+/**
+	@brief Called by the driver loop before handing a burst of received frames to the stack
+
+	If the coalescing buffer is nonzero size, in-order data segments on the same socket are merged until OnRxBurstEnd(), so
+	the upper layer sees one OnRxData() call and the remote side gets one ACK for the whole burst.
+ */
+void TCPProtocolBase::OnRxBurstStart()
+{
+	m_inRxBurst = (m_groBufferSize != 0);
+}
+
+/**
+	@brief Called by the driver loop after the last frame of a burst, to deliver any coalesced data
+ */
+void TCPProtocolBase::OnRxBurstEnd()
+{
+	m_inRxBurst = false;
+	if(m_groLength)
+		FlushCoalescedData();
+}
+
+/**
+	@brief Checks if an incoming segment (already byte swapped) can be appended to the coalesced data
+
+	Only plain in-order data on the same socket qualifies. Anything else has to wait until the coalesced data has
+	been delivered, so the upper layer sees events in the same order they arrived.
+ */
+template<class AddressType>
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+bool TCPProtocolBase::CanCoalesce(TCPSegment* segment, AddressType sourceAddress, uint16_t payloadLen)
+{
+	const uint16_t flagMask = TCPSegment::FLAG_SYN | TCPSegment::FLAG_RST | TCPSegment::FLAG_FIN | TCPSegment::FLAG_ACK;
+	if( (segment->m_offsetAndFlags & flagMask) != TCPSegment::FLAG_ACK)
+		return false;
+
+	auto state = m_groSocket;
+	return
+		(payloadLen > 0) &&
+		(state->m_remoteIP == sourceAddress) &&
+		(segment->m_destPort == state->m_localPort) &&
+		(segment->m_sourcePort == state->m_remotePort) &&
+		(segment->m_sequence == state->m_remoteSeq) &&
+		(m_groLength + payloadLen <= m_groBufferSize);
+}
+
+/**
+	@brief Passes coalesced data to the upper layer and ACKs it
+ */
+void TCPProtocolBase::FlushCoalescedData()
+{
+	auto state = m_groSocket;
+	auto len = m_groLength;
+	m_groSocket = nullptr;
+	m_groLength = 0;
+
+	NotifyRxData(state, m_groBuffer, len);
+
+	//Send a single ACK for everything, unless the upper layer already sent it with a reply or closed the socket
+	if(!state->m_valid || (state->m_remoteSeq == state->m_remoteSeqSent) )
+		return;
+	auto reply = CreateReply(state);
+	if(!reply)
+		return;
+	SendSegment(state, reply);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Outbound traffic
 
+/**
+	@brief Sends a segment on a socket, using whichever IP family the socket is on
+
+	@param state	The socket
+	@param segment	The segment to send, in host byte order
+	@param length	Length of the segment including headers
+	@param mode		How to retransmit the segment if it contains data and is lost
+	@param cookie	Application defined value for RegenerateSegment(), if mode is RETRANSMIT_REGENERATE
+
+	@return False if a segment containing data had no tracking entry, in which case it's freed without being sent
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+bool TCPProtocolBase::SendSegment(
+	TCPTableEntry* state,
+	TCPSegment* segment,
+	uint16_t length,
+	RetransmitMode mode,
+	uint32_t cookie)
+{
+	if(state->m_remoteIP.IsIPv6())
+		return SendSegment(state, segment, GetPacket<IPv6Packet>(segment), length, mode, cookie);
+	else
+		return SendSegment(state, segment, GetPacket<IPv4Packet>(segment), length, mode, cookie);
+}
+
 /**
 	@brief Does final prep and sends a TCP segment
+
+	@param state	The socket (may be null if we're sending a RST in response to a closed port)
+	@param segment	The segment to send, in host byte order
+	@param packet	The IPv4 or IPv6 packet containing the segment
+	@param length	Length of the segment including headers
+	@param mode		How to retransmit the segment if it contains data and is lost
+	@param cookie	Application defined value for RegenerateSegment(), if mode is RETRANSMIT_REGENERATE
+
+	@return False if a segment containing data had no tracking entry, in which case it's freed without being sent
  */
+template<class PacketType>
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
-void TCPProtocol::SendSegment(TCPTableEntry* state, TCPSegment* segment, IPv4Packet* packet, uint16_t length)
+bool TCPProtocolBase::SendSegment(
+	TCPTableEntry* state,
+	TCPSegment* segment,
+	PacketType* packet,
+	uint16_t length,
+	RetransmitMode mode,
+	uint32_t cookie)
 {
-	//Calculate the pseudoheader checksum
-	#ifndef HAVE_TCP_V4_CHECKSUM_OFFLOAD
-	auto pseudoHeaderChecksum = m_ipv4->PseudoHeaderChecksum(packet, length);
-	#endif
+	uint16_t headerLength = segment->GetDataOffsetBytes();
+	uint32_t endSeq = segment->m_sequence + length - headerLength;
+
+	//New data has to go in the retransmit queue, using the entry GetTxSegment() reserved for it.
+	//Sending it untracked would lose it for good if it's dropped, so refuse instead.
+	//(state may be null if we're sending a RST in response to a closed port)
+	TCPSentSegment* s = nullptr;
+	if(state && (length > headerLength) && (mode != RETRANSMIT_UNTRACKED))
+	{
+		s = TakeReservation(state, segment);
+		if(!s)
+		{
+			FreeTxSegment(state, segment);
+			return false;
+		}
+	}
 
 	//Make an note of what ACK number we just sent
 	if(state)
 		state->m_remoteSeqSent = state->m_remoteSeq;
 
+	TRACE_EVENT(TRACE_TCP_SEGMENT_SENT, segment->m_destPort, segment->m_sequence,
+		(length - headerLength) | ((segment->m_offsetAndFlags & 0x1ff) << 16));
+
 	//Need to be in network byte order before we send
 	segment->ByteSwap();
+	segment->m_checksum = GetTxChecksum(packet, segment, length);
+
+	//Put it in the transmit queue if the frame has content (don't worry about retransmitting ACKs).
+	//New data always goes at the end of the list, so it stays in sequence order.
+	bool inQueue = false;
+	if(s)
+	{
+		s->m_endSeq = endSeq;
+		s->m_sentTime = GetTime();
+		s->m_length = length - headerLength;
+		s->m_retransmitted = false;
+		s->m_cookie = cookie;
+
+		//Only hang on to the frame if we can't rebuild it later
+		if(mode == RETRANSMIT_REGENERATE)
+			s->m_segment = nullptr;
+		else
+		{
+			s->m_segment = segment;
+			inQueue = true;
+		}
+
+		if(state->m_unackedTail)
+			state->m_unackedTail->m_next = s;
+		else
+			state->m_unackedHead = s;
+		state->m_unackedTail = s;
+
+		if(!state->m_retransmitTimer.IsArmed())
+			m_timers.Arm(&state->m_retransmitTimer, TCP_RETRANSMIT_TICKS);
+	}
+
+	#ifdef STATICNET_PERFORMANCE_COUNTERS
+		if(state && (mode != RETRANSMIT_UNTRACKED))
+			state->m_perfCounters.m_txBytes += length - headerLength;
+	#endif
+
+	SendTxPacket(packet, length, !inQueue);
+	return true;
+}
+
+/**
+	@brief Calculates the checksum of an outbound segment over IPv4 (segment must be in network byte order)
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+uint16_t TCPProtocolBase::GetTxChecksum(IPv4Packet* packet, TCPSegment* segment, uint16_t length)
+{
 	#ifdef HAVE_TCP_V4_CHECKSUM_OFFLOAD
-		segment->m_checksum = 0x0000;	//will be filled in by hardware, but don't leave uninitialized
+		(void)packet;
+		(void)segment;
+		(void)length;
+		return 0x0000;	//will be filled in by hardware, but don't leave uninitialized
 	#else
-		segment->m_checksum = ~__builtin_bswap16(
-			IPv4Protocol::InternetChecksum(reinterpret_cast<uint8_t*>(segment), length, pseudoHeaderChecksum));
+		return ~__builtin_bswap16(IPv4Protocol::InternetChecksum(
+			reinterpret_cast<uint8_t*>(segment), length, m_ipv4->PseudoHeaderChecksum(packet, length)));
 	#endif
+}
 
-	//Put it in the transmit queue if the frame has content (don't worry about retransmitting ACKs)
-	//Find first free spot in the list of unacked frames
-	//(state may be null if we're sending a RST in response to a closed port)
-	bool inQueue = false;
-	if(state && (length > sizeof(TCPSegment) ))
+/**
+	@brief Calculates the checksum of an outbound segment over IPv6 (segment must be in network byte order)
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+uint16_t TCPProtocolBase::GetTxChecksum(IPv6Packet* packet, TCPSegment* segment, uint16_t length)
+{
+	return ~__builtin_bswap16(IPv4Protocol::InternetChecksum(
+		reinterpret_cast<uint8_t*>(segment), length, m_ipv6->PseudoHeaderChecksum(packet, length)));
+}
+
+/**
+	@brief Resends a segment which is still in its TX frame
+ */
+void TCPProtocolBase::ResendTxSegment(TCPTableEntry* state, TCPSegment* segment)
+{
+	if(state->m_remoteIP.IsIPv6())
+		m_ipv6->ResendTxPacket(GetPacket<IPv6Packet>(segment));
+	else
+		m_ipv4->ResendTxPacket(GetPacket<IPv4Packet>(segment));
+}
+
+/**
+	@brief Frees the TX frame containing a segment
+ */
+void TCPProtocolBase::FreeTxSegment(TCPTableEntry* state, TCPSegment* segment)
+{
+	if(state->m_remoteIP.IsIPv6())
+		m_ipv6->CancelTxPacket(GetPacket<IPv6Packet>(segment));
+	else
+		m_ipv4->CancelTxPacket(GetPacket<IPv4Packet>(segment));
+}
+
+/**
+	@brief Retransmits a segment sent with SendRegenerableTxSegment(), using the application to rebuild the payload
+
+	If no TX buffer is available, this does nothing and the segment will be tried again on the next timeout.
+
+	@return False if the application couldn't regenerate the segment
+ */
+bool TCPProtocolBase::ResendRegeneratedSegment(TCPTableEntry* state, TCPSentSegment* sent)
+{
+	auto payload = CreateReply(state);
+	if(!payload)
+		return true;
+
+	uint32_t seq = sent->m_endSeq - sent->m_length;
+	payload->m_sequence = seq;
+	payload->m_offsetAndFlags |= TCPSegment::FLAG_PSH;
+
+	//Stream offset 0 is the first byte after the SYN
+	if(!NotifyRegenerateSegment(
+		state, payload->Payload(), sent->m_length, seq - state->m_localInitialSeq - 1, sent->m_cookie))
+	{
+		FreeTxSegment(state, payload);
+		return false;
+	}
+
+	SendSegment(state, payload, sent->m_length + sizeof(TCPSegment), RETRANSMIT_UNTRACKED);
+	return true;
+}
+
+/**
+	@brief Sends a buffer of stream data on a socket
+
+	See the scatter list version for details.
+ */
+uint32_t TCPProtocolBase::SendStream(TCPTableEntry* state, const uint8_t* data, uint32_t len)
+{
+	TCPStreamBuffer buf = { data, len };
+	return SendStream(state, &buf, 1);
+}
+
+/**
+	@brief Sends a scatter list of stream data on a socket
+
+	The data is split into segments no larger than the remote side's MSS. Sending stops early if the remote side's
+	window is full, the socket has too many segments in flight, or we run out of TX buffers.
+
+	@return Number of bytes accepted. The caller is responsible for resending anything past this point later.
+ */
+uint32_t TCPProtocolBase::SendStream(TCPTableEntry* state, const TCPStreamBuffer* buffers, uint16_t count)
+{
+	uint32_t mss = GetMaxSegmentSize(state);
+
+	uint32_t sent = 0;
+	uint16_t ibuf = 0;
+	uint32_t offset = 0;
+	while(ibuf < count)
 	{
-		for(size_t i=0; i<TCP_MAX_UNACKED; i++)
+		//Skip over empty buffers
+		if(offset >= buffers[ibuf].m_len)
 		{
-			if(state->m_unackedFrames[i].m_segment == nullptr)
+			ibuf ++;
+			offset = 0;
+			continue;
+		}
+
+		//Figure out how much we can send
+		uint32_t window = GetSendWindow(state);
+		if(window == 0)
+			break;
+		uint32_t segmentLen = mss;
+		if(window < segmentLen)
+			segmentLen = window;
+
+		auto segment = GetTxSegment(state);
+		if(!segment)
+			break;
+
+		//Gather data into the segment
+		auto payload = segment->Payload();
+		uint32_t len = 0;
+		while( (len < segmentLen) && (ibuf < count) )
+		{
+			uint32_t chunk = buffers[ibuf].m_len - offset;
+			if(chunk > (segmentLen - len))
+				chunk = segmentLen - len;
+
+			memcpy(payload + len, buffers[ibuf].m_data + offset, chunk);
+			len += chunk;
+			offset += chunk;
+
+			if(offset >= buffers[ibuf].m_len)
 			{
-				state->m_unackedFrames[i] = TCPSentSegment(segment);
-				inQueue = true;
-				break;
+				ibuf ++;
+				offset = 0;
 			}
-			//TODO: don't allow sending the frame if no space to queue it?
 		}
+
+		SendTxSegment(state, segment, len);
+		sent += len;
 	}
 
-	m_ipv4->SendTxPacket(packet, length, !inQueue);
+	return sent;
 }
 
 /**
@@ -431,44 +1375,361 @@ void TCPProtocol::SendSegment(TCPTableEntry* state, TCPSegment* segment, IPv4Pac
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
-IPv4Packet* TCPProtocol::CreateReply(TCPTableEntry* state)
+TCPSegment* TCPProtocolBase::CreateReply(TCPTableEntry* state)
 {
 	//Get ready to send a reply, if no free buffers give up
-	auto reply = m_ipv4->GetTxPacket(state->m_remoteIP, IP_PROTO_TCP);
-	if(reply == nullptr)
-		return nullptr;
+	uint8_t* buf;
+	if(state->m_remoteIP.IsIPv6())
+	{
+		auto reply = GetTxPacket(state->m_remoteIP.m_v6);
+		if(reply == nullptr)
+			return nullptr;
+		buf = reply->Payload();
+	}
+	else
+	{
+		auto reply = GetTxPacket(state->m_remoteIP.m_v4);
+		if(reply == nullptr)
+			return nullptr;
+		buf = reply->Payload();
+	}
 
 	//Format the reply
-	auto payload = reinterpret_cast<TCPSegment*>(reply->Payload());
+	auto payload = reinterpret_cast<TCPSegment*>(buf);
 	payload->m_sourcePort = state->m_localPort;
 	payload->m_destPort = state->m_remotePort;
 	payload->m_sequence = state->m_localSeq;
 	payload->m_ack = state->m_remoteSeq;
 	payload->m_offsetAndFlags = (5 << 12) | TCPSegment::FLAG_ACK;
-	payload->m_windowSize = TCP_IPV4_PAYLOAD_MTU;	//TODO: support variable window size
+	payload->m_windowSize = TCP_RX_WINDOW;	//TODO: support variable window size
 	payload->m_urgent = 0;
 	payload->m_checksum = 0;
 
-	return reply;
+	return payload;
 }
 
 /**
 	@brief Close a socket
+
+	Sends a FIN and moves the socket into FIN-WAIT-1 (or LAST-ACK, if the remote side already closed). The socket
+	state is kept until our FIN is ACKed, but is released after TCP_CLOSE_TIMEOUT even if the remote side never
+	answers. Closing a socket that's already closing does nothing.
  */
-void TCPProtocol::CloseSocket(TCPTableEntry* state)
+void TCPProtocolBase::CloseSocket(TCPTableEntry* state)
 {
-	//Prepare the reply
-	auto reply = CreateReply(state);
-	auto payload = reinterpret_cast<TCPSegment*>(reply->Payload());
-	payload->m_offsetAndFlags |= TCPSegment::FLAG_FIN;
+	switch(state->m_state)
+	{
+		case TCPTableEntry::STATE_ESTABLISHED:
+			state->m_state = TCPTableEntry::STATE_FIN_WAIT_1;
+			break;
 
-	//Send it
-	SendSegment(state, payload, reply);
+		case TCPTableEntry::STATE_CLOSE_WAIT:
+			state->m_state = TCPTableEntry::STATE_LAST_ACK;
+			break;
+
+		default:
+			return;
+	}
 
 	//The FIN flag counts as a byte in the stream, so we expect the next ACK to be one greater than what we sent
 	state->m_localSeq ++;
+	state->m_lastActivity = GetTime();
+	m_timers.Arm(&state->m_stateTimer, TCP_RETRANSMIT_TICKS);
+
+	//Send it. If we're out of buffers it'll be resent when the timer expires
+	SendFIN(state);
+}
+
+/**
+	@brief Sends (or resends) the FIN for a socket we've closed
+
+	The FIN isn't put in the retransmit queue since it's cheap to regenerate, so it doesn't hold a TX buffer while
+	we wait for the ACK.
+ */
+void TCPProtocolBase::SendFIN(TCPTableEntry* state)
+{
+	auto payload = CreateReply(state);
+	if(!payload)
+		return;
+	payload->m_sequence = state->m_localSeq - 1;
+	payload->m_offsetAndFlags |= TCPSegment::FLAG_FIN;
+	SendSegment(state, payload);
+}
+
+/**
+	@brief Sends a keepalive probe
+
+	This is an ACK with a sequence number one before the next byte we'd send, which the remote side has to respond
+	to with an ACK of its own (RFC 1122 section 4.2.3.6).
+ */
+void TCPProtocolBase::SendKeepalive(TCPTableEntry* state)
+{
+	auto payload = CreateReply(state);
+	if(!payload)
+		return;
+	payload->m_sequence = state->m_localSeq - 1;
+	SendSegment(state, payload);
+}
+
+/**
+	@brief Sends a RST to abort a connection
+ */
+void TCPProtocolBase::SendReset(TCPTableEntry* state)
+{
+	auto payload = CreateReply(state);
+	if(!payload)
+		return;
+	payload->m_offsetAndFlags |= TCPSegment::FLAG_RST;
+	SendSegment(state, payload);
+}
+
+/**
+	@brief ACKs the remote FIN if needed, then moves a fully closed connection from the socket table to the TIME-WAIT table
+
+	If the TIME-WAIT table is full, the oldest entry is evicted.
+ */
+void TCPProtocolBase::EnterTimeWait(TCPTableEntry* state)
+{
+	//ACK the FIN, unless we already did so (simultaneous close)
+	if(state->m_remoteSeq != state->m_remoteSeqSent)
+	{
+		auto payload = CreateReply(state);
+		if(payload)
+			SendSegment(state, payload);
+	}
+
+	//Find a free entry, or the oldest one
+	TCPTimeWaitEntry* tw = &m_timeWaitTable[0];
+	for(uint16_t i=0; i<m_timeWaitTableSize; i++)
+	{
+		auto& e = m_timeWaitTable[i];
+		if(!e.m_valid)
+		{
+			tw = &e;
+			break;
+		}
+		if( (GetTime() - e.m_startTime) > (GetTime() - tw->m_startTime) )
+			tw = &e;
+	}
+
+	tw->m_valid = true;
+	tw->m_remoteIP = state->m_remoteIP;
+	tw->m_localPort = state->m_localPort;
+	tw->m_remotePort = state->m_remotePort;
+	tw->m_localSeq = state->m_localSeq;
+	tw->m_remoteSeq = state->m_remoteSeq;
+	tw->m_startTime = GetTime();
+	m_timers.Arm(&tw->m_timer, TCP_DECISECONDS_TO_TICKS(TCP_TIME_WAIT_TIMEOUT));
+
+	ReleaseSocket(state);
+}
+
+/**
+	@brief Frees a socket table entry, notifying the upper layer if it still thinks the connection is open
+ */
+void TCPProtocolBase::ReleaseSocket(TCPTableEntry* state)
+{
+	switch(state->m_state)
+	{
+		//Upper layer never heard about the connection, or was already notified when the remote side closed
+		case TCPTableEntry::STATE_SYN_RECEIVED:
+		case TCPTableEntry::STATE_CLOSE_WAIT:
+		case TCPTableEntry::STATE_LAST_ACK:
+			break;
+
+		default:
+			NotifyConnectionClosed(state);
+			break;
+	}
+
+	//Make sure we don't leak TX buffers even if an override of OnConnectionClosed() didn't call ours
+	FreeUnackedSegments(state);
+
+	//Any coalesced data for the socket has nowhere to go
+	if(m_groSocket == state)
+	{
+		m_groSocket = nullptr;
+		m_groLength = 0;
+	}
+
+	m_timers.Cancel(&state->m_stateTimer);
+	state->m_valid = false;
+}
+
+/**
+	@brief Frees all un-ACKed TX buffers for a socket
+ */
+void TCPProtocolBase::FreeUnackedSegments(TCPTableEntry* state)
+{
+	while(state->m_unackedHead)
+	{
+		auto s = state->m_unackedHead;
+
+		//Free the frame, if we kept it
+		if(s->m_segment)
+			FreeTxSegment(state, s->m_segment);
+
+		//It's no longer in the list of un-acked frames
+		state->m_unackedHead = s->m_next;
+		s->m_next = m_freeSegments;
+		m_freeSegments = s;
+	}
+	state->m_unackedTail = nullptr;
+
+	//Reserved entries go back to the pool too. The upper layer still owns those frames, and sending or cancelling
+	//them later frees them without touching the pool.
+	while(state->m_reservedHead)
+	{
+		auto s = state->m_reservedHead;
+		state->m_reservedHead = s->m_next;
+		s->m_next = m_freeSegments;
+		m_freeSegments = s;
+	}
+	state->m_unackedCount = 0;
+
+	m_timers.Cancel(&state->m_retransmitTimer);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// SYN cookies
+
+/**
+	@brief Replies to a SYN with a SYN+ACK whose initial sequence number encodes the connection (RFC 4987 section 3.6)
+
+	Used when there's no space in the socket table for the connection. No state is kept for the connection; if the
+	client completes the handshake, the socket is created by ValidateSYNCookie() when the final ACK arrives.
+
+	The client's MSS isn't encoded in the cookie, so connections accepted this way use TCP_DEFAULT_REMOTE_MSS.
+ */
+template<class AddressType>
+void TCPProtocolBase::SendSYNCookie(TCPSegment* segment, AddressType sourceAddress)
+{
+	//Get ready to send a reply, if no free buffers give up
+	auto reply = GetTxPacket(sourceAddress);
+	if(reply == nullptr)
+		return;
+
+	//Format the reply
+	auto payload = reinterpret_cast<TCPSegment*>(reply->Payload());
+	payload->m_sourcePort = segment->m_destPort;
+	payload->m_destPort = segment->m_sourcePort;
+	payload->m_sequence = GenerateSYNCookie(
+		sourceAddress,
+		segment->m_destPort,
+		segment->m_sourcePort,
+		segment->m_sequence,
+		GetTime() / TCP_DECISECONDS_TO_TICKS(TCP_SYN_COOKIE_PERIOD));
+	payload->m_ack = segment->m_sequence + 1;
+	payload->m_offsetAndFlags = (5 << 12) | TCPSegment::FLAG_SYN | TCPSegment::FLAG_ACK;
+	payload->m_windowSize = TCP_RX_WINDOW;
+	payload->m_urgent = 0;
+	payload->m_checksum = 0;
+	payload->SetMaxSegmentSize(GetPayloadMTU(sourceAddress));
+
+	//Done
+	SendSegment(nullptr, payload, reply, payload->GetDataOffsetBytes());
+}
+
+/**
+	@brief Checks if an ACK for an unknown socket is completing a handshake we answered with a SYN cookie
+
+	If the cookie is valid, a new socket is allocated and returned in the established state. Otherwise returns null.
+ */
+template<class AddressType>
+TCPTableEntry* TCPProtocolBase::ValidateSYNCookie(TCPSegment* segment, AddressType sourceAddress)
+{
+	//If we've never sent a cookie, it can't be one
+	if(!m_cookieSecretValid)
+		return nullptr;
+
+	//Cookie must have been generated in the current or previous timestamp period
+	uint32_t cookie = segment->m_ack - 1;
+	uint32_t timestamp = cookie >> 24;
+	uint32_t age = ( (GetTime() / TCP_DECISECONDS_TO_TICKS(TCP_SYN_COOKIE_PERIOD)) - timestamp) & 0xff;
+	if(age > 1)
+		return nullptr;
+
+	//Make sure it's actually ours
+	uint32_t remoteInitialSeq = segment->m_sequence - 1;
+	if(cookie != GenerateSYNCookie(
+		sourceAddress, segment->m_destPort, segment->m_sourcePort, remoteInitialSeq, timestamp))
+	{
+		return nullptr;
+	}
 
-	//Don't close the socket state on our end until we get the FIN+ACK
+	//Valid cookie. The client has proven it can receive from us, so it takes priority over a half-open connection
+	//(which might be a spoofed SYN) if the row is full. Give up only if the row is all real connections.
+	auto hash = Hash(sourceAddress, segment->m_destPort, segment->m_sourcePort);
+	auto state = AllocateSocketHandle(hash);
+	if( (state == nullptr) && EvictHalfOpenSocket(hash) )
+		state = AllocateSocketHandle(hash);
+	if(state == nullptr)
+		return nullptr;
+
+	//Fill out the table entry. The final ACK is what we'd expect next from a SYN_RECEIVED socket, so let OnRxACK()
+	//finish the handshake and notify the upper layer.
+	state->m_state = TCPTableEntry::STATE_SYN_RECEIVED;
+	state->m_lastActivity = GetTime();
+	state->m_keepaliveProbes = 0;
+	state->m_remoteIP = sourceAddress;
+	state->m_localPort = segment->m_destPort;
+	state->m_remotePort = segment->m_sourcePort;
+	state->m_remoteSeq = segment->m_sequence;
+	state->m_remoteSeqSent = segment->m_sequence;
+	state->m_localSeq = segment->m_ack;
+	state->m_remoteInitialSeq = remoteInitialSeq;
+	state->m_localInitialSeq = cookie;
+	state->m_localAckedSeq = cookie;
+	state->m_remoteWindow = segment->m_windowSize;
+	state->m_remoteMSS = TCP_DEFAULT_REMOTE_MSS;
+	state->m_server = GetServer(segment->m_destPort);
+	m_timers.Arm(&state->m_stateTimer, TCP_DECISECONDS_TO_TICKS(TCP_SYN_RECEIVED_TIMEOUT));
+	return state;
+}
+
+/**
+	@brief Generates a SYN cookie for a connection
+
+	The high 8 bits are a coarse timestamp, the low 24 bits are a keyed hash of the connection tuple and timestamp.
+ */
+template<class AddressType>
+uint32_t TCPProtocolBase::GenerateSYNCookie(
+	AddressType ip,
+	uint16_t localPort,
+	uint16_t remotePort,
+	uint32_t remoteInitialSeq,
+	uint32_t timestamp)
+{
+	//Lazily generate the secret, since we can't call the RNG from our constructor
+	if(!m_cookieSecretValid)
+	{
+		m_cookieSecret[0] = GenerateInitialSequenceNumber();
+		m_cookieSecret[1] = GenerateInitialSequenceNumber();
+		m_cookieSecretValid = true;
+	}
+
+	//Hash every word of the address, so a cookie can't be reused from a different address
+	const size_t addressWords = sizeof(ip) / sizeof(uint32_t);
+	uint32_t words[addressWords + 3];
+	memcpy(words, &ip, sizeof(ip));
+	words[addressWords] = (static_cast<uint32_t>(localPort) << 16) | remotePort;
+	words[addressWords + 1] = remoteInitialSeq;
+	words[addressWords + 2] = timestamp & 0xff;
+
+	//Murmur3 style mixing, seeded with the secret
+	uint32_t hash = m_cookieSecret[0];
+	for(auto w : words)
+	{
+		hash ^= w;
+		hash ^= hash >> 16;
+		hash *= 0x85ebca6b;
+		hash ^= hash >> 13;
+		hash *= 0xc2b2ae35;
+		hash ^= hash >> 16;
+		hash += m_cookieSecret[1];
+	}
+
+	return ( (timestamp & 0xff) << 24) | (hash & 0xffffff);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -477,37 +1738,49 @@ void TCPProtocol::CloseSocket(TCPTableEntry* state)
 /**
 	@brief Hashes an IP address and returns a row index
 
-	32-bit FNV-1 for now. Simple and good mixing, but uses a bunch of multiplies so might be slow?
+	Word-at-a-time multiply-shift: the address, then both ports packed into one word.
  */
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
-uint16_t TCPProtocol::Hash(IPv4Address ip, uint16_t localPort, uint16_t remotePort)
+uint16_t TCPProtocolBase::Hash(IPv4Address ip, uint16_t localPort, uint16_t remotePort)
 {
-	size_t hash = FNV_INITIAL;
-	for(size_t i=0; i<4; i++)
-		hash = (hash * FNV_MULT) ^ ip.m_octets[i];
-	hash = (hash * FNV_MULT) ^ (localPort >> 8);
-	hash = (hash * FNV_MULT) ^ (localPort & 0xff);
-	hash = (hash * FNV_MULT) ^ (remotePort >> 8);
-	hash = (hash * FNV_MULT) ^ (remotePort & 0xff);
+	uint32_t hash = HashWord(0, HashLoad(ip.m_octets));
+	hash = HashWord(hash, (static_cast<uint32_t>(localPort) << 16) | remotePort);
 
-	return hash % TCP_TABLE_LINES;
+	return HashToIndex(hash, m_tableLines);
+}
+
+/**
+	@brief Hashes an IPv6 address and returns a row index
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+uint16_t TCPProtocolBase::Hash(IPv6Address ip, uint16_t localPort, uint16_t remotePort)
+{
+	uint32_t hash = 0;
+	for(size_t i=0; i<IPV6_ADDR_SIZE; i += 4)
+		hash = HashWord(hash, HashLoad(ip.m_octets + i));
+	hash = HashWord(hash, (static_cast<uint32_t>(localPort) << 16) | remotePort);
+
+	return HashToIndex(hash, m_tableLines);
 }
 
 /**
 	@brief Looks up the socket state for the given connection
  */
+template<class AddressType>
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
-TCPTableEntry* TCPProtocol::GetSocketState(IPv4Address ip, uint16_t localPort, uint16_t remotePort)
+TCPTableEntry* TCPProtocolBase::GetSocketState(AddressType ip, uint16_t localPort, uint16_t remotePort)
 {
 	auto hash = Hash(ip, localPort, remotePort);
 
-	for(size_t way=0; way < TCP_TABLE_WAYS; way ++)
+	for(size_t way=0; way < m_tableWays; way ++)
 	{
-		auto& row = m_socketTable[way].m_lines[hash];
+		auto& row = GetRow(way, hash);
 
 		//Nothing there? No match
 		if(!row.m_valid)
@@ -515,22 +1788,41 @@ TCPTableEntry* TCPProtocol::GetSocketState(IPv4Address ip, uint16_t localPort, u
 
 		//Check table info
 		if( (row.m_remoteIP == ip) && (row.m_localPort == localPort) && (row.m_remotePort == remotePort) )
-			return &m_socketTable[way].m_lines[hash];
+			return &GetRow(way, hash);
 	}
 
 	//Not a valid socket
 	return nullptr;
 }
 
+//Derived classes may look up sockets for either family
+template TCPTableEntry* TCPProtocolBase::GetSocketState(IPv4Address ip, uint16_t localPort, uint16_t remotePort);
+template TCPTableEntry* TCPProtocolBase::GetSocketState(IPv6Address ip, uint16_t localPort, uint16_t remotePort);
+
+/**
+	@brief Looks up the TIME-WAIT state for the given connection
+ */
+template<class AddressType>
+TCPTimeWaitEntry* TCPProtocolBase::GetTimeWaitState(AddressType ip, uint16_t localPort, uint16_t remotePort)
+{
+	for(uint16_t i=0; i<m_timeWaitTableSize; i++)
+	{
+		auto& tw = m_timeWaitTable[i];
+		if(tw.m_valid && (tw.m_remoteIP == ip) && (tw.m_localPort == localPort) && (tw.m_remotePort == remotePort) )
+			return &tw;
+	}
+	return nullptr;
+}
+
 /**
 	@brief Finds a free space in the socket table for the given hash, then marks it as in use and returns the
 	socket state object
  */
-TCPTableEntry* TCPProtocol::AllocateSocketHandle(uint16_t hash)
+TCPTableEntry* TCPProtocolBase::AllocateSocketHandle(uint16_t hash)
 {
-	for(size_t way=0; way < TCP_TABLE_WAYS; way ++)
+	for(size_t way=0; way < m_tableWays; way ++)
 	{
-		auto& row = m_socketTable[way].m_lines[hash];
+		auto& row = GetRow(way, hash);
 
 		//There's something in the row. We can't insert here.
 		if(row.m_valid)
@@ -540,7 +1832,11 @@ TCPTableEntry* TCPProtocol::AllocateSocketHandle(uint16_t hash)
 		else
 		{
 			row.m_valid = true;
-			return &m_socketTable[way].m_lines[hash];
+			row.m_context = nullptr;
+			#ifdef STATICNET_PERFORMANCE_COUNTERS
+				row.m_perfCounters = TCPSocketPerformanceCounters();
+			#endif
+			return &GetRow(way, hash);
 		}
 	}
 
@@ -548,6 +1844,92 @@ TCPTableEntry* TCPProtocol::AllocateSocketHandle(uint16_t hash)
 	return nullptr;
 }
 
+/**
+	@brief Frees the oldest socket in SYN_RECEIVED state in the row for the given hash
+
+	Half-open sockets have no upper layer state yet, so this is safe at any time. If the client was genuine, its
+	final ACK no longer matches a socket and it will retry.
+
+	@return True if a socket was freed
+ */
+bool TCPProtocolBase::EvictHalfOpenSocket(uint16_t hash)
+{
+	auto now = GetTime();
+	TCPTableEntry* oldest = nullptr;
+	for(size_t way=0; way < m_tableWays; way ++)
+	{
+		auto& row = GetRow(way, hash);
+		if(!row.m_valid || (row.m_state != TCPTableEntry::STATE_SYN_RECEIVED) )
+			continue;
+		if(!oldest || (now - row.m_lastActivity > now - oldest->m_lastActivity) )
+			oldest = &row;
+	}
+
+	if(!oldest)
+		return false;
+	ReleaseSocket(oldest);
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Upper layer dispatch
+
+/**
+	@brief Passes received data to the socket's server, or OnRxData() if it has none
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+void TCPProtocolBase::NotifyRxData(TCPTableEntry* state, uint8_t* payload, uint16_t payloadLen)
+{
+	LATENCY_MARK(STAGE_TCP_DELIVER);
+
+	if(state->m_server)
+		state->m_server->OnRxData(state, payload, payloadLen);
+	else
+		OnRxData(state, payload, payloadLen);
+}
+
+/**
+	@brief Tells the socket's server, or OnConnectionAccepted() if it has none, about a newly opened connection
+ */
+void TCPProtocolBase::NotifyConnectionAccepted(TCPTableEntry* state)
+{
+	if(state->m_server)
+		state->m_server->OnConnectionAccepted(state);
+	else
+		OnConnectionAccepted(state);
+}
+
+/**
+	@brief Tells the socket's server, or OnConnectionClosed() if it has none, that a connection has closed
+ */
+void TCPProtocolBase::NotifyConnectionClosed(TCPTableEntry* state)
+{
+	if(state->m_server)
+	{
+		state->m_server->OnConnectionClosed(state);
+		FreeUnackedSegments(state);
+	}
+	else
+		OnConnectionClosed(state);
+}
+
+/**
+	@brief Asks the socket's server, or RegenerateSegment() if it has none, to rebuild a lost segment
+ */
+bool TCPProtocolBase::NotifyRegenerateSegment(
+	TCPTableEntry* state,
+	uint8_t* payload,
+	uint16_t payloadLen,
+	uint32_t streamOffset,
+	uint32_t cookie)
+{
+	if(state->m_server)
+		return state->m_server->RegenerateSegment(state, payload, payloadLen, streamOffset, cookie);
+	return RegenerateSegment(state, payload, payloadLen, streamOffset, cookie);
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Overrides for end user application logic
 
@@ -558,7 +1940,7 @@ TCPTableEntry* TCPProtocol::AllocateSocketHandle(uint16_t hash)
 
 	The default implementation does nothing.
  */
-void TCPProtocol::OnConnectionAccepted(TCPTableEntry* /*state*/)
+void TCPProtocolBase::OnConnectionAccepted(TCPTableEntry* /*state*/)
 {
 }
 
@@ -569,21 +1951,35 @@ void TCPProtocol::OnConnectionAccepted(TCPTableEntry* /*state*/)
 
 	The default implementation frees all un-ACKed socket buffers and must be called by any overrides.
  */
-void TCPProtocol::OnConnectionClosed(TCPTableEntry* state)
+void TCPProtocolBase::OnConnectionClosed(TCPTableEntry* state)
 {
-	for(size_t i=0; i<TCP_MAX_UNACKED; i++)
-	{
-		auto frame = state->m_unackedFrames[i].m_segment;
-		if(!frame)
-			continue;
+	FreeUnackedSegments(state);
+}
 
-		//Free the frame
-		auto v4 = reinterpret_cast<IPv4Packet*>(reinterpret_cast<uint8_t*>(frame) - sizeof(IPv4Packet));
-		m_ipv4->CancelTxPacket(v4);
+/**
+	@brief Rebuilds the payload of a lost segment sent with SendRegenerableTxSegment()
 
-		//It's no longer in the list of un-acked frames
-		state->m_unackedFrames[i].m_segment = nullptr;
-	}
+	Override in applications which send reproducible content (static files etc) to avoid holding TX buffers until
+	data is ACKed.
+
+	The default implementation returns false, which aborts the connection.
+
+	@param state		The socket
+	@param payload		Buffer to write the payload to
+	@param payloadLen	Number of bytes to write (same as the original segment)
+	@param streamOffset	Offset of the first byte of the segment from the start of our side of the stream
+	@param cookie		Value passed to SendRegenerableTxSegment() when the segment was originally sent
+
+	@return True if the payload was regenerated, false if it couldn't be
+ */
+bool TCPProtocolBase::RegenerateSegment(
+	TCPTableEntry* /*state*/,
+	uint8_t* /*payload*/,
+	uint16_t /*payloadLen*/,
+	uint32_t /*streamOffset*/,
+	uint32_t /*cookie*/)
+{
+	return false;
 }
 
 /**
@@ -591,7 +1987,7 @@ void TCPProtocol::OnConnectionClosed(TCPTableEntry* state)
 
 	The default implementation returns true for all ports.
  */
-bool TCPProtocol::IsPortOpen(uint16_t /*port*/)
+bool TCPProtocolBase::IsPortOpen(uint16_t /*port*/)
 {
 	return true;
 }
@@ -601,6 +1997,6 @@ bool TCPProtocol::IsPortOpen(uint16_t /*port*/)
 
 	The default implementation does nothing.
  */
-void TCPProtocol::OnRxData(TCPTableEntry* /*state*/, uint8_t* /*payload*/, uint16_t /*payloadLen*/)
+void TCPProtocolBase::OnRxData(TCPTableEntry* /*state*/, uint8_t* /*payload*/, uint16_t /*payloadLen*/)
 {
 }
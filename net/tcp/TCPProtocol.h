@@ -29,33 +29,179 @@
 
 /**
 	@file
-	@brief Declaration of TCPProtocol
+	@brief Declaration of TCPProtocolBase and SizedTCPProtocol
  */
 
 #ifndef TCPProtocol_h
 #define TCPProtocol_h
 
+#include "../IPAddress.h"
 #include "TCPSegment.h"
+#include "TCPTimerWheel.h"
+#include "TCPSocketPerformanceCounters.h"
+#include "../../util/DropCounters.h"
 
-//Default of 4 pending TCP segments allowed in flight
+/*
+	All TCP timeouts below are in units of 100ms for compatibility with OnAgingTick10x(), and are converted to
+	timer ticks internally.
+ */
+
+//Default of 10 Hz timer, driven by OnAgingTick10x(). If set to anything else, call OnTimerTick() at this rate instead.
+#ifndef TCP_TIMER_HZ
+#define TCP_TIMER_HZ 10
+#endif
+
+///@brief Converts a timeout in 100ms units to timer ticks
+#define TCP_DECISECONDS_TO_TICKS(x) ( (x) * TCP_TIMER_HZ / 10)
+
+//Default of 4 pending TCP segments allowed in flight per socket.
+//Each one holds a TX buffer until it's ACKed, so keep this well under the number the driver has
 #ifndef TCP_MAX_UNACKED
 #define TCP_MAX_UNACKED 4
 #endif
 
+//Default of 536 byte MSS for peers that don't send a MSS option (RFC 1122 section 4.2.2.6)
+#ifndef TCP_DEFAULT_REMOTE_MSS
+#define TCP_DEFAULT_REMOTE_MSS 536
+#endif
+
+//Default of 536 bytes as the smallest MSS we honor from a peer. Smaller values are raised to this, since upper layers
+//size their headers and framing on the assumption that a segment holds a reasonable amount of data
+#ifndef TCP_MIN_REMOTE_MSS
+#define TCP_MIN_REMOTE_MSS 536
+#endif
+
+//Default of 16 pending TCP segments allowed in flight across all sockets
+#ifndef TCP_SEGMENT_POOL_SIZE
+#define TCP_SEGMENT_POOL_SIZE 16
+#endif
+
 #ifndef TCP_RETRANSMIT_TIMEOUT
 #define TCP_RETRANSMIT_TIMEOUT 2
 #endif
 
+//Retransmit timeout in timer ticks. Override directly for sub-100ms timeouts with a faster TCP_TIMER_HZ
+#ifndef TCP_RETRANSMIT_TICKS
+#define TCP_RETRANSMIT_TICKS TCP_DECISECONDS_TO_TICKS(TCP_RETRANSMIT_TIMEOUT)
+#endif
+
+//Default of 3 seconds to wait for the final ACK of a handshake before discarding the half-open socket
+#ifndef TCP_SYN_RECEIVED_TIMEOUT
+#define TCP_SYN_RECEIVED_TIMEOUT 30
+#endif
+
+//Default of 64 seconds between increments of the SYN cookie timestamp
+#ifndef TCP_SYN_COOKIE_PERIOD
+#define TCP_SYN_COOKIE_PERIOD 640
+#endif
+
+//Default of 10 seconds to wait for our FIN to be ACKed (resent every TCP_RETRANSMIT_TIMEOUT) before giving up
+#ifndef TCP_CLOSE_TIMEOUT
+#define TCP_CLOSE_TIMEOUT 100
+#endif
+
+//Default of 60 seconds to wait in FIN-WAIT-2 for the remote side to close its half of the connection
+#ifndef TCP_FIN_WAIT_2_TIMEOUT
+#define TCP_FIN_WAIT_2_TIMEOUT 600
+#endif
+
+//Default of 60 seconds without hearing from the remote side before sending keepalive probes (0 to disable)
+#ifndef TCP_KEEPALIVE_IDLE
+#define TCP_KEEPALIVE_IDLE 600
+#endif
+
+//Default of 10 seconds between keepalive probes
+#ifndef TCP_KEEPALIVE_INTERVAL
+#define TCP_KEEPALIVE_INTERVAL 100
+#endif
+
+//Default of 5 unanswered keepalive probes before dropping the connection
+#ifndef TCP_KEEPALIVE_PROBES
+#define TCP_KEEPALIVE_PROBES 5
+#endif
+
+//Default of 8 connections in TIME-WAIT
+#ifndef TCP_TIME_WAIT_TABLE_SIZE
+#define TCP_TIME_WAIT_TABLE_SIZE 8
+#endif
+
+//Default of 4 ports with registered servers
+#ifndef TCP_MAX_LISTEN_PORTS
+#define TCP_MAX_LISTEN_PORTS 4
+#endif
+
+class TCPServerBase;
+
+//Firmware with a single TCP server class can name it in staticnet-config.h, so the upper layer handlers are called
+//directly rather than through the vtable. RegisterServer() then only accepts that type. The class must be final,
+//declared at global scope, and its handlers must be accessible to TCPProtocolBase (public, or via friendship):
+//	#define STATICNET_TCP_SERVER				BoardSSHServer
+//	#define STATICNET_TCP_SERVER_HEADER			"BoardSSHServer.h"
+#ifdef STATICNET_TCP_SERVER
+class STATICNET_TCP_SERVER;
+typedef STATICNET_TCP_SERVER TCPServerType;
+#else
+typedef TCPServerBase TCPServerType;
+#endif
+
+//Default of 60 seconds (2 * MSL, with a 30 second MSL) in TIME-WAIT
+#ifndef TCP_TIME_WAIT_TIMEOUT
+#define TCP_TIME_WAIT_TIMEOUT 600
+#endif
+
+/**
+	@brief A segment which has been sent but not ACKed
+
+	These are allocated from a pool shared by all sockets. GetTxSegment() reserves one for each segment it hands out,
+	which moves to a per-socket list in sequence order once the segment is sent.
+
+	Segments sent with TCPProtocol::SendRegenerableTxSegment() don't hold on to a TX frame. Only the sequence range
+	and an application cookie are kept, and TCPProtocol::RegenerateSegment() is called to rebuild the payload if it
+	has to be retransmitted.
+ */
 class TCPSentSegment
 {
 public:
-	TCPSentSegment(TCPSegment* seg = nullptr)
-	: m_segment(seg)
-	, m_agingTicks(0)
+	TCPSentSegment()
+	: m_next(nullptr)
+	, m_segment(nullptr)
+	, m_endSeq(0)
+	, m_sentTime(0)
+	, m_length(0)
+	, m_retransmitted(false)
+	, m_cookie(0)
 	{}
 
+	///@brief Next segment in the socket's list (or the pool free list)
+	TCPSentSegment* m_next;
+
+	///@brief The segment (in network byte order), or null if it will be regenerated on retransmit
 	TCPSegment* m_segment;
-	uint32_t m_agingTicks;
+
+	///@brief Sequence number of the byte after the end of the segment
+	uint32_t m_endSeq;
+
+	///@brief Timer tick at which the segment was most recently sent
+	uint32_t m_sentTime;
+
+	///@brief Payload length of the segment
+	uint16_t m_length;
+
+	///@brief True if the segment has been sent more than once (so ACKs for it can't be used to measure RTT)
+	bool m_retransmitted;
+
+	///@brief Application defined value passed to TCPProtocol::RegenerateSegment()
+	uint32_t m_cookie;
+};
+
+/**
+	@brief One piece of a scatter list for TCPProtocol::SendStream()
+ */
+class TCPStreamBuffer
+{
+public:
+	const uint8_t* m_data;
+	uint32_t m_len;
 };
 
 /**
@@ -66,12 +212,37 @@ class TCPTableEntry
 public:
 	TCPTableEntry()
 	: m_valid(false)
+	, m_state(STATE_SYN_RECEIVED)
 	, m_remoteSeqSent(0)
+	, m_lastActivity(0)
+	, m_keepaliveProbes(0)
+	, m_unackedHead(nullptr)
+	, m_unackedTail(nullptr)
+	, m_reservedHead(nullptr)
+	, m_unackedCount(0)
+	, m_retransmitTimer(TCPTimer::TYPE_RETRANSMIT, this)
+	, m_stateTimer(TCPTimer::TYPE_SOCKET, this)
+	, m_server(nullptr)
+	, m_context(nullptr)
 	{
 	}
 
 	bool m_valid;
-	IPv4Address m_remoteIP;
+
+	///@brief Position in the connection state machine
+	enum
+	{
+		STATE_SYN_RECEIVED,		//Got a SYN and sent our SYN+ACK, waiting for the final ACK of the handshake
+		STATE_ESTABLISHED,		//Handshake complete, upper layer has been notified
+		STATE_FIN_WAIT_1,		//We closed and sent a FIN, waiting for it to be ACKed
+		STATE_FIN_WAIT_2,		//Our FIN was ACKed, waiting for the remote side to close
+		STATE_CLOSE_WAIT,		//Remote side closed, upper layer has been notified
+		STATE_CLOSING,			//Both sides sent a FIN at the same time, waiting for ours to be ACKed
+		STATE_LAST_ACK			//Remote side closed first and we sent our FIN, waiting for it to be ACKed
+	} m_state;
+
+	///@brief Remote address (either family, both share the same table)
+	IPAddress m_remoteIP;
 	uint16_t m_localPort;
 	uint16_t m_remotePort;
 
@@ -96,34 +267,181 @@ public:
 	///@brief Initial sequence number sent by remote side
 	uint32_t m_remoteInitialSeq;
 
-	//TODO: aging for session idle closure
+	///@brief Most recent ACK number received (our oldest un-ACKed sequence number)
+	uint32_t m_localAckedSeq;
+
+	///@brief Most recent window size advertised by the remote side (we don't negotiate window scaling)
+	uint16_t m_remoteWindow;
 
-	///@brief List of frames that have been sent but not ACKed
-	TCPSentSegment m_unackedFrames[TCP_MAX_UNACKED];
+	///@brief Maximum segment size advertised by the remote side
+	uint16_t m_remoteMSS;
+
+	/**
+		@brief Value of the timer tick counter when we last received a segment on this socket
+
+		Also reset on entry to the closing states, so close timeouts are measured from when the socket went idle
+		or started closing (whichever is later).
+	 */
+	uint32_t m_lastActivity;
+
+	///@brief Number of keepalive probes sent since we last heard from the remote side
+	uint8_t m_keepaliveProbes;
+
+	///@brief Oldest segment that has been sent but not ACKed
+	TCPSentSegment* m_unackedHead;
+
+	///@brief Newest segment that has been sent but not ACKed
+	TCPSentSegment* m_unackedTail;
+
+	///@brief Entries reserved by GetTxSegment() for segments which haven't been sent or cancelled yet
+	TCPSentSegment* m_reservedHead;
+
+	///@brief Number of entries in the un-ACKed and reserved lists, capped at TCP_MAX_UNACKED
+	uint16_t m_unackedCount;
+
+	///@brief Armed while the un-ACKed list is non-empty, expires when the oldest frame is due for retransmit
+	TCPTimer m_retransmitTimer;
+
+	/**
+		@brief Handshake, keepalive, and close timeouts
+
+		Re-armed lazily: receiving a segment only updates m_lastActivity, and the expiry handler works out whether
+		anything is actually due yet.
+	 */
+	TCPTimer m_stateTimer;
+
+	///@brief Server registered on the local port when the connection was opened (null if none)
+	TCPServerType* m_server;
+
+	/**
+		@brief Opaque per-connection state owned by the upper layer protocol
+
+		Cleared to null when the socket is allocated, never touched by TCPProtocol otherwise.
+	 */
+	void* m_context;
+
+#ifdef STATICNET_PERFORMANCE_COUNTERS
+
+	///@brief Performance counters for this connection (reset when the socket is allocated)
+	TCPSocketPerformanceCounters m_perfCounters;
+
+#endif
+};
+
+/**
+	@brief A connection in the TIME-WAIT state
+
+	Only the information needed to re-ACK a retransmitted FIN is kept, so the full TCPTableEntry (and any frames it
+	was holding) can be reused as soon as the connection is closed.
+ */
+class TCPTimeWaitEntry
+{
+public:
+	TCPTimeWaitEntry()
+	: m_valid(false)
+	, m_timer(TCPTimer::TYPE_TIME_WAIT, this)
+	{}
+
+	bool m_valid;
+
+	IPAddress m_remoteIP;
+	uint16_t m_localPort;
+	uint16_t m_remotePort;
+
+	///@brief Sequence number of the byte after our FIN
+	uint32_t m_localSeq;
+
+	///@brief Sequence number of the byte after the remote FIN
+	uint32_t m_remoteSeq;
+
+	///@brief Value of the timer tick counter when we entered TIME-WAIT
+	uint32_t m_startTime;
+
+	///@brief Expires the entry
+	TCPTimer m_timer;
 };
 
 /**
-	@brief A single bank of the TCP socket table (direct mapped)
+	@brief A single entry in the TCP listen table
  */
-class TCPTableWay
+class TCPListenEntry
 {
 public:
-	TCPTableEntry m_lines[TCP_TABLE_LINES];
+	uint16_t m_port;
+	TCPServerType* m_server;
 };
 
 #define TCP_IPV4_PAYLOAD_MTU (IPV4_PAYLOAD_MTU - 20)
+#define TCP_IPV6_PAYLOAD_MTU (IPV6_PAYLOAD_MTU - 20)
+
+//Default of one full segment advertised as our receive window.
+//Upper layers must be able to accept this much data in a single OnRxData() call if receive coalescing is enabled.
+#ifndef TCP_RX_WINDOW
+#define TCP_RX_WINDOW TCP_IPV4_PAYLOAD_MTU
+#endif
+
+static_assert(TCP_RX_WINDOW <= 0xffff, "TCP_RX_WINDOW must fit in 16 bits (window scaling is not supported)");
+
+//Default of no receive coalescing. If nonzero, in-order data received on one socket during an RX burst is
+//copied into a buffer of this size and delivered with a single OnRxData() call and ACK at the end of the burst.
+//This is only the default for SizedTCPProtocol, each instance can pick its own size.
+#ifndef TCP_GRO_BUFFER_SIZE
+#define TCP_GRO_BUFFER_SIZE 0
+#endif
+
+///@brief Drop reasons for TCPProtocolBase (see DropCounted)
+struct TCPDropReasons
+{
+	///@brief Reasons for discarding a received segment
+	enum DropReason
+	{
+		DROP_SHORT,				//Too small to hold a TCP header
+		DROP_BAD_CHECKSUM,		//Checksum failed
+		DROP_BAD_OFFSET,		//Data offset points past the end of the segment
+		DROP_NO_FLAGS,			//None of SYN, RST, or ACK set
+		DROP_CLOSED_PORT,		//SYN to a port nobody is listening on (answered with a RST)
+		DROP_NO_SOCKET,			//ACK or RST for a connection we don't have (and not a valid SYN cookie)
+		DROP_BAD_SEQUENCE,		//Not the next segment in sequence (answered with a duplicate ACK)
+		DROP_BAD_HANDSHAKE,		//Final ACK of the handshake doesn't ACK our SYN
+		DROP_REASON_COUNT
+	};
+};
 
 /**
 	@brief TCP protocol driver
+
+	Incoming connections are handed to the server registered for the local port with RegisterServer(). The server is
+	saved in the socket, so every later callback for the connection is a single direct call. Connections to ports
+	with no registered server are accepted if IsPortOpen() allows them, and go to the virtual handlers of this class.
+
+	The socket table, segment pool and TIME-WAIT table are owned by the derived class (see SizedTCPProtocol), so
+	stacks with different table sizes can coexist in the same application.
  */
-class TCPProtocol
+class TCPProtocolBase : public DropCounted<TCPDropReasons>
 {
 public:
-	TCPProtocol(IPv4Protocol* ipv4);
-	//TODO: IPv6 backend
-
-	bool IsTxBufferAvailable()
-	{ return m_ipv4->IsTxBufferAvailable(); }
+	TCPProtocolBase(
+		IPv4Protocol* ipv4,
+		IPv6Protocol* ipv6,
+		TCPTableEntry* socketTable,
+		uint16_t tableWays,
+		uint16_t tableLines,
+		TCPTimeWaitEntry* timeWaitTable,
+		uint16_t timeWaitTableSize);
+
+	bool RegisterServer(uint16_t port, TCPServerType* server);
+	void UnregisterServer(uint16_t port);
+	TCPServerType* GetServer(uint16_t port);
+
+	const TCPTableEntry* GetNextSocket(const TCPTableEntry* prev = nullptr);
+
+	///@brief Checks if the interface a socket sends on has a TX buffer free
+	bool IsTxBufferAvailable(TCPTableEntry* state)
+	{
+		if(state->m_remoteIP.IsIPv6())
+			return m_ipv6->IsTxBufferAvailable();
+		return m_ipv4->IsTxBufferAvailable();
+	}
 
 	void OnRxPacket(
 		TCPSegment* segment,
@@ -131,32 +449,112 @@ public:
 		IPv4Address sourceAddress,
 		uint16_t pseudoHeaderChecksum);
 
+	void OnRxPacket(
+		TCPSegment* segment,
+		uint16_t ipPayloadLength,
+		IPv6Address sourceAddress,
+		uint16_t pseudoHeaderChecksum);
+
 	virtual void OnAgingTick10x();
+	void OnTimerTick();
+
+	void OnRxBurstStart();
+	void OnRxBurstEnd();
 
 	TCPSegment* GetTxSegment(TCPTableEntry* state);
 
 	/**
 		@brief Sends a TCP segment on a given socket handle
+
+		@return False if the segment lost its tracking entry (the socket was closed since GetTxSegment()), in which
+		case it's freed without being sent
 	 */
-	void SendTxSegment(TCPTableEntry* state, TCPSegment* segment, uint16_t payloadLength)
+	bool SendTxSegment(TCPTableEntry* state, TCPSegment* segment, uint16_t payloadLength)
 	{
+		//Stamp the segment with the current stream position, in case several were allocated up front
+		StampTxSegment(state, segment);
+
 		//Update the socket state to expect a new ACK number in response to this segment
-		auto packet = reinterpret_cast<IPv4Packet*>(reinterpret_cast<uint8_t*>(segment) - sizeof(IPv4Packet));
 		state->m_localSeq += payloadLength;
 
 		//Add the PSH flag since this segment contains data
 		segment->m_offsetAndFlags |= TCPSegment::FLAG_PSH;
 
 		//Reay to send
-		SendSegment(state, segment, packet, payloadLength + sizeof(TCPSegment));
+		if(SendSegment(state, segment, payloadLength + sizeof(TCPSegment)))
+			return true;
+		state->m_localSeq -= payloadLength;
+		return false;
+	}
+
+	/**
+		@brief Sends a TCP segment whose payload can be rebuilt by RegenerateSegment() if it's lost
+
+		The TX frame is freed as soon as it's sent rather than being held until it's ACKed, so a socket sending
+		reproducible content (static files etc) can keep a large window in flight with only a few TX buffers.
+		The segment still takes a tracking entry, and counts against TCP_MAX_UNACKED, until it's ACKed.
+
+		@param state			The socket
+		@param segment			Segment from GetTxSegment()
+		@param payloadLength	Number of payload bytes in the segment
+		@param cookie			Application defined value passed to RegenerateSegment() if the segment is retransmitted
+
+		@return False if the segment lost its tracking entry (the socket was closed since GetTxSegment()), in which
+		case it's freed without being sent
+	 */
+	bool SendRegenerableTxSegment(TCPTableEntry* state, TCPSegment* segment, uint16_t payloadLength, uint32_t cookie)
+	{
+		StampTxSegment(state, segment);
+		state->m_localSeq += payloadLength;
+		segment->m_offsetAndFlags |= TCPSegment::FLAG_PSH;
+		if(SendSegment(state, segment, payloadLength + sizeof(TCPSegment), RETRANSMIT_REGENERATE, cookie))
+			return true;
+		state->m_localSeq -= payloadLength;
+		return false;
 	}
 
 	///@brief Cancels sending of a packet
 	void CancelTxSegment(TCPSegment* segment, TCPTableEntry* state);
 
+	/**
+		@brief Gets the largest payload we can put in a single segment on a given socket
+	 */
+	uint16_t GetMaxSegmentSize(TCPTableEntry* state)
+	{
+		auto mtu = GetPayloadMTU(state);
+		if(state->m_remoteMSS < mtu)
+			return state->m_remoteMSS;
+		return mtu;
+	}
+
+	/**
+		@brief Gets the number of bytes we can send on a given socket before filling the remote side's window
+	 */
+	uint32_t GetSendWindow(TCPTableEntry* state)
+	{
+		uint32_t inFlight = state->m_localSeq - state->m_localAckedSeq;
+		if(inFlight >= state->m_remoteWindow)
+			return 0;
+		return state->m_remoteWindow - inFlight;
+	}
+
+	bool CanSendBurst(TCPTableEntry* state, uint16_t segments, uint32_t bytes);
+
+	uint32_t SendStream(TCPTableEntry* state, const uint8_t* data, uint32_t len);
+	uint32_t SendStream(TCPTableEntry* state, const TCPStreamBuffer* buffers, uint16_t count);
+
 	///@brief Close a socket from the server side
 	void CloseSocket(TCPTableEntry* state);
 
+	/**
+		@brief Configures keepalive for all sockets
+
+		@param idle		Time in 100ms units without hearing from the remote side before probing (0 to disable)
+		@param interval	Time in 100ms units between probes
+		@param probes	Number of unanswered probes before the connection is dropped
+	 */
+	void SetKeepalive(uint32_t idle, uint32_t interval, uint8_t probes);
+
 protected:
 	virtual bool IsPortOpen(uint16_t port);
 
@@ -170,25 +568,278 @@ protected:
 	virtual void OnRxData(TCPTableEntry* state, uint8_t* payload, uint16_t payloadLen);
 	virtual void OnConnectionAccepted(TCPTableEntry* state);
 	virtual void OnConnectionClosed(TCPTableEntry* state);
+	virtual bool RegenerateSegment(
+		TCPTableEntry* state,
+		uint8_t* payload,
+		uint16_t payloadLen,
+		uint32_t streamOffset,
+		uint32_t cookie);
+
+	//Route upper layer callbacks to the socket's server, if it has one
+	void NotifyRxData(TCPTableEntry* state, uint8_t* payload, uint16_t payloadLen);
+	void NotifyConnectionAccepted(TCPTableEntry* state);
+	void NotifyConnectionClosed(TCPTableEntry* state);
+	bool NotifyRegenerateSegment(
+		TCPTableEntry* state,
+		uint8_t* payload,
+		uint16_t payloadLen,
+		uint32_t streamOffset,
+		uint32_t cookie);
 
 protected:
-	void OnRxSYN(TCPSegment* segment, IPv4Address sourceAddress);
-	void OnRxRST(TCPSegment* segment, IPv4Address sourceAddress);
-	void OnRxACK(TCPSegment* segment, IPv4Address sourceAddress, uint16_t payloadLen);
+	/*
+		The receive path is templated on the address type (IPv4Address or IPv6Address), so each family gets its own
+		copy with the address comparisons and reply allocation resolved at compile time. Once a segment has been
+		matched to a socket, everything works on the TCPTableEntry and only branches on the family when it touches
+		the IP layer.
+	 */
+	template<class AddressType>
+	void OnRxSegment(
+		TCPSegment* segment,
+		uint16_t ipPayloadLength,
+		AddressType sourceAddress,
+		uint16_t pseudoHeaderChecksum);
+
+	template<class AddressType>
+	void OnRxSYN(TCPSegment* segment, AddressType sourceAddress);
+	template<class AddressType>
+	void OnRxRST(TCPSegment* segment, AddressType sourceAddress);
+	template<class AddressType>
+	void OnRxACK(TCPSegment* segment, AddressType sourceAddress, uint16_t payloadLen);
+	template<class AddressType>
+	void OnRxTimeWait(TCPSegment* segment, TCPTimeWaitEntry* tw, AddressType sourceAddress);
 
 	uint16_t Hash(IPv4Address ip, uint16_t localPort, uint16_t remotePort);
+	uint16_t Hash(IPv6Address ip, uint16_t localPort, uint16_t remotePort);
+
+	///@brief Gets the socket table entry for a given way and row
+	TCPTableEntry& GetRow(size_t way, size_t row)
+	{ return m_socketTable[way*m_tableLines + row]; }
+
+	template<class AddressType>
+	void SendSYNCookie(TCPSegment* segment, AddressType sourceAddress);
+	template<class AddressType>
+	TCPTableEntry* ValidateSYNCookie(TCPSegment* segment, AddressType sourceAddress);
+	template<class AddressType>
+	uint32_t GenerateSYNCookie(
+		AddressType ip,
+		uint16_t localPort,
+		uint16_t remotePort,
+		uint32_t remoteInitialSeq,
+		uint32_t timestamp);
 
 	TCPTableEntry* AllocateSocketHandle(uint16_t hash);
-	TCPTableEntry* GetSocketState(IPv4Address ip, uint16_t localPort, uint16_t remotePort);
-	IPv4Packet* CreateReply(TCPTableEntry* state);
+	bool EvictHalfOpenSocket(uint16_t hash);
+	template<class AddressType>
+	TCPTableEntry* GetSocketState(AddressType ip, uint16_t localPort, uint16_t remotePort);
+	TCPSegment* CreateReply(TCPTableEntry* state);
+
+	///@brief Updates the sequence and ACK numbers of a segment from GetTxSegment() just before it's sent
+	void StampTxSegment(TCPTableEntry* state, TCPSegment* segment)
+	{
+		segment->m_sequence = state->m_localSeq;
+		segment->m_ack = state->m_remoteSeq;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Per-family glue to the IP layer (resolved at compile time)
+
+	IPv4Packet* GetTxPacket(IPv4Address dest)
+	{ return m_ipv4->GetTxPacket(dest, IP_PROTO_TCP); }
+
+	IPv6Packet* GetTxPacket(IPv6Address dest)
+	{ return m_ipv6 ? m_ipv6->GetTxPacket(dest, IP_PROTO_TCP) : nullptr; }
+
+	void SendTxPacket(IPv4Packet* packet, uint16_t length, bool markFree)
+	{ m_ipv4->SendTxPacket(packet, length, markFree); }
+
+	void SendTxPacket(IPv6Packet* packet, uint16_t length, bool markFree)
+	{ m_ipv6->SendTxPacket(packet, length, markFree); }
+
+	uint16_t GetTxChecksum(IPv4Packet* packet, TCPSegment* segment, uint16_t length);
+	uint16_t GetTxChecksum(IPv6Packet* packet, TCPSegment* segment, uint16_t length);
+
+	static uint16_t GetPayloadMTU(IPv4Address /*ip*/)
+	{ return TCP_IPV4_PAYLOAD_MTU; }
+
+	static uint16_t GetPayloadMTU(IPv6Address /*ip*/)
+	{ return TCP_IPV6_PAYLOAD_MTU; }
+
+	///@brief Gets the largest segment payload the local link can carry for a socket
+	static uint16_t GetPayloadMTU(TCPTableEntry* state)
+	{ return state->m_remoteIP.IsIPv6() ? TCP_IPV6_PAYLOAD_MTU : TCP_IPV4_PAYLOAD_MTU; }
 
-	void SendSegment(TCPTableEntry* state, TCPSegment* segment, IPv4Packet* packet, uint16_t length = sizeof(TCPSegment));
+	///@brief Gets the IP packet containing an outbound segment
+	template<class PacketType>
+	static PacketType* GetPacket(TCPSegment* segment)
+	{ return reinterpret_cast<PacketType*>(reinterpret_cast<uint8_t*>(segment) - sizeof(PacketType)); }
+
+	void ResendTxSegment(TCPTableEntry* state, TCPSegment* segment);
+	void FreeTxSegment(TCPTableEntry* state, TCPSegment* segment);
+
+	void OnRetransmitTimer(TCPTableEntry* state);
+	void OnSocketTimer(TCPTableEntry* state);
+
+	///@brief Gets the current time, in timer ticks
+	uint32_t GetTime()
+	{ return m_timers.GetTime(); }
+
+	void SendFIN(TCPTableEntry* state);
+	void SendKeepalive(TCPTableEntry* state);
+	void SendReset(TCPTableEntry* state);
+	void EnterTimeWait(TCPTableEntry* state);
+	void ReleaseSocket(TCPTableEntry* state);
+	void FreeUnackedSegments(TCPTableEntry* state);
+	TCPSentSegment* TakeReservation(TCPTableEntry* state, TCPSegment* segment);
+	void InitSegmentPool(TCPSentSegment* pool, uint16_t size);
+	void InitCoalescingBuffer(uint8_t* buf, uint16_t size);
+	template<class AddressType>
+	TCPTimeWaitEntry* GetTimeWaitState(AddressType ip, uint16_t localPort, uint16_t remotePort);
+
+	///@brief How SendSegment() should handle a segment containing data if it's lost
+	enum RetransmitMode
+	{
+		RETRANSMIT_KEEP_FRAME,		//Hold the TX frame until it's ACKed and resend it as is
+		RETRANSMIT_REGENERATE,		//Free the TX frame once sent, and rebuild the payload with RegenerateSegment()
+		RETRANSMIT_UNTRACKED		//Already in the un-ACKed list (regenerated retransmission)
+	};
+
+	template<class AddressType>
+	bool CanCoalesce(TCPSegment* segment, AddressType sourceAddress, uint16_t payloadLen);
+	void FlushCoalescedData();
+
+	bool SendSegment(
+		TCPTableEntry* state,
+		TCPSegment* segment,
+		uint16_t length = sizeof(TCPSegment),
+		RetransmitMode mode = RETRANSMIT_KEEP_FRAME,
+		uint32_t cookie = 0);
+
+	template<class PacketType>
+	bool SendSegment(
+		TCPTableEntry* state,
+		TCPSegment* segment,
+		PacketType* packet,
+		uint16_t length = sizeof(TCPSegment),
+		RetransmitMode mode = RETRANSMIT_KEEP_FRAME,
+		uint32_t cookie = 0);
+	bool ResendRegeneratedSegment(TCPTableEntry* state, TCPSentSegment* sent);
 
 	///@brief The IPv4 protocol stack
 	IPv4Protocol* m_ipv4;
 
+	///@brief The IPv6 protocol stack (if present)
+	IPv6Protocol* m_ipv6;
+
+	///@brief The socket state table (way-major, m_tableWays x m_tableLines)
+	TCPTableEntry* m_socketTable;
+
+	///@brief Number of ways in the socket table
+	uint16_t m_tableWays;
+
+	///@brief Number of lines in each way of the socket table
+	uint16_t m_tableLines;
+
+	///@brief Ports with registered servers, sorted by port number
+	TCPListenEntry m_listenPorts[TCP_MAX_LISTEN_PORTS];
+
+	///@brief Number of valid entries in m_listenPorts
+	uint16_t m_numListenPorts;
+
+	///@brief Head of the list of free un-ACKed segment entries (storage is in the derived class)
+	TCPSentSegment* m_freeSegments;
+
+	///@brief Connections in TIME-WAIT
+	TCPTimeWaitEntry* m_timeWaitTable;
+
+	///@brief Number of entries in m_timeWaitTable
+	uint16_t m_timeWaitTableSize;
+
+	///@brief Timers for all sockets, also keeps track of the current time
+	TCPTimerWheel m_timers;
+
+	///@brief Timer ticks of idle time before sending keepalive probes (0 if disabled)
+	uint32_t m_keepaliveIdle;
+
+	///@brief Timer ticks between keepalive probes
+	uint32_t m_keepaliveInterval;
+
+	///@brief Number of unanswered keepalive probes before dropping the connection
+	uint8_t m_keepaliveMaxProbes;
+
+	///@brief True if m_cookieSecret has been initialized
+	bool m_cookieSecretValid;
+
+	///@brief Secret key for generating SYN cookies
+	uint32_t m_cookieSecret[2];
+
+	///@brief True between OnRxBurstStart() and OnRxBurstEnd(), if coalescing is enabled
+	bool m_inRxBurst;
+
+	///@brief Socket which the data in m_groBuffer belongs to
+	TCPTableEntry* m_groSocket;
+
+	///@brief Number of bytes of data in m_groBuffer
+	uint16_t m_groLength;
+
+	///@brief In-order data received during the current RX burst, not yet passed to OnRxData()
+	uint8_t* m_groBuffer;
+
+	///@brief Size of m_groBuffer (zero if coalescing is disabled)
+	uint16_t m_groBufferSize;
+};
+
+/**
+	@brief TCP protocol driver with storage for a WAYS x LINES socket table, POOL un-ACKed segments, TIMEWAIT
+	connections in TIME-WAIT, and a GRO byte receive coalescing buffer (zero to disable coalescing)
+
+	Defaults to the TCP_TABLE_WAYS, TCP_TABLE_LINES, TCP_SEGMENT_POOL_SIZE, TCP_TIME_WAIT_TABLE_SIZE and
+	TCP_GRO_BUFFER_SIZE values from staticnet-config.h.
+
+	TCP_MAX_UNACKED is a per-socket limit rather than storage, and is shared by all instances.
+ */
+template<
+	uint16_t WAYS = TCP_TABLE_WAYS,
+	uint16_t LINES = TCP_TABLE_LINES,
+	uint16_t POOL = TCP_SEGMENT_POOL_SIZE,
+	uint16_t TIMEWAIT = TCP_TIME_WAIT_TABLE_SIZE,
+	uint16_t GRO = TCP_GRO_BUFFER_SIZE>
+class SizedTCPProtocol : public TCPProtocolBase
+{
+public:
+	SizedTCPProtocol(IPv4Protocol* ipv4, IPv6Protocol* ipv6 = nullptr)
+	: TCPProtocolBase(ipv4, ipv6, m_socketStorage, WAYS, LINES, m_timeWaitStorage, TIMEWAIT)
+	{
+		//Members are constructed after the base class, so the pool can't be linked up until now
+		InitSegmentPool(m_segmentStorage, POOL);
+		InitCoalescingBuffer(m_groStorage, GRO);
+	}
+
+protected:
 	///@brief The socket state table
-	TCPTableWay m_socketTable[TCP_TABLE_WAYS];
+	TCPTableEntry m_socketStorage[WAYS * LINES];
+
+	///@brief Storage for un-ACKed segments of all sockets
+	TCPSentSegment m_segmentStorage[POOL];
+
+	///@brief Connections in TIME-WAIT
+	TCPTimeWaitEntry m_timeWaitStorage[TIMEWAIT];
+
+	///@brief Receive coalescing buffer (always at least one byte, since zero length arrays aren't allowed)
+	uint8_t m_groStorage[GRO ? GRO : 1];
+};
+
+/**
+	@brief TCP protocol driver with the default table sizes
+
+	A class rather than a typedef of SizedTCPProtocol<>, so that it can be forward declared.
+ */
+class TCPProtocol : public SizedTCPProtocol<>
+{
+public:
+	TCPProtocol(IPv4Protocol* ipv4, IPv6Protocol* ipv6 = nullptr)
+	: SizedTCPProtocol(ipv4, ipv6)
+	{}
 };
 
 #endif
@@ -52,6 +52,14 @@ public:
 		FLAG_ACK	= 0x10
 	};
 
+	//only options we care about
+	enum TcpOptions
+	{
+		OPTION_END	= 0,
+		OPTION_NOP	= 1,
+		OPTION_MSS	= 2
+	};
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Byte ordering correction
 
@@ -76,6 +84,51 @@ public:
 	uint8_t* Payload()
 	{ return reinterpret_cast<uint8_t*>(this) + GetDataOffsetBytes(); }
 
+	/**
+		@brief Looks for a maximum segment size option, returning the default if there is none
+
+		Must be called after ByteSwap(). Malformed options are ignored.
+	 */
+	uint16_t GetMaxSegmentSize(uint16_t defaultMSS)
+	{
+		auto opt = reinterpret_cast<uint8_t*>(this) + sizeof(TCPSegment);
+		auto end = Payload();
+		while(opt < end)
+		{
+			if(opt[0] == OPTION_END)
+				break;
+			if(opt[0] == OPTION_NOP)
+			{
+				opt ++;
+				continue;
+			}
+
+			//Everything else is type-length-value
+			if( (opt + 2 > end) || (opt[1] < 2) || (opt + opt[1] > end) )
+				break;
+			if( (opt[0] == OPTION_MSS) && (opt[1] == 4) )
+				return (opt[2] << 8) | opt[3];
+			opt += opt[1];
+		}
+
+		return defaultMSS;
+	}
+
+	/**
+		@brief Adds a maximum segment size option to a header which doesn't have any options yet
+
+		Must be called before ByteSwap().
+	 */
+	void SetMaxSegmentSize(uint16_t mss)
+	{
+		auto opt = reinterpret_cast<uint8_t*>(this) + sizeof(TCPSegment);
+		opt[0] = OPTION_MSS;
+		opt[1] = 4;
+		opt[2] = mss >> 8;
+		opt[3] = mss & 0xff;
+		m_offsetAndFlags = (m_offsetAndFlags & 0x0fff) | (6 << 12);
+	}
+
 	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 	// Data members
 
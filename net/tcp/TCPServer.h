@@ -28,11 +28,35 @@
 ***********************************************************************************************************************/
 /**
 	@file
-	@brief Declaration of TCPServer
+	@brief Declaration of TCPServerBase and TCPServer
  */
 #ifndef TCPServer_h
 #define TCPServer_h
 
+/**
+	@brief Interface for anything which can be registered with TCPProtocolBase::RegisterServer()
+ */
+class TCPServerBase
+{
+public:
+	virtual void OnConnectionAccepted(TCPTableEntry* socket) =0;
+	virtual void OnConnectionClosed(TCPTableEntry* socket) =0;
+	virtual bool OnRxData(TCPTableEntry* socket, uint8_t* payload, uint16_t payloadLen) =0;
+
+	/**
+		@brief Rebuilds the payload of a lost segment sent with TCPProtocol::SendRegenerableTxSegment()
+
+		The default implementation returns false, which aborts the connection.
+	 */
+	virtual bool RegenerateSegment(
+		[[maybe_unused]] TCPTableEntry* socket,
+		[[maybe_unused]] uint8_t* payload,
+		[[maybe_unused]] uint16_t payloadLen,
+		[[maybe_unused]] uint32_t streamOffset,
+		[[maybe_unused]] uint32_t cookie)
+	{ return false; }
+};
+
 /**
 	@brief Helper class for implementing TCP servers
 
@@ -42,19 +66,31 @@
 		TCPTableEntry* m_socket
  */
 template<int MAXCONNS, class ContextType>
-class TCPServer
+class TCPServer : public TCPServerBase
 {
 public:
-	TCPServer(TCPProtocol& tcp)
+	TCPServer(TCPProtocolBase& tcp)
 		: m_tcp(tcp)
 	{
 	}
 
-	virtual void OnConnectionAccepted(TCPTableEntry* socket) =0;
-	virtual void OnConnectionClosed(TCPTableEntry* socket) =0;
-	virtual bool OnRxData(TCPTableEntry* socket, uint8_t* payload, uint16_t payloadLen) =0;
 	virtual void GracefulDisconnect(int id, TCPTableEntry* socket) =0;
 
+#ifndef STATICNET_TCP_SERVER
+
+	/**
+		@brief Starts accepting connections on a port
+
+		Not available if STATICNET_TCP_SERVER is defined, since only that class can be registered. It registers
+		itself with m_tcp.RegisterServer(port, this) instead.
+
+		@return False if the port already has a server or the listen table is full
+	 */
+	bool Listen(uint16_t port)
+	{ return m_tcp.RegisterServer(port, this); }
+
+#endif
+
 	TCPSegment* GetTxSegment(TCPTableEntry* socket)
 	{ return m_tcp.GetTxSegment(socket); }
 
@@ -62,15 +98,20 @@ protected:
 
 	/**
 		@brief Finds the connection ID for a TCP socket, or returns -1 if it's not a currently connected session
+
+		The socket's context slot points straight at our state, so this is O(1) regardless of MAXCONNS.
 	 */
 	int GetConnectionID(TCPTableEntry* socket)
 	{
-		//Just a linear search for now
-		for(int i=0; i<MAXCONNS; i++)
-		{
-			if(m_state[i].m_valid && (m_state[i].m_socket == socket))
-				return i;
-		}
+		//Make sure the context is one of ours, and hasn't since been reused for another connection
+		auto ctx = reinterpret_cast<uintptr_t>(socket->m_context);
+		auto base = reinterpret_cast<uintptr_t>(&m_state[0]);
+		if( (ctx < base) || (ctx >= base + sizeof(m_state)) )
+			return -1;
+
+		int id = (ctx - base) / sizeof(ContextType);
+		if(m_state[id].m_valid && (m_state[id].m_socket == socket))
+			return id;
 
 		return -1;
 	}
@@ -87,6 +128,7 @@ protected:
 				m_state[i].Clear();
 				m_state[i].m_valid = true;
 				m_state[i].m_socket = socket;
+				socket->m_context = &m_state[i];
 				return i;
 			}
 		}
@@ -97,7 +139,7 @@ protected:
 protected:
 
 	///@brief The transport layer for our traffic
-	TCPProtocol& m_tcp;
+	TCPProtocolBase& m_tcp;
 
 	///@brief Context data for connected clients
 	ContextType m_state[MAXCONNS];
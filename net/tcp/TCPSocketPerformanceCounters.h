@@ -0,0 +1,86 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Declaration of TCPSocketPerformanceCounters
+ */
+
+#ifndef TCPSocketPerformanceCounters_h
+#define TCPSocketPerformanceCounters_h
+
+#ifdef STATICNET_PERFORMANCE_COUNTERS
+
+/**
+	@brief Performance counters for a single TCP connection
+
+	The current send window and data in flight aren't duplicated here, they're in the TCPTableEntry itself
+	(m_remoteWindow, and m_localSeq - m_localAckedSeq).
+ */
+class TCPSocketPerformanceCounters
+{
+public:
+	TCPSocketPerformanceCounters()
+	: m_rxBytes(0)
+	, m_txBytes(0)
+	, m_txSegmentsRetransmitted(0)
+	, m_rxDuplicateAcks(0)
+	, m_rxSegmentsOutOfOrder(0)
+	, m_smoothedRTT(0)
+	{
+	}
+
+	///@brief Number of in-order payload bytes received and delivered to the upper layer protocol
+	uint32_t	m_rxBytes;
+
+	///@brief Number of payload bytes sent for the first time (not counting retransmissions)
+	uint32_t	m_txBytes;
+
+	///@brief Number of segments retransmitted after a timeout
+	uint32_t	m_txSegmentsRetransmitted;
+
+	///@brief Number of ACKs received which acknowledged nothing new while we had data in flight
+	uint32_t	m_rxDuplicateAcks;
+
+	///@brief Number of incoming segments dropped because they arrived after a gap in the sequence space
+	uint32_t	m_rxSegmentsOutOfOrder;
+
+	/**
+		@brief Smoothed round trip time, in timer ticks (see TCP_TIMER_HZ) times 8
+
+		Exponentially weighted moving average with gain 1/8 (RFC 6298). Samples are only taken from segments which
+		weren't retransmitted (Karn's algorithm). Zero until the first sample.
+	 */
+	uint32_t	m_smoothedRTT;
+};
+
+#endif
+
+#endif
@@ -0,0 +1,224 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Declaration of TCPTimer and TCPTimerWheel
+ */
+#ifndef TCPTimerWheel_h
+#define TCPTimerWheel_h
+
+//Default of 64 slots in the timer wheel
+#ifndef TCP_TIMER_WHEEL_SLOTS
+#define TCP_TIMER_WHEEL_SLOTS 64
+#endif
+
+static_assert( (TCP_TIMER_WHEEL_SLOTS & (TCP_TIMER_WHEEL_SLOTS - 1)) == 0, "TCP_TIMER_WHEEL_SLOTS must be a power of two");
+
+/**
+	@brief Links for a doubly linked list of timers
+
+	Used on its own for the list heads in TCPTimerWheel, so they don't pay for the rest of TCPTimer.
+ */
+class TCPTimerLink
+{
+public:
+	TCPTimerLink()
+	: m_next(nullptr)
+	, m_prev(nullptr)
+	{}
+
+	///@brief Next timer in the same list
+	TCPTimerLink* m_next;
+
+	///@brief Previous timer in the same list
+	TCPTimerLink* m_prev;
+};
+
+/**
+	@brief A timer which can be armed in a TCPTimerWheel
+
+	Timers are embedded in the object they belong to, so arming one never allocates memory. The type and owner fields
+	tell the expiry handler what to do with it.
+ */
+class TCPTimer : public TCPTimerLink
+{
+public:
+	enum
+	{
+		TYPE_NONE,
+		TYPE_RETRANSMIT,	//Retransmit timer for a TCPTableEntry
+		TYPE_SOCKET,		//Connection state timer (handshake, keepalive, close) for a TCPTableEntry
+		TYPE_TIME_WAIT		//Expiry of a TCPTimeWaitEntry
+	};
+
+	TCPTimer(uint8_t type = TYPE_NONE, void* owner = nullptr)
+	: m_deadline(0)
+	, m_armed(false)
+	, m_type(type)
+	, m_owner(owner)
+	{}
+
+	bool IsArmed() const
+	{ return m_armed; }
+
+	///@brief Timer tick at which this timer expires
+	uint32_t m_deadline;
+
+	///@brief True if the timer is in the wheel
+	bool m_armed;
+
+	///@brief What kind of object owns the timer
+	uint8_t m_type;
+
+	///@brief The object which owns the timer
+	void* m_owner;
+};
+
+/**
+	@brief A hashed timer wheel (Varghese and Lauck, 1987)
+
+	Timers are hashed into one of TCP_TIMER_WHEEL_SLOTS doubly linked lists by deadline. Each tick only looks at one
+	slot, so the cost of a tick scales with the number of armed timers rather than the number of objects which could
+	have one. Deadlines more than one revolution out just stay in their slot for more than one pass.
+
+	Arming and cancelling a timer are O(1).
+
+	This class has no interlocks and is not thread/interrupt safe without external locks.
+ */
+class TCPTimerWheel
+{
+public:
+	TCPTimerWheel()
+	: m_now(0)
+	{
+		for(auto& s : m_slots)
+			s.m_next = s.m_prev = &s;
+		m_expired.m_next = m_expired.m_prev = &m_expired;
+	}
+
+	///@brief Returns the current time, in ticks (wraps)
+	uint32_t GetTime() const
+	{ return m_now; }
+
+	/**
+		@brief Arms a timer to expire the given number of ticks from now (minimum of 1).
+
+		If the timer was already armed, it's rescheduled.
+	 */
+	void Arm(TCPTimer* timer, uint32_t ticks)
+	{
+		Cancel(timer);
+
+		if(ticks == 0)
+			ticks = 1;
+		timer->m_deadline = m_now + ticks;
+		timer->m_armed = true;
+		Link(&m_slots[timer->m_deadline & (TCP_TIMER_WHEEL_SLOTS - 1)], timer);
+	}
+
+	///@brief Disarms a timer, if it's armed
+	void Cancel(TCPTimer* timer)
+	{
+		if(!timer->m_armed)
+			return;
+		Unlink(timer);
+		timer->m_armed = false;
+	}
+
+	/**
+		@brief Advances time by one tick.
+
+		Call PopExpired() until it returns null to handle all timers which expired during this tick.
+	 */
+	void Tick()
+	{
+		m_now ++;
+
+		//Move everything due now to the expired list
+		auto& slot = m_slots[m_now & (TCP_TIMER_WHEEL_SLOTS - 1)];
+		for(auto link = slot.m_next; link != &slot; )
+		{
+			auto t = static_cast<TCPTimer*>(link);
+			link = link->m_next;
+			if(t->m_deadline == m_now)
+			{
+				Unlink(t);
+				Link(&m_expired, t);
+			}
+		}
+	}
+
+	/**
+		@brief Removes and returns the next expired timer, or null if there are none.
+
+		Handlers are free to arm or cancel any timer (including the one just returned) before calling this again.
+	 */
+	TCPTimer* PopExpired()
+	{
+		if(m_expired.m_next == &m_expired)
+			return nullptr;
+
+		auto t = static_cast<TCPTimer*>(m_expired.m_next);
+		Unlink(t);
+		t->m_armed = false;
+		return t;
+	}
+
+protected:
+
+	///@brief Inserts a timer at the tail of a list
+	void Link(TCPTimerLink* head, TCPTimerLink* timer)
+	{
+		timer->m_prev = head->m_prev;
+		timer->m_next = head;
+		head->m_prev->m_next = timer;
+		head->m_prev = timer;
+	}
+
+	///@brief Removes a timer from whatever list it's in
+	void Unlink(TCPTimerLink* timer)
+	{
+		timer->m_prev->m_next = timer->m_next;
+		timer->m_next->m_prev = timer->m_prev;
+		timer->m_next = nullptr;
+		timer->m_prev = nullptr;
+	}
+
+	///@brief Current time
+	uint32_t m_now;
+
+	///@brief List heads for each slot
+	TCPTimerLink m_slots[TCP_TIMER_WHEEL_SLOTS];
+
+	///@brief List head for timers which expired this tick but haven't been handled yet
+	TCPTimerLink m_expired;
+};
+
+#endif
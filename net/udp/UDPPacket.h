@@ -36,6 +36,7 @@
 #define UDPPacket_h
 
 #include "../ipv4/IPv4Packet.h"
+#include "../ipv6/IPv6Packet.h"
 
 /**
 	@brief A UDP packet sent over IPv4
@@ -82,4 +83,16 @@ public:
 	//Data comes after this
 };
 
+/**
+	@brief A UDP packet sent over IPv6
+
+	Same layout as UDPPacket. The distinct type lets UDPProtocol pick the IPv6 send path at compile time.
+ */
+class UDPv6Packet : public UDPPacket
+{
+public:
+	IPv6Packet* Parent()
+	{ return reinterpret_cast<IPv6Packet*>(reinterpret_cast<uint8_t*>(this) - sizeof(IPv6Packet)); }
+};
+
 #endif
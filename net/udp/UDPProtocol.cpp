@@ -33,29 +33,115 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
-UDPProtocol::UDPProtocol(IPv4Protocol* ipv4)
+UDPProtocol::UDPProtocol(IPv4Protocol* ipv4, IPv6Protocol* ipv6)
 	: m_ipv4(ipv4)
+	, m_ipv6(ipv6)
+	, m_numPorts(0)
+	, m_unmatchedPolicy(UNMATCHED_DELIVER)
 {
 }
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Port table
+
+/**
+	@brief Binds a handler to a local port
+
+	Registration is expected to happen at startup, so this is a simple insertion into the sorted table.
+
+	@return False if the port is already bound or the table is full
+ */
+bool UDPProtocol::RegisterPortHandler(uint16_t port, UDPPortHandler* handler)
+{
+	if( (m_numPorts >= UDP_MAX_PORT_HANDLERS) || GetPortHandler(port) )
+		return false;
+
+	//Shift larger ports up to make room, keeping the table sorted
+	uint16_t i = m_numPorts;
+	for(; (i > 0) && (m_ports[i-1].m_port > port); i--)
+		m_ports[i] = m_ports[i-1];
+
+	m_ports[i].m_port = port;
+	m_ports[i].m_handler = handler;
+	m_numPorts ++;
+	return true;
+}
+
+/**
+	@brief Removes the handler bound to a port, if there is one
+ */
+void UDPProtocol::UnregisterPortHandler(uint16_t port)
+{
+	for(uint16_t i=0; i<m_numPorts; i++)
+	{
+		if(m_ports[i].m_port != port)
+			continue;
+
+		for(; i+1 < m_numPorts; i++)
+			m_ports[i] = m_ports[i+1];
+		m_numPorts --;
+		return;
+	}
+}
+
+/**
+	@brief Looks up the handler bound to a port
+
+	@return The handler, or null if the port isn't bound
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+UDPPortHandler* UDPProtocol::GetPortHandler(uint16_t port)
+{
+	uint16_t lo = 0;
+	uint16_t hi = m_numPorts;
+	while(lo < hi)
+	{
+		uint16_t mid = (lo + hi) / 2;
+		if(m_ports[mid].m_port < port)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if( (lo < m_numPorts) && (m_ports[lo].m_port == port) )
+		return m_ports[lo].m_handler;
+	return nullptr;
+}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Handler for incoming packets
 
 /**
 	@brief Handles an incoming UDP packet
  */
+template<class AddressType>
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
-void UDPProtocol::OnRxPacket(
+void UDPProtocol::OnRxPacketCommon(
 	UDPPacket* packet,
 	uint16_t ipPayloadLength,
-	IPv4Address sourceAddress,
+	AddressType sourceAddress,
 	uint16_t pseudoHeaderChecksum)
 {
+	LATENCY_MARK(STAGE_UDP);
+
 	//Drop any packets too small for a complete UDP header
 	if(ipPayloadLength < 8)
+	{
+		CountDrop(DROP_SHORT);
 		return;
+	}
+
+	//Find out who it's for. If nobody, and we're dropping those, don't bother with the checksum
+	auto handler = GetPortHandler(__builtin_bswap16(packet->m_destPort));
+	if(!handler && (m_unmatchedPolicy == UNMATCHED_DROP) )
+	{
+		CountDrop(DROP_NO_HANDLER);
+		return;
+	}
 
 	//Verify checksum of packet body
 	if(0xffff != IPv4Protocol::InternetChecksum(
@@ -63,16 +149,80 @@ void UDPProtocol::OnRxPacket(
 		ipPayloadLength,
 		pseudoHeaderChecksum))
 	{
+		CountDrop(DROP_BAD_CHECKSUM);
+		return;
+	}
+
+	if(!handler && (m_unmatchedPolicy == UNMATCHED_REJECT) )
+	{
+		CountDrop(DROP_NO_HANDLER);
+		SendPortUnreachable(packet, sourceAddress);
 		return;
 	}
+
 	packet->ByteSwap();
 
-	//Sanity check packet length fits in the packet
-	if(packet->m_len > ipPayloadLength)
+	//Sanity check packet length fits in the packet and covers the header
+	if( (packet->m_len > ipPayloadLength) || (packet->m_len < 8) )
+	{
+		CountDrop(DROP_BAD_LENGTH);
 		return;
+	}
 
 	//Handle the incoming packet
-	OnRxData(sourceAddress, packet->m_sourcePort, packet->m_destPort, packet->Payload(), packet->m_len);
+	if(handler)
+		handler->OnRxData(sourceAddress, packet->m_sourcePort, packet->m_destPort, packet->Payload(), packet->m_len - 8);
+	else
+		OnRxData(sourceAddress, packet->m_sourcePort, packet->m_destPort, packet->Payload(), packet->m_len - 8);
+}
+
+/**
+	@brief Reports a packet to an unbound port back to the sender, if it was unicast to us
+
+	The packet must still be in network byte order.
+ */
+void UDPProtocol::SendPortUnreachable(UDPPacket* packet, [[maybe_unused]] IPv4Address sourceAddress)
+{
+	auto icmp = m_ipv4->GetICMPv4();
+	auto ipack = packet->Parent();
+	if(!icmp || (m_ipv4->GetAddressType(ipack->m_destAddress) != IPv4Protocol::ADDR_UNICAST_US) )
+		return;
+
+	icmp->SendDestUnreachable(ipack, ICMPv4Packet::CODE_PORT_UNREACHABLE);
+}
+
+void UDPProtocol::SendPortUnreachable(UDPPacket* packet, [[maybe_unused]] IPv6Address sourceAddress)
+{
+	auto icmp = m_ipv6->GetICMPv6();
+	auto ipack = static_cast<UDPv6Packet*>(packet)->Parent();
+	if(!icmp || (m_ipv6->GetAddressType(ipack->m_destAddress) != IPv6Protocol::ADDR_UNICAST_US) )
+		return;
+
+	icmp->SendDestUnreachable(ipack, ICMPv6Packet::CODE_PORT_UNREACHABLE);
+}
+
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+void UDPProtocol::OnRxPacket(
+	UDPPacket* packet,
+	uint16_t ipPayloadLength,
+	IPv4Address sourceAddress,
+	uint16_t pseudoHeaderChecksum)
+{
+	OnRxPacketCommon(packet, ipPayloadLength, sourceAddress, pseudoHeaderChecksum);
+}
+
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+void UDPProtocol::OnRxPacket(
+	UDPPacket* packet,
+	uint16_t ipPayloadLength,
+	IPv6Address sourceAddress,
+	uint16_t pseudoHeaderChecksum)
+{
+	OnRxPacketCommon(packet, ipPayloadLength, sourceAddress, pseudoHeaderChecksum);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -92,19 +242,84 @@ UDPPacket* UDPProtocol::GetTxPacket(IPv4Address dstip)
 	return reinterpret_cast<UDPPacket*>(reply->Payload());
 }
 
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+UDPv6Packet* UDPProtocol::GetTxPacket(IPv6Address dstip)
+{
+	if(!m_ipv6)
+		return nullptr;
+
+	//Allocate the frame and fail if we couldn't allocate one
+	auto reply = m_ipv6->GetTxPacket(dstip, IP_PROTO_UDP);
+	if(reply == nullptr)
+		return nullptr;
+
+	//All good, return the packet
+	return reinterpret_cast<UDPv6Packet*>(reply->Payload());
+}
+
 void UDPProtocol::CancelTxPacket(UDPPacket* packet)
 {
 	//Cancel the packet in the upper layer
-	m_ipv4->CancelTxPacket(reinterpret_cast<IPv4Packet*>(reinterpret_cast<uint8_t*>(packet) - sizeof(IPv4Packet)));
+	m_ipv4->CancelTxPacket(packet->Parent());
+}
+
+void UDPProtocol::CancelTxPacket(UDPv6Packet* packet)
+{
+	//Cancel the packet in the upper layer
+	m_ipv6->CancelTxPacket(packet->Parent());
+}
+
+/**
+	@brief Calculates the checksum for an outbound packet over IPv4 (already in network byte order)
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+uint16_t UDPProtocol::GetTxChecksum(
+	[[maybe_unused]] IPv4Packet* ipack,
+	[[maybe_unused]] UDPPacket* packet,
+	[[maybe_unused]] uint16_t length)
+{
+	#ifdef HAVE_UDP_V4_CHECKSUM_OFFLOAD
+		return 0x0000;	//will be filled in by hardware, but don't leave uninitialized
+	#else
+		return ~__builtin_bswap16(IPv4Protocol::InternetChecksum(
+			reinterpret_cast<uint8_t*>(packet), length, m_ipv4->PseudoHeaderChecksum(ipack, length)));
+	#endif
+}
+
+/**
+	@brief Calculates the checksum for an outbound packet over IPv6 (already in network byte order)
+
+	The checksum is mandatory for IPv6, so a computed value of zero is sent as 0xffff (RFC 8200 section 8.1).
+ */
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+uint16_t UDPProtocol::GetTxChecksum(IPv6Packet* ipack, UDPPacket* packet, uint16_t length)
+{
+	uint16_t checksum = ~__builtin_bswap16(IPv4Protocol::InternetChecksum(
+		reinterpret_cast<uint8_t*>(packet), length, m_ipv6->PseudoHeaderChecksum(ipack, length)));
+	if(checksum == 0)
+		return 0xffff;
+	return checksum;
 }
 
 /**
 	@brief Does final prep and sends a UDP packet
  */
+template<class PacketType>
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
-void UDPProtocol::SendTxPacket(UDPPacket* packet, uint16_t sport, uint16_t dport, uint16_t payloadLen)
+void UDPProtocol::SendTxPacketCommon(
+	UDPPacket* packet,
+	PacketType* ipack,
+	uint16_t sport,
+	uint16_t dport,
+	uint16_t payloadLen)
 {
 	auto length = payloadLen + 8;
 
@@ -113,27 +328,31 @@ void UDPProtocol::SendTxPacket(UDPPacket* packet, uint16_t sport, uint16_t dport
 	packet->m_destPort = dport;
 	packet->m_len = length;
 
-	//Calculate the pseudoheader checksum
-	auto ipack = packet->Parent();
-	#ifndef HAVE_UDP_V4_CHECKSUM_OFFLOAD
-	auto pseudoHeaderChecksum = m_ipv4->PseudoHeaderChecksum(ipack, length);
-	#endif
-
 	//Zeroize the checksum when computing it
 	packet->m_checksum = 0;
 
 	//Need to be in network byte order before we send
 	packet->ByteSwap();
-
-	#ifdef HAVE_UDP_V4_CHECKSUM_OFFLOAD
-		packet->m_checksum = 0x0000;	//will be filled in by hardware, but don't leave uninitialized
-	#else
-		packet->m_checksum = ~__builtin_bswap16(
-			IPv4Protocol::InternetChecksum(reinterpret_cast<uint8_t*>(packet), length, pseudoHeaderChecksum));
-	#endif
+	packet->m_checksum = GetTxChecksum(ipack, packet, length);
 
 	//Actually send it
-	m_ipv4->SendTxPacket(ipack, length, true);
+	SendTxPacket(ipack, length);
+}
+
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+void UDPProtocol::SendTxPacket(UDPPacket* packet, uint16_t sport, uint16_t dport, uint16_t payloadLen)
+{
+	SendTxPacketCommon(packet, packet->Parent(), sport, dport, payloadLen);
+}
+
+#ifdef HAVE_ITCM
+__attribute__((section(".tcmtext")))
+#endif
+void UDPProtocol::SendTxPacket(UDPv6Packet* packet, uint16_t sport, uint16_t dport, uint16_t payloadLen)
+{
+	SendTxPacketCommon(packet, packet->Parent(), sport, dport, payloadLen);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -153,3 +372,16 @@ void UDPProtocol::OnRxData(
 {
 }
 
+/**
+	@brief Handles incoming packet data from an IPv6 source.
+
+	The default implementation does nothing.
+ */
+void UDPProtocol::OnRxData(
+	[[maybe_unused]] IPv6Address srcip,
+	[[maybe_unused]] uint16_t sport,
+	[[maybe_unused]] uint16_t dport,
+	[[maybe_unused]] uint8_t* payload,
+	[[maybe_unused]] uint16_t payloadLen)
+{
+}
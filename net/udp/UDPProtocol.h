@@ -36,18 +36,82 @@
 #define UDPProtocol_h
 
 #include "../ipv4/IPv4Protocol.h"
+#include "../ipv6/IPv6Protocol.h"
 #include "UDPPacket.h"
+#include "../../util/DropCounters.h"
 
 #define UDP_IPV4_PAYLOAD_MTU (IPV4_PAYLOAD_MTU - 4)
+#define UDP_IPV6_PAYLOAD_MTU (IPV6_PAYLOAD_MTU - 8)
+
+//Default of 8 ports with registered handlers
+#ifndef UDP_MAX_PORT_HANDLERS
+#define UDP_MAX_PORT_HANDLERS 8
+#endif
+
+/**
+	@brief Base class for an application service bound to a UDP port
+
+	The default implementations do nothing, so a service only needs to override the address families it cares about.
+ */
+class UDPPortHandler
+{
+public:
+	virtual void OnRxData(
+		[[maybe_unused]] IPv4Address srcip,
+		[[maybe_unused]] uint16_t sport,
+		[[maybe_unused]] uint16_t dport,
+		[[maybe_unused]] uint8_t* payload,
+		[[maybe_unused]] uint16_t payloadLen)
+	{}
+
+	virtual void OnRxData(
+		[[maybe_unused]] IPv6Address srcip,
+		[[maybe_unused]] uint16_t sport,
+		[[maybe_unused]] uint16_t dport,
+		[[maybe_unused]] uint8_t* payload,
+		[[maybe_unused]] uint16_t payloadLen)
+	{}
+};
+
+/**
+	@brief A single entry in the UDP port table
+ */
+class UDPPortBinding
+{
+public:
+	uint16_t m_port;
+	UDPPortHandler* m_handler;
+};
+
+///@brief Drop reasons for UDPProtocol (see DropCounted)
+struct UDPDropReasons
+{
+	///@brief Reasons for discarding a received packet
+	enum DropReason
+	{
+		DROP_SHORT,			//Too small to hold a UDP header
+		DROP_BAD_CHECKSUM,	//Checksum failed
+		DROP_BAD_LENGTH,	//Length field smaller than the header, or bigger than the IP payload
+		DROP_NO_HANDLER,	//No handler bound to the port and the policy is to drop or reject
+		DROP_REASON_COUNT
+	};
+};
 
 /**
 	@brief UDP protocol driver
+
+	Either address family can be used, or both at once. The family is part of the packet type (UDPPacket for IPv4,
+	UDPv6Packet for IPv6), so each GetTxPacket / SendTxPacket overload compiles down to a direct call into the right
+	IP layer with no per-packet branching.
+
+	Incoming packets are routed by destination port to handlers registered with RegisterPortHandler(). The port table
+	is a sorted array searched by bisection, so dispatch takes at most log2(UDP_MAX_PORT_HANDLERS) compares. Packets to
+	a port with no handler are handled according to SetUnmatchedPortPolicy().
  */
-class UDPProtocol
+class UDPProtocol : public DropCounted<UDPDropReasons>
 {
 public:
-	UDPProtocol(IPv4Protocol* ipv4);
-	//TODO: IPv6 backend
+	UDPProtocol(IPv4Protocol* ipv4, IPv6Protocol* ipv6 = nullptr);
 
 	void OnRxPacket(
 		UDPPacket* packet,
@@ -55,15 +119,38 @@ public:
 		IPv4Address sourceAddress,
 		uint16_t pseudoHeaderChecksum);
 
+	void OnRxPacket(
+		UDPPacket* packet,
+		uint16_t ipPayloadLength,
+		IPv6Address sourceAddress,
+		uint16_t pseudoHeaderChecksum);
+
 	//Called at 1 Hz by the stack to handle protocol-level aging
 	virtual void OnAgingTick()
 	{}
 
+	bool RegisterPortHandler(uint16_t port, UDPPortHandler* handler);
+	void UnregisterPortHandler(uint16_t port);
+	UDPPortHandler* GetPortHandler(uint16_t port);
+
+	///@brief What to do with packets sent to a port with no registered handler
+	enum UnmatchedPortPolicy
+	{
+		UNMATCHED_DELIVER,	//pass to OnRxData() (default)
+		UNMATCHED_DROP,		//drop silently, before verifying the checksum
+		UNMATCHED_REJECT	//drop, and send ICMP port unreachable for unicasts (rate limited by the ICMP layer)
+	};
+
+	void SetUnmatchedPortPolicy(UnmatchedPortPolicy policy)
+	{ m_unmatchedPolicy = policy; }
+
 	///@brief Allocates an outbound packet
 	UDPPacket* GetTxPacket(IPv4Address dstip);
+	UDPv6Packet* GetTxPacket(IPv6Address dstip);
 
 	///@brief Cancels sending of a packet
 	void CancelTxPacket(UDPPacket* packet);
+	void CancelTxPacket(UDPv6Packet* packet);
 
 	/**
 		@brief Sends a UDP packet on a given socket handle
@@ -74,15 +161,64 @@ public:
 		uint16_t dport,
 		uint16_t payloadLength);
 
+	void SendTxPacket(
+		UDPv6Packet* packet,
+		uint16_t sport,
+		uint16_t dport,
+		uint16_t payloadLength);
+
 	IPv4Protocol* GetIPv4()
 	{ return m_ipv4; }
 
+	IPv6Protocol* GetIPv6()
+	{ return m_ipv6; }
+
 protected:
 
+	template<class AddressType>
+	void OnRxPacketCommon(
+		UDPPacket* packet,
+		uint16_t ipPayloadLength,
+		AddressType sourceAddress,
+		uint16_t pseudoHeaderChecksum);
+
+	template<class PacketType>
+	void SendTxPacketCommon(
+		UDPPacket* packet,
+		PacketType* ipack,
+		uint16_t sport,
+		uint16_t dport,
+		uint16_t payloadLength);
+
+	uint16_t GetTxChecksum(IPv4Packet* ipack, UDPPacket* packet, uint16_t length);
+	uint16_t GetTxChecksum(IPv6Packet* ipack, UDPPacket* packet, uint16_t length);
+
+	void SendTxPacket(IPv4Packet* ipack, uint16_t length)
+	{ m_ipv4->SendTxPacket(ipack, length, true); }
+
+	void SendTxPacket(IPv6Packet* ipack, uint16_t length)
+	{ m_ipv6->SendTxPacket(ipack, length, true); }
+
+	void SendPortUnreachable(UDPPacket* packet, IPv4Address sourceAddress);
+	void SendPortUnreachable(UDPPacket* packet, IPv6Address sourceAddress);
+
 	virtual void OnRxData(IPv4Address srcip, uint16_t sport, uint16_t dport, uint8_t* payload, uint16_t payloadLen);
+	virtual void OnRxData(IPv6Address srcip, uint16_t sport, uint16_t dport, uint8_t* payload, uint16_t payloadLen);
 
 	///@brief The IPv4 protocol stack
 	IPv4Protocol* m_ipv4;
+
+	///@brief The IPv6 protocol stack (may be null)
+	IPv6Protocol* m_ipv6;
+
+	///@brief Bound ports, sorted by port number
+	UDPPortBinding m_ports[UDP_MAX_PORT_HANDLERS];
+
+	///@brief Number of valid entries in m_ports
+	uint16_t m_numPorts;
+
+	///@brief What to do with packets for ports not in m_ports
+	UnmatchedPortPolicy m_unmatchedPolicy;
 };
 
 #endif
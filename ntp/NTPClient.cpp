@@ -46,6 +46,7 @@ NTPClient::NTPClient(UDPProtocol* udp)
 	, m_state(STATE_DESYNCED)
 	, m_timeout(0)
 {
+	m_udp->RegisterPortHandler(NTP_PORT, this);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -45,13 +45,21 @@
 
 	For now, only implements SNTP
  */
-class NTPClient
+class NTPClient : public UDPPortHandler
 {
 public:
 	NTPClient(UDPProtocol* udp);
 
 	void OnAgingTick();
-	void OnRxData(IPv4Address srcip, uint16_t sport, uint16_t dport, uint8_t* payload, uint16_t payloadLen);
+
+	//IPv4 only, the IPv6 handler keeps the default (ignore) implementation
+	using UDPPortHandler::OnRxData;
+	virtual void OnRxData(
+		IPv4Address srcip,
+		uint16_t sport,
+		uint16_t dport,
+		uint8_t* payload,
+		uint16_t payloadLen) override;
 
 	void Enable()
 	{ m_enabled = true; }
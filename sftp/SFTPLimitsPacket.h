@@ -48,7 +48,8 @@ public:
 	SFTPLimitsPacket()
 	{
 		m_maxPacketLength = SSH_RX_BUFFER_SIZE;
-		m_maxReadLength = 1024;
+		m_maxReadLength = SSHTransportServer::GetMaxChannelDataLength(TCP_IPV4_PAYLOAD_MTU) -
+			sizeof(SFTPPacket) - sizeof(SFTPDataPacket);
 		m_maxWriteLength = 1024;
 		m_maxOpenHandles = SFTP_MAX_REQUESTS;
 	}
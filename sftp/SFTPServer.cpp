@@ -91,7 +91,7 @@ bool SFTPServer::OnRxData(int id, SFTPConnectionState* state, TCPTableEntry* soc
 		while(IsPacketReady(state))
 		{
 			//If there's no space to send a reply, ignore any incoming messages
-			if(!m_ssh->IsTxBufferAvailable())
+			if(!m_ssh->IsTxBufferAvailable(socket))
 			{
 				//g_log("OnRxData no tx buffer 1\n");
 				state->m_packetPendingTxBuffer = true;
@@ -105,7 +105,7 @@ bool SFTPServer::OnRxData(int id, SFTPConnectionState* state, TCPTableEntry* soc
 		}
 
 		//If there's no space to send a reply, ignore any incoming messages
-		if(!m_ssh->IsTxBufferAvailable())
+		if(!m_ssh->IsTxBufferAvailable(socket))
 		{
 			//g_log("OnRxData no tx buffer 2\n");
 			state->m_packetPendingTxBuffer = true;
@@ -134,6 +134,8 @@ __attribute__((section(".tcmtext")))
 #endif
 void SFTPServer::OnRxPacket(int id, SFTPConnectionState* state, TCPTableEntry* socket, SFTPPacket* pack)
 {
+	TRACE_EVENT(TRACE_SFTP_REQUEST, id, pack->m_type, pack->m_length);
+
 	//See what we got
 	switch(pack->m_type)
 	{
@@ -346,11 +348,17 @@ void SFTPServer::OnRxRead(
 	if(pack->m_handleLength != 4)
 		SendStatusReply(id, socket, pack->m_requestid, SFTPStatusPacket::SSH_FX_BAD_MESSAGE);
 
-	//Read file in blocks of up to 1024 bytes
+	//Read file in blocks of whatever fits in a single TCP segment
 	//NOTE: client may request larger blocks than we are capable of servicing!
 	//That's OK, we'll just send a shorter reply and the client will send additional read requests,
 	//just like POSIX read(2)
-	const uint32_t maxBlockSize = 1024;
+	const uint32_t maxDataLength = m_ssh->GetMaxSessionDataLength(socket);
+	if(maxDataLength <= sizeof(SFTPPacket) + sizeof(SFTPDataPacket))
+	{
+		SendStatusReply(id, socket, pack->m_requestid, SFTPStatusPacket::SSH_FX_FAILURE);
+		return;
+	}
+	const uint32_t maxBlockSize = maxDataLength - sizeof(SFTPPacket) - sizeof(SFTPDataPacket);
 	uint32_t blockLen = std::min(pack->m_len, maxBlockSize);
 
 	//Allocate a reply packet
@@ -503,6 +511,8 @@ void SFTPServer::StartHugePacket(
 	SFTPConnectionState* state,
 	SFTPPacket* header)
 {
+	TRACE_EVENT(TRACE_SFTP_REQUEST, id, header->m_type, header->m_length);
+
 	//For now, only support huge packets of type SSH_FXP_WRITE
 	if(header->m_type != SFTPPacket::SSH_FXP_WRITE)
 	{
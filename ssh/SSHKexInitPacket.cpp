@@ -73,7 +73,7 @@ bool SSHKexInitPacket::NameListContains(uint8_t* start, const char* search, uint
 	//Check each substring in the name list for a match
 	uint32_t targetlen = strlen(search);
 	uint32_t pos = 0;
-	while(pos < (len - targetlen))
+	while(pos + targetlen <= len)
 	{
 		//Bounds check
 		if( ((data+pos) - reinterpret_cast<char*>(this)) > end)
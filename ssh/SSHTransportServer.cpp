@@ -79,7 +79,7 @@ static const char* g_strExec				= "exec";
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 // Construction / destruction
 
-SSHTransportServer::SSHTransportServer(TCPProtocol& tcp)
+SSHTransportServer::SSHTransportServer(TCPProtocolBase& tcp)
 	: TCPServer(tcp)
 	, m_passwordAuth(nullptr)
 	, m_pubkeyAuth(nullptr)
@@ -150,55 +150,74 @@ bool SSHTransportServer::OnRxData(TCPTableEntry* socket, uint8_t* payload, uint1
 	//Look up the connection ID for the incoming session
 	auto id = GetConnectionID(socket);
 	if(id < 0)
-		return true;
-
-	//Push the segment data into our RX FIFO
-	if(!m_state[id].m_rxBuffer.Push(payload, payloadLen))
-	{
-		DropConnection(id, socket);
-		return false;
-	}
-
-	//If waiting for a client banner, special handling needed (not the normal packet format)
-	if(m_state[id].m_state == SSHConnectionState::STATE_BANNER_WAIT)
 	{
-		OnRxBanner(id, socket);
+		CountDrop(DROP_UNKNOWN_CONNECTION);
 		return true;
 	}
 
-	//Everything else uses the normal SSH packet framing.
-	//Process packets (might be several concatenated in a single TCP segment)
-	while(IsPacketReady(m_state[id]))
+	//Coalesced receives can be bigger than the RX FIFO, so push as much as fits and process packets to make room
+	//for the rest. A single segment always fits unless the client overran the FIFO.
+	auto& state = m_state[id];
+	while(payloadLen > 0)
 	{
-		//Figure out what state we're in so we know what to expect
-		switch(m_state[id].m_state)
-		{
-			//never used, just to prevent compiler warnings about unhandled cases
-			case SSHConnectionState::STATE_BANNER_WAIT:
-				break;
+		//Stop if processing the last chunk dropped the connection
+		if(state.m_socket != socket)
+			return true;
 
-			//Setup / key exchange
-			case SSHConnectionState::STATE_BANNER_SENT:
-				OnRxKexInit(id, socket);
-				break;
+		//Push the segment data into our RX FIFO
+		uint16_t chunk = state.m_rxBuffer.WriteSize();
+		if(chunk > payloadLen)
+			chunk = payloadLen;
+		if( (chunk == 0) || !state.m_rxBuffer.Push(payload, chunk))
+		{
+			CountDrop(DROP_RX_FIFO_FULL);
+			DropConnection(id, socket);
+			return false;
+		}
+		payload += chunk;
+		payloadLen -= chunk;
 
-			case SSHConnectionState::STATE_KEX_INIT_SENT:
-				OnRxKexEcdhInit(id, socket);
-				break;
+		//If waiting for a client banner, special handling needed (not the normal packet format)
+		if(state.m_state == SSHConnectionState::STATE_BANNER_WAIT)
+		{
+			OnRxBanner(id, socket);
+			continue;
+		}
 
-			case SSHConnectionState::STATE_KEX_ECDHINIT_SENT:
-				OnRxNewKeys(id, socket);
-				break;
+		//Everything else uses the normal SSH packet framing.
+		//Process packets (might be several concatenated in a single TCP segment)
+		while(IsPacketReady(state))
+		{
+			//Figure out what state we're in so we know what to expect
+			switch(state.m_state)
+			{
+				//never used, just to prevent compiler warnings about unhandled cases
+				case SSHConnectionState::STATE_BANNER_WAIT:
+					break;
+
+				//Setup / key exchange
+				case SSHConnectionState::STATE_BANNER_SENT:
+					OnRxKexInit(id, socket);
+					break;
+
+				case SSHConnectionState::STATE_KEX_INIT_SENT:
+					OnRxKexEcdhInit(id, socket);
+					break;
+
+				case SSHConnectionState::STATE_KEX_ECDHINIT_SENT:
+					OnRxNewKeys(id, socket);
+					break;
+
+				//By the time we get here, we've got encrypted traffic!
+				//Need to decrypt and verify it before doing anything.
+				default:
+					OnRxEncryptedPacket(id, socket);
+					break;
+			}
 
-			//By the time we get here, we've got encrypted traffic!
-			//Need to decrypt and verify it before doing anything.
-			default:
-				OnRxEncryptedPacket(id, socket);
-				break;
+			//Whatever it was, we're done with it. On to the next one.
+			PopPacket(state);
 		}
-
-		//Whatever it was, we're done with it. On to the next one.
-		PopPacket(m_state[id]);
 	}
 
 	return true;
@@ -283,31 +302,60 @@ void SSHTransportServer::DropConnection(int id, TCPTableEntry* socket)
 
 /**
 	@brief Helper for sending session data to the client
+
+	Data is split into as many packets as needed, each filling one TCP segment. Nothing is sent unless the whole
+	payload fits in the socket's send window, segment quota and TX buffers right now, so on failure the caller can
+	simply retry later without duplicating any of the stream.
+
+	@return True if all of the data was sent, false if none of it was
  */
 bool SSHTransportServer::SendSessionData(int id, TCPTableEntry* socket, const char* data, uint16_t length)
 {
 	//abort if we dont have a valid session
 	if(m_state[id].m_sessionChannelID == INVALID_CHANNEL)
 		return false;
+	if(length == 0)
+		return true;
 
-	//max 1280 bytes per packet for now
-	//(this is enough to be comfortably below typical 1500 byte MTUs after header overhead)
-	if(length > 1280)
+	//Figure out how many packets it takes, and how much window they use
+	uint16_t maxLength = GetMaxSessionDataLength(socket);
+	if(maxLength == 0)
 		return false;
-
-	//Send the data
-	auto segment = m_tcp.GetTxSegment(socket);
-	if(!segment)
+	uint32_t count = (length + maxLength - 1) / maxLength;
+	uint16_t lastLength = length - (count - 1) * maxLength;
+	uint32_t wireLength = (count - 1) * GetChannelDataWireLength(maxLength) + GetChannelDataWireLength(lastLength);
+	if( (count > TCP_MAX_UNACKED) || !m_tcp.CanSendBurst(socket, count, wireLength) )
 		return false;
 
-	auto reply = reinterpret_cast<SSHTransportPacket*>(segment->Payload());
-	reply->m_type = SSHTransportPacket::SSH_MSG_CHANNEL_DATA;
-	auto dat = reinterpret_cast<SSHChannelDataPacket*>(reply->Payload());
-	dat->m_clientChannel = m_state[id].m_sessionChannelID;
-	dat->m_dataLength = length;
-	memcpy(dat->Payload(), data, length);
-	dat->ByteSwap();
-	SendEncryptedPacket(id, sizeof(SSHChannelDataPacket) + length, segment, reply, socket);
+	//Grab all of the segments up front, so running out of TX buffers can't leave us with a partial send
+	TCPSegment* segments[TCP_MAX_UNACKED];
+	for(uint32_t i=0; i<count; i++)
+	{
+		segments[i] = m_tcp.GetTxSegment(socket);
+		if(!segments[i])
+		{
+			for(uint32_t j=0; j<i; j++)
+				m_tcp.CancelTxSegment(segments[j], socket);
+			return false;
+		}
+	}
+
+	for(uint32_t i=0; i<count; i++)
+	{
+		uint16_t chunk = std::min(length, maxLength);
+
+		auto reply = reinterpret_cast<SSHTransportPacket*>(segments[i]->Payload());
+		reply->m_type = SSHTransportPacket::SSH_MSG_CHANNEL_DATA;
+		auto dat = reinterpret_cast<SSHChannelDataPacket*>(reply->Payload());
+		dat->m_clientChannel = m_state[id].m_sessionChannelID;
+		dat->m_dataLength = chunk;
+		memcpy(dat->Payload(), data, chunk);
+		dat->ByteSwap();
+		SendEncryptedPacket(id, sizeof(SSHChannelDataPacket) + chunk, segments[i], reply, socket);
+
+		data += chunk;
+		length -= chunk;
+	}
 
 	return true;
 }
@@ -340,16 +388,16 @@ SSHTransportPacket* SSHTransportServer::AllocateReply(int id, TCPTableEntry* soc
 /**
 	@brief Sends a reply packet allocated by AllocateReply().
 
-	In between, the caller must fill the packet payload in with a valid SSHChannelDataPacket
+	In between, the caller must fill the packet payload in with a valid SSHChannelDataPacket no longer than
+	GetMaxSessionDataLength().
  */
 #ifdef HAVE_ITCM
 __attribute__((section(".tcmtext")))
 #endif
 void SSHTransportServer::SendReply(int id, TCPTableEntry* socket, TCPSegment* segment, SSHTransportPacket* pack, uint16_t length)
 {
-	//max 1280 bytes per packet for now
-	//(this is enough to be comfortably below typical 1500 byte MTUs after header overhead)
-	if(length > 1280)
+	//Has to fit in a single segment
+	if(length > GetMaxSessionDataLength(socket))
 	{
 		m_tcp.CancelTxSegment(segment, socket);
 		return;
@@ -769,9 +817,12 @@ void SSHTransportServer::OnRxEncryptedPacket(int id, TCPTableEntry* socket)
 	//If verification failure, drop the connection and exit
 	if(!m_state[id].m_crypto->DecryptAndVerify(&pack->m_paddingLength, pack->m_packetLength + GCM_TAG_SIZE))
 	{
+		CountDrop(DROP_BAD_MAC);
 		DropConnection(id, socket);
 		return;
 	}
+	LATENCY_MARK(STAGE_SSH_DECRYPT);
+	TRACE_EVENT(TRACE_SSH_PACKET_DECRYPTED, id, pack->m_type, pack->m_packetLength);
 
 	//Sanity check padding length
 	if(pack->m_paddingLength > pack->m_packetLength)
@@ -1540,6 +1591,7 @@ void SSHTransportServer::OnRxChannelData(int id, TCPTableEntry* socket, SSHTrans
 	//Pass to the appropriate subsystem
 	if(dpack->m_clientChannel == m_state[id].m_sessionChannelID)
 	{
+		LATENCY_MARK(STAGE_APP);
 		switch(m_state[id].m_channelType)
 		{
 			//shell session
@@ -36,10 +36,34 @@
 
 #include "../crypt/CryptoEngine.h"
 #include "../util/CircularFIFO.h"
+#include "../util/DropCounters.h"
 #include "SSHPasswordAuthenticator.h"
 #include "SSHPubkeyAuthenticator.h"
 #include "../net/tcp/TCPServer.h"
 #include "../sftp/SFTPServer.h"
+#include "SSHChannelDataPacket.h"
+
+//Firmware with a single crypto engine class can name it in staticnet-config.h (it must be final), so the per-packet
+//EncryptAndMAC / DecryptAndVerify calls are bound statically instead of going through the CryptoEngine vtable:
+//	#define STATICNET_CRYPTO_ENGINE			BoardCryptoEngine
+//	#define STATICNET_CRYPTO_ENGINE_HEADER	"BoardCryptoEngine.h"
+#ifdef STATICNET_CRYPTO_ENGINE
+
+#include <type_traits>
+#include STATICNET_CRYPTO_ENGINE_HEADER
+
+typedef STATICNET_CRYPTO_ENGINE SSHCryptoEngine;
+
+static_assert(std::is_base_of<CryptoEngine, SSHCryptoEngine>::value,
+	"STATICNET_CRYPTO_ENGINE must be derived from CryptoEngine");
+static_assert(std::is_final<SSHCryptoEngine>::value,
+	"STATICNET_CRYPTO_ENGINE must be declared final for calls to it to be bound statically");
+
+#else
+
+typedef CryptoEngine SSHCryptoEngine;
+
+#endif
 
 class SSHTransportPacket;
 class SSHKexInitPacket;
@@ -137,7 +161,7 @@ public:
 	} m_channelType;
 
 	///@brief The crypto engine containing key material for this session
-	CryptoEngine* m_crypto;
+	SSHCryptoEngine* m_crypto;
 
 	///@brief Packet reassembly buffer (may span multiple TCP segments)
 	CircularFIFO<SSH_RX_BUFFER_SIZE> m_rxBuffer;
@@ -164,18 +188,33 @@ public:
 	SFTPConnectionState* m_sftpState;
 };
 
+///@brief Drop reasons for SSHTransportServer (see DropCounted)
+struct SSHTransportDropReasons
+{
+	///@brief Reasons for discarding a received segment
+	enum DropReason
+	{
+		DROP_UNKNOWN_CONNECTION,	//Data for a socket with no SSH session
+		DROP_RX_FIFO_FULL,			//Client overran the receive FIFO (drops the connection)
+		DROP_BAD_MAC,				//Encrypted packet failed authentication (drops the connection)
+		DROP_REASON_COUNT
+	};
+};
+
 /**
 	@brief Server for the SSH transport layer (RFC 4253)
 
 	Derived classes must initialize crypto engines in the constructor.
  */
-class SSHTransportServer : public TCPServer<SSH_TABLE_SIZE, SSHConnectionState>
+class SSHTransportServer
+	: public TCPServer<SSH_TABLE_SIZE, SSHConnectionState>
+	, public DropCounted<SSHTransportDropReasons>
 {
 public:
-	SSHTransportServer(TCPProtocol& tcp);
+	SSHTransportServer(TCPProtocolBase& tcp);
 
-	bool IsTxBufferAvailable()
-	{ return m_tcp.IsTxBufferAvailable(); }
+	bool IsTxBufferAvailable(TCPTableEntry* socket)
+	{ return m_tcp.IsTxBufferAvailable(socket); }
 
 	//Event handlers
 	virtual void OnConnectionAccepted(TCPTableEntry* socket) override;
@@ -192,6 +231,31 @@ public:
 
 	bool SendSessionData(int id, TCPTableEntry* socket, const char* data, uint16_t length);
 
+	/**
+		@brief Gets the largest amount of channel data that fits in one encrypted packet in a TCP segment of the
+		given size
+
+		The packet is the length field, then padding length and type bytes, the SSHChannelDataPacket header, the
+		data, and at least 4 bytes of padding, rounded up to a multiple of the cipher block size, then the MAC.
+
+		Returns 0 if the segment is too small to hold any data at all.
+	 */
+	static constexpr uint16_t GetMaxChannelDataLength(uint16_t mss)
+	{
+		return (mss < GetChannelDataWireLength(1)) ?
+			0 : ( (mss - sizeof(uint32_t) - GCM_TAG_SIZE) & ~15 ) - 2 - sizeof(SSHChannelDataPacket) - 4;
+	}
+
+	///@brief Gets the size on the wire of an encrypted packet carrying the given amount of channel data
+	static constexpr uint32_t GetChannelDataWireLength(uint16_t dataLength)
+	{
+		return sizeof(uint32_t) + ( (2 + sizeof(SSHChannelDataPacket) + dataLength + 4 + 15) & ~15 ) + GCM_TAG_SIZE;
+	}
+
+	///@brief Gets the largest amount of channel data that fits in one packet on a given socket
+	uint16_t GetMaxSessionDataLength(TCPTableEntry* socket)
+	{ return GetMaxChannelDataLength(m_tcp.GetMaxSegmentSize(socket)); }
+
 	SSHTransportPacket* AllocateReply(int id, TCPTableEntry* socket, TCPSegment*& segment);
 
 	void CancelReply(TCPTableEntry* socket, TCPSegment* segment)
@@ -232,6 +296,37 @@ public:
 
 	virtual void GracefulDisconnect(int id, TCPTableEntry* socket) override;
 
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Performance counters
+
+#ifdef STATICNET_PERFORMANCE_COUNTERS
+
+	///@brief Gets the most data any connection's SSH packet reassembly buffer has held
+	uint16_t GetRxBufferHighWatermark()
+	{
+		uint16_t ret = 0;
+		for(auto& state : m_state)
+		{
+			if(state.m_rxBuffer.GetHighWatermark() > ret)
+				ret = state.m_rxBuffer.GetHighWatermark();
+		}
+		return ret;
+	}
+
+	///@brief Gets the most data any connection's SFTP packet reassembly buffer has held
+	uint16_t GetSFTPRxBufferHighWatermark()
+	{
+		uint16_t ret = 0;
+		for(auto& state : m_state)
+		{
+			if(state.m_sftpState && (state.m_sftpState->m_rxBuffer.GetHighWatermark() > ret) )
+				ret = state.m_sftpState->m_rxBuffer.GetHighWatermark();
+		}
+		return ret;
+	}
+
+#endif
+
 protected:
 	void OnRxBanner(int id, TCPTableEntry* socket);
 	void OnRxKexInit(int id, TCPTableEntry* socket);
@@ -0,0 +1,210 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+/**
+	@file
+	@brief Compile-time accounting of the stack's static RAM
+
+	All of staticnet's memory is allocated statically, sized by the macros in staticnet-config.h. MemoryBudget adds up
+	sizeof() of every object in a typical deployment, so the totals always match what the compiler will actually
+	allocate for the current configuration (including padding and performance counters).
+
+	Include this from one source file in the application, after staticnet.h and the headers for any optional
+	subsystems in use (drivers, SSH, SFTP, CLI). Subsystems whose headers haven't been included count as zero.
+
+	Options (set in staticnet-config.h or on the command line):
+		STATICNET_RAM_BUDGET		Fail the build if the total exceeds this many bytes
+		STATICNET_MEMORY_REPORT		Print the per-subsystem breakdown as a compiler warning
+
+	The accounting assumes one instance of each protocol at the default sizes (ARPCache, NDPCache, TCPProtocol), and
+	one CryptoEngine, SFTPConnectionState and SSHOutputStream per entry in the SSH connection table. Additional
+	stacks built from SizedARPCache etc, and objects owned by the application itself (filesystem caches, CLI context,
+	etc) aren't included.
+ */
+
+#ifndef MemoryBudget_h
+#define MemoryBudget_h
+
+#include "staticnet.h"
+
+/**
+	@brief Static RAM used by each subsystem of the stack, in bytes
+ */
+class MemoryBudget
+{
+public:
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Individual subsystems
+
+	///@brief Ethernet driver, including DMA descriptors and frame buffers
+	static constexpr size_t GetDriverBytes()
+	{
+		size_t ret = 0;
+		#ifdef STM32EthernetInterface_h
+			ret += sizeof(STM32EthernetInterface);
+		#endif
+		#ifdef APBEthernetInterface_h
+			ret += sizeof(APBEthernetInterface);
+		#endif
+		return ret;
+	}
+
+	///@brief Layer 2/3 protocol handlers without large tables of their own
+	static constexpr size_t GetProtocolBytes()
+	{
+		return
+			sizeof(EthernetProtocol) +
+			sizeof(ARPProtocol) +
+			sizeof(IPv4Protocol) +
+			sizeof(ICMPv4Protocol) +
+			sizeof(IPv6Protocol) +
+			sizeof(ICMPv6Protocol) +
+			sizeof(UDPProtocol);
+	}
+
+	///@brief ARP cache (ARP_CACHE_WAYS x ARP_CACHE_LINES)
+	static constexpr size_t GetARPBytes()
+	{ return sizeof(ARPCache); }
+
+	///@brief NDP cache (NDP_CACHE_WAYS x NDP_CACHE_LINES)
+	static constexpr size_t GetNDPBytes()
+	{ return sizeof(NDPCache); }
+
+	///@brief TCP socket table, segment pool, TIME-WAIT table and GRO buffer
+	static constexpr size_t GetTCPBytes()
+	{ return sizeof(TCPProtocol); }
+
+	///@brief SSH connection table (SSH_TABLE_SIZE x SSH_RX_BUFFER_SIZE etc) plus one crypto engine per connection
+	static constexpr size_t GetSSHBytes()
+	{
+		#ifdef SSHTransportServer_h
+			#if defined(STATICNET_CRYPTO_ENGINE)
+				return sizeof(SSHTransportServer) + SSH_TABLE_SIZE*sizeof(SSHCryptoEngine);
+			#elif defined(STM32CryptoEngine_h)
+				return sizeof(SSHTransportServer) + SSH_TABLE_SIZE*sizeof(STM32CryptoEngine);
+			#else
+				return sizeof(SSHTransportServer) + SSH_TABLE_SIZE*sizeof(CryptoEngine);
+			#endif
+		#else
+			return 0;
+		#endif
+	}
+
+	///@brief SFTP connection state (SSH_TABLE_SIZE x SFTP_RX_BUFFER_SIZE)
+	static constexpr size_t GetSFTPBytes()
+	{
+		#ifdef SFTPServer_h
+			return SSH_TABLE_SIZE * sizeof(SFTPConnectionState);
+		#else
+			return 0;
+		#endif
+	}
+
+	///@brief CLI output streams (SSH_TABLE_SIZE x CLI_TX_BUFFER_SIZE)
+	static constexpr size_t GetCLIBytes()
+	{
+		#ifdef SSHOutputStream_h
+			return SSH_TABLE_SIZE * sizeof(SSHOutputStream);
+		#else
+			return 0;
+		#endif
+	}
+
+	///@brief Trace buffer and latency histograms, if enabled
+	static constexpr size_t GetDiagnosticBytes()
+	{
+		size_t ret = 0;
+		#ifdef STATICNET_TRACE
+			ret += sizeof(TraceBuffer);
+		#endif
+		#ifdef STATICNET_LATENCY_PROFILING
+			ret += sizeof(LatencyProfiler);
+		#endif
+		return ret;
+	}
+
+	////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+	// Totals
+
+	static constexpr size_t GetTotalBytes()
+	{
+		return
+			GetDriverBytes() +
+			GetProtocolBytes() +
+			GetARPBytes() +
+			GetNDPBytes() +
+			GetTCPBytes() +
+			GetSSHBytes() +
+			GetSFTPBytes() +
+			GetCLIBytes() +
+			GetDiagnosticBytes();
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Build-time report
+
+#ifdef STATICNET_MEMORY_REPORT
+
+/**
+	@brief Does nothing; exists only so the compiler prints the template arguments in a diagnostic
+
+	There is no portable way to print a constexpr value at compile time, but GCC includes the template arguments of a
+	deprecated function in the warning when it's called.
+ */
+template<size_t driver, size_t protocols, size_t arp, size_t ndp, size_t tcp, size_t ssh, size_t sftp, size_t cli,
+	size_t diagnostics, size_t total>
+[[deprecated("staticnet memory report, sizes in bytes (this is not an error)")]]
+constexpr bool MemoryBudgetReport()
+{ return true; }
+
+static_assert(MemoryBudgetReport<
+	MemoryBudget::GetDriverBytes(),
+	MemoryBudget::GetProtocolBytes(),
+	MemoryBudget::GetARPBytes(),
+	MemoryBudget::GetNDPBytes(),
+	MemoryBudget::GetTCPBytes(),
+	MemoryBudget::GetSSHBytes(),
+	MemoryBudget::GetSFTPBytes(),
+	MemoryBudget::GetCLIBytes(),
+	MemoryBudget::GetDiagnosticBytes(),
+	MemoryBudget::GetTotalBytes()>());
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// Budget enforcement
+
+#ifdef STATICNET_RAM_BUDGET
+static_assert(MemoryBudget::GetTotalBytes() <= STATICNET_RAM_BUDGET,
+	"staticnet static RAM exceeds STATICNET_RAM_BUDGET (build with STATICNET_MEMORY_REPORT for a breakdown)");
+#endif
+
+#endif
@@ -47,18 +47,19 @@
 #include <stdint.h>
 #include <memory.h>
 
+#include "../util/Hash.h"
+#include "../util/TraceBuffer.h"
+
 #include "../drivers/base/EthernetInterface.h"
 #include "../net/ethernet/EthernetProtocol.h"
 #include "../net/arp/ARPProtocol.h"
 #include "../net/ipv4/IPv4Protocol.h"
+#include "../net/icmpv6/NDPCache.h"
 #include "../net/ipv6/IPv6Protocol.h"
 #include "../net/icmpv4/ICMPv4Protocol.h"
 #include "../net/icmpv6/ICMPv6Protocol.h"
 #include "../net/tcp/TCPProtocol.h"
+#include "../net/tcp/TCPServer.h"
 #include "../net/udp/UDPProtocol.h"
 
-//Constants used for FNV hash
-#define FNV_INITIAL	0x811c9dc5
-#define FNV_MULT	0x01000193
-
 #endif
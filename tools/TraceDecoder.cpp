@@ -0,0 +1,215 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Host-side decoder for TraceBuffer dumps
+
+	Usage: staticnet-tracedecode dump.bin [cycles per microsecond]
+
+	The input is the raw contents of g_trace from a little endian target, for example from gdb:
+
+		dump binary value trace.bin g_trace
+
+	Entries are printed oldest first. Timestamps are shown relative to the first entry and as deltas from the previous
+	one, in cycles, or in microseconds if the clock rate is given.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define STATICNET_TRACE
+#include "../util/TraceBuffer.h"
+
+///@brief Size of the header fields ahead of the entry array in TraceBuffer
+#define TRACE_HEADER_SIZE 12
+
+static const char* GetEventName(uint8_t event)
+{
+	switch(event)
+	{
+		case TRACE_TCP_SEGMENT_SENT:		return "tcp-tx";
+		case TRACE_TCP_SEGMENT_RECEIVED:	return "tcp-rx";
+		case TRACE_TCP_RETRANSMIT:			return "tcp-retransmit";
+		case TRACE_TCP_DUP_ACK:				return "tcp-dup-ack";
+		case TRACE_SSH_PACKET_DECRYPTED:	return "ssh-decrypted";
+		case TRACE_SFTP_REQUEST:			return "sftp-request";
+		case TRACE_FRAME_ALLOC_FAIL:		return "frame-alloc-fail";
+		default:							return "unknown";
+	}
+}
+
+///@brief Formats TCP flags as e.g. "SA" for SYN+ACK
+static void FormatTCPFlags(char* buf, uint32_t flags)
+{
+	static const char names[] = "FSRPA";
+	for(int i=0; i<5; i++)
+	{
+		if(flags & (1 << i))
+			*buf++ = names[i];
+	}
+	*buf = '\0';
+}
+
+static void PrintArgs(const TraceEntry& e)
+{
+	char flags[8];
+	switch(e.m_event)
+	{
+		case TRACE_TCP_SEGMENT_SENT:
+		case TRACE_TCP_SEGMENT_RECEIVED:
+			FormatTCPFlags(flags, e.m_arg1 >> 16);
+			printf("port=%-5u seq=%10u len=%-5u flags=%s", e.m_id, e.m_arg0, e.m_arg1 & 0xffff, flags);
+			break;
+
+		case TRACE_TCP_RETRANSMIT:
+			printf("port=%-5u seq=%10u len=%u", e.m_id, e.m_arg0, e.m_arg1);
+			break;
+
+		case TRACE_TCP_DUP_ACK:
+			printf("port=%-5u ack=%10u win=%u", e.m_id, e.m_arg0, e.m_arg1);
+			break;
+
+		case TRACE_SSH_PACKET_DECRYPTED:
+		case TRACE_SFTP_REQUEST:
+			printf("conn=%-5u type=%-3u len=%u", e.m_id, e.m_arg0, e.m_arg1);
+			break;
+
+		case TRACE_FRAME_ALLOC_FAIL:
+			printf("ethertype=0x%04x", e.m_id);
+			break;
+
+		default:
+			printf("id=%u arg0=0x%08x arg1=0x%08x", e.m_id, e.m_arg0, e.m_arg1);
+			break;
+	}
+}
+
+static void PrintTime(uint32_t cycles, double cyclesPerUs)
+{
+	if(cyclesPerUs > 0)
+		printf("%14.3f", cycles / cyclesPerUs);
+	else
+		printf("%14u", cycles);
+}
+
+int main(int argc, char* argv[])
+{
+	if( (argc < 2) || (argc > 3) )
+	{
+		fprintf(stderr, "Usage: %s dump.bin [cycles per microsecond]\n", argv[0]);
+		return 1;
+	}
+	double cyclesPerUs = 0;
+	if(argc == 3)
+		cyclesPerUs = atof(argv[2]);
+
+	//Read the whole dump
+	FILE* fp = fopen(argv[1], "rb");
+	if(!fp)
+	{
+		perror(argv[1]);
+		return 1;
+	}
+	std::vector<uint8_t> dump;
+	uint8_t buf[4096];
+	size_t len;
+	while( (len = fread(buf, 1, sizeof(buf), fp)) > 0)
+		dump.insert(dump.end(), buf, buf + len);
+	fclose(fp);
+
+	//Validate the header
+	if(dump.size() < TRACE_HEADER_SIZE)
+	{
+		fprintf(stderr, "Dump too short for a trace header\n");
+		return 1;
+	}
+	uint32_t magic;
+	uint16_t size;
+	uint16_t entrySize;
+	uint32_t head;
+	memcpy(&magic, &dump[0], sizeof(magic));
+	memcpy(&size, &dump[4], sizeof(size));
+	memcpy(&entrySize, &dump[6], sizeof(entrySize));
+	memcpy(&head, &dump[8], sizeof(head));
+	if(magic != TRACE_MAGIC)
+	{
+		fprintf(stderr, "Bad magic number 0x%08x (not a trace dump, or from a big endian target?)\n", magic);
+		return 1;
+	}
+	if( (size == 0) || ( (size & (size - 1)) != 0) || (entrySize < sizeof(TraceEntry)) )
+	{
+		fprintf(stderr, "Bad header (%u entries of %u bytes)\n", size, entrySize);
+		return 1;
+	}
+	if(dump.size() < TRACE_HEADER_SIZE + static_cast<size_t>(size) * entrySize)
+	{
+		fprintf(stderr, "Dump truncated (expected %u entries of %u bytes)\n", size, entrySize);
+		return 1;
+	}
+
+	//If the ring has wrapped, the oldest entry is the one about to be overwritten
+	uint32_t count = (head < size) ? head : size;
+	uint32_t first = head - count;
+	printf("%u events logged, showing last %u\n", head, count);
+	printf("%14s %14s  %-18s %s\n", "time", "delta", "event", "details");
+
+	bool haveBase = false;
+	uint32_t base = 0;
+	uint32_t prev = 0;
+	for(uint32_t i=0; i<count; i++)
+	{
+		TraceEntry e;
+		memcpy(&e, &dump[TRACE_HEADER_SIZE + ((first + i) & (size - 1)) * entrySize], sizeof(e));
+		if(e.m_event == TRACE_NONE)
+			continue;
+
+		if(!haveBase)
+		{
+			base = e.m_timestamp;
+			prev = e.m_timestamp;
+			haveBase = true;
+		}
+
+		PrintTime(e.m_timestamp - base, cyclesPerUs);
+		printf(" ");
+		PrintTime(e.m_timestamp - prev, cyclesPerUs);
+		printf("  %-18s ", GetEventName(e.m_event));
+		PrintArgs(e);
+		printf("\n");
+
+		prev = e.m_timestamp;
+	}
+
+	return 0;
+}
@@ -43,6 +43,9 @@
 	Pointers are 16 bit to reduce the memory footprint. One extra bit is required to distinguish between
 	empty and full positions so the maximum legal value for SIZE is 2^15-1.
 
+	If STATICNET_PERFORMANCE_COUNTERS is defined, the FIFO also tracks the most data it has ever held and how many
+	pushes failed for lack of space. These survive Reset() so they cover every connection that has used the buffer.
+
 	This class has no interlocks and is not thread/interrupt safe without external locks.
  */
 template<uint16_t SIZE>
@@ -50,7 +53,13 @@ class CircularFIFO
 {
 public:
 	CircularFIFO()
-	{ Reset(); }
+	{
+		Reset();
+
+		#ifdef STATICNET_PERFORMANCE_COUNTERS
+			ResetStatistics();
+		#endif
+	}
 
 	/**
 		@brief Clears the FIFO to an empty state
@@ -81,7 +90,12 @@ public:
 	bool Push(const uint8_t* data, uint16_t len)
 	{
 		if(len > WriteSize())
+		{
+			#ifdef STATICNET_PERFORMANCE_COUNTERS
+				m_overflows ++;
+			#endif
 			return false;
+		}
 
 		//fast path
 		if( (m_writePtr + len) < SIZE)
@@ -96,6 +110,10 @@ public:
 			for(uint16_t i=0; i<len; i++)
 				Push(data[i]);
 		}
+
+		#ifdef STATICNET_PERFORMANCE_COUNTERS
+			UpdateHighWatermark();
+		#endif
 		return true;
 	}
 
@@ -107,10 +125,19 @@ public:
 	bool Push(uint8_t c)
 	{
 		if(WriteSize() == 0)
+		{
+			#ifdef STATICNET_PERFORMANCE_COUNTERS
+				m_overflows ++;
+			#endif
 			return false;
+		}
 
 		m_data[m_writePtr % SIZE] = c;
 		m_writePtr = IncrementPointer(m_writePtr);
+
+		#ifdef STATICNET_PERFORMANCE_COUNTERS
+			UpdateHighWatermark();
+		#endif
 		return true;
 	}
 
@@ -196,8 +223,50 @@ public:
 		return m_data;
 	}
 
+#ifdef STATICNET_PERFORMANCE_COUNTERS
+
+	/**
+		@brief Returns the largest number of bytes the FIFO has held at once
+	 */
+	uint16_t GetHighWatermark() const
+	{ return m_highWatermark; }
+
+	/**
+		@brief Returns the number of pushes which were rejected because the FIFO was too full
+	 */
+	uint32_t GetOverflowCount() const
+	{ return m_overflows; }
+
+	/**
+		@brief Clears the high watermark and overflow count
+	 */
+	void ResetStatistics()
+	{
+		m_highWatermark = 0;
+		m_overflows = 0;
+	}
+
+#endif
+
 protected:
 
+#ifdef STATICNET_PERFORMANCE_COUNTERS
+
+	void UpdateHighWatermark()
+	{
+		uint16_t used = ReadSize();
+		if(used > m_highWatermark)
+			m_highWatermark = used;
+	}
+
+	///@brief Largest number of bytes the FIFO has held at once
+	uint16_t m_highWatermark;
+
+	///@brief Number of pushes rejected for lack of space
+	uint32_t m_overflows;
+
+#endif
+
 	/**
 		@brief Increments a pointer mod our pointer size
 	 */
@@ -0,0 +1,78 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Free running cycle counter used for profiling and tracing
+ */
+#ifndef CycleCounter_h
+#define CycleCounter_h
+
+#include <stdint.h>
+
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__) || defined(__ARM_ARCH_8M_MAIN__)
+#define HAVE_DWT_CYCCNT
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/**
+	@brief Turns on the cycle counter, if it needs turning on (unlocking the DWT first, needed on Cortex-M7)
+ */
+inline void EnableCycleCounter()
+{
+	#ifdef HAVE_DWT_CYCCNT
+		*reinterpret_cast<volatile uint32_t*>(0xe000edfc) |= (1 << 24);
+		*reinterpret_cast<volatile uint32_t*>(0xe0001fb0) = 0xc5acce55;
+		*reinterpret_cast<volatile uint32_t*>(0xe0001000) |= 1;
+	#endif
+}
+
+/**
+	@brief Reads a free running cycle counter (wraps at 32 bits)
+
+	DWT CYCCNT on Cortex-M, the TSC on x86, and nanoseconds from the monotonic clock anywhere else.
+ */
+inline uint32_t GetCycleCount()
+{
+	#ifdef HAVE_DWT_CYCCNT
+		return *reinterpret_cast<volatile uint32_t*>(0xe0001004);
+	#elif defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+	#else
+		timespec ts;
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+		return ts.tv_sec * 1000000000 + ts.tv_nsec;
+	#endif
+}
+
+#endif
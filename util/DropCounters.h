@@ -0,0 +1,122 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Declaration of DropCounters and DropCounted
+ */
+#ifndef DropCounters_h
+#define DropCounters_h
+
+#include <stdint.h>
+
+#ifdef STATICNET_PERFORMANCE_COUNTERS
+
+/**
+	@brief Number of received packets a protocol layer discarded, broken down by reason
+
+	Counters wrap silently.
+ */
+template<int NUM_REASONS>
+class DropCounters
+{
+public:
+	DropCounters()
+	{ Clear(); }
+
+	void Clear()
+	{
+		for(auto& c : m_counts)
+			c = 0;
+	}
+
+	void Increment(int reason)
+	{ m_counts[reason] ++; }
+
+	///@brief Gets the number of packets dropped for a given reason
+	uint32_t Get(int reason) const
+	{ return m_counts[reason]; }
+
+	///@brief Gets the number of packets dropped for any reason
+	uint32_t GetTotal() const
+	{
+		uint32_t total = 0;
+		for(auto c : m_counts)
+			total += c;
+		return total;
+	}
+
+protected:
+	uint32_t m_counts[NUM_REASONS];
+};
+
+#endif
+
+/**
+	@brief Mixin giving a protocol layer a set of per-reason drop counters
+
+	Reasons is a small struct holding the layer's DropReason enum, which must end in DROP_REASON_COUNT. The layer
+	derives from DropCounted<Reasons> (which makes the DROP_* names visible in its own scope) and calls CountDrop() on
+	every early return in its receive path.
+
+	If STATICNET_PERFORMANCE_COUNTERS is not defined, CountDrop() is a no-op and the mixin takes no space.
+ */
+template<class Reasons>
+class DropCounted : public Reasons
+{
+public:
+
+#ifdef STATICNET_PERFORMANCE_COUNTERS
+
+	///@brief Gets the number of received packets dropped for each reason
+	const DropCounters<Reasons::DROP_REASON_COUNT>& GetDropCounters()
+	{ return m_dropCounters; }
+
+#endif
+
+protected:
+
+	///@brief Counts a dropped packet
+	void CountDrop([[maybe_unused]] typename Reasons::DropReason reason)
+	{
+		#ifdef STATICNET_PERFORMANCE_COUNTERS
+			m_dropCounters.Increment(reason);
+		#endif
+	}
+
+#ifdef STATICNET_PERFORMANCE_COUNTERS
+
+	///@brief Received packets dropped, by reason
+	DropCounters<Reasons::DROP_REASON_COUNT> m_dropCounters;
+
+#endif
+};
+
+#endif
@@ -0,0 +1,75 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Word-at-a-time hashing helpers for the socket table and address caches
+ */
+#ifndef Hash_h
+#define Hash_h
+
+#include <stdint.h>
+#include <string.h>
+
+//Odd constant close to 2^32 / golden ratio, used as the multiplier for multiply-shift hashing
+#define HASH_MULT	0x9e3779b1
+
+/**
+	@brief Mixes one 32-bit word into a running hash
+
+	One multiply per word (vs one per byte for FNV-1). The xor-shift folds the well mixed high half back down so the
+	next word's low bits interact with everything that came before.
+ */
+inline uint32_t HashWord(uint32_t hash, uint32_t word)
+{
+	hash = (hash ^ word) * HASH_MULT;
+	return hash ^ (hash >> 16);
+}
+
+/**
+	@brief Loads a 32-bit word from a possibly unaligned byte array (native byte order)
+ */
+inline uint32_t HashLoad(const uint8_t* p)
+{
+	uint32_t word;
+	memcpy(&word, p, sizeof(word));
+	return word;
+}
+
+/**
+	@brief Reduces a hash to an index in [0, size)
+
+	Takes the high bits of hash * size rather than hash % size. This needs no divide, and for the usual power-of-two
+	sizes is just a shift, taking the top bits of the hash (which are the best mixed for multiply-shift hashing).
+ */
+inline uint32_t HashToIndex(uint32_t hash, uint32_t size)
+{ return (static_cast<uint64_t>(hash) * size) >> 32; }
+
+#endif
@@ -0,0 +1,186 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Declaration of LatencyProfiler and LatencyHistogram
+ */
+#ifndef LatencyProfiler_h
+#define LatencyProfiler_h
+
+/*
+	Latency profiling is compiled out unless STATICNET_LATENCY_PROFILING is defined in staticnet-config.h. If it is,
+	the application must provide the profiler instance:
+
+		LatencyProfiler g_latencyProfiler;
+
+	Each received frame is timestamped when the driver hands it to the stack (or on entry to EthernetProtocol if the
+	driver doesn't), and the elapsed time since then is logged each time the frame reaches another layer. So a stage's
+	histogram shows how long after arrival processing got that far, and the difference between two stages is the cost
+	of everything in between.
+ */
+#ifdef STATICNET_LATENCY_PROFILING
+
+#include "CycleCounter.h"
+
+/**
+	@brief Histogram of latencies with power-of-two bucket sizes
+
+	Bucket 0 counts zero-cycle samples, bucket N counts samples from 2^(N-1) to 2^N - 1 cycles.
+ */
+class LatencyHistogram
+{
+public:
+	LatencyHistogram()
+	{ Clear(); }
+
+	void Clear()
+	{
+		for(auto& b : m_buckets)
+			b = 0;
+		m_count = 0;
+		m_max = 0;
+	}
+
+	void Add(uint32_t cycles)
+	{
+		m_buckets[cycles ? (32 - __builtin_clz(cycles)) : 0] ++;
+		m_count ++;
+		if(cycles > m_max)
+			m_max = cycles;
+	}
+
+	///@brief Number of samples in each bucket
+	uint32_t m_buckets[33];
+
+	///@brief Total number of samples
+	uint32_t m_count;
+
+	///@brief Largest sample seen
+	uint32_t m_max;
+};
+
+/**
+	@brief Per-stage latency histograms for the receive path
+
+	This class has no interlocks and is not thread/interrupt safe without external locks.
+ */
+class LatencyProfiler
+{
+public:
+	enum Stage
+	{
+		STAGE_ETHERNET,		//EthernetProtocol::OnRxFrame()
+		STAGE_IPV4,			//IPv4Protocol::OnRxPacket()
+		STAGE_IPV6,			//IPv6Protocol::OnRxPacket()
+		STAGE_TCP,			//TCPProtocol::OnRxPacket()
+		STAGE_UDP,			//UDPProtocol::OnRxPacket()
+		STAGE_TCP_DELIVER,	//TCP payload handed to the server / upper layer
+		STAGE_SSH_DECRYPT,	//SSH packet decrypted and authenticated
+		STAGE_APP,			//SSH channel data handed to the shell or SFTP server
+		STAGE_TX_SUBMIT,	//A reply frame handed to the driver
+		STAGE_RX_DONE,		//Frame fully processed and released
+
+		STAGE_COUNT
+	};
+
+	LatencyProfiler()
+	: m_frameStart(0)
+	, m_frameActive(false)
+	{
+		EnableCycleCounter();
+	}
+
+	///@brief Starts timing a new frame (call from the driver as soon as the frame is received)
+	void BeginFrame()
+	{
+		m_frameStart = GetCycleCount();
+		m_frameActive = true;
+	}
+
+	///@brief Starts timing a new frame, unless the driver already did
+	void BeginFrameIfIdle()
+	{
+		if(!m_frameActive)
+			BeginFrame();
+	}
+
+	///@brief Logs the time since the start of the current frame (does nothing if not processing a frame)
+	void Mark(Stage stage)
+	{
+		if(m_frameActive)
+			m_histograms[stage].Add(GetCycleCount() - m_frameStart);
+	}
+
+	///@brief Finishes timing the current frame
+	void EndFrame()
+	{
+		Mark(STAGE_RX_DONE);
+		m_frameActive = false;
+	}
+
+	const LatencyHistogram& GetHistogram(Stage stage) const
+	{ return m_histograms[stage]; }
+
+	void Clear()
+	{
+		for(auto& h : m_histograms)
+			h.Clear();
+	}
+
+protected:
+
+	///@brief Cycle count when the current frame was received
+	uint32_t m_frameStart;
+
+	///@brief True between BeginFrame() and EndFrame()
+	bool m_frameActive;
+
+	///@brief Latency histograms for each stage
+	LatencyHistogram m_histograms[STAGE_COUNT];
+};
+
+extern LatencyProfiler g_latencyProfiler;
+
+#define LATENCY_BEGIN_FRAME()			g_latencyProfiler.BeginFrame()
+#define LATENCY_BEGIN_FRAME_IF_IDLE()	g_latencyProfiler.BeginFrameIfIdle()
+#define LATENCY_MARK(stage)				g_latencyProfiler.Mark(LatencyProfiler::stage)
+#define LATENCY_END_FRAME()				g_latencyProfiler.EndFrame()
+
+#else
+
+#define LATENCY_BEGIN_FRAME()
+#define LATENCY_BEGIN_FRAME_IF_IDLE()
+#define LATENCY_MARK(stage)
+#define LATENCY_END_FRAME()
+
+#endif
+
+#endif
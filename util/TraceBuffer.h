@@ -0,0 +1,188 @@
+/***********************************************************************************************************************
+*                                                                                                                      *
+* staticnet                                                                                                            *
+*                                                                                                                      *
+* Copyright (c) 2021-2024 Andrew D. Zonenberg and contributors                                                         *
+* All rights reserved.                                                                                                 *
+*                                                                                                                      *
+* Redistribution and use in source and binary forms, with or without modification, are permitted provided that the     *
+* following conditions are met:                                                                                        *
+*                                                                                                                      *
+*    * Redistributions of source code must retain the above copyright notice, this list of conditions, and the         *
+*      following disclaimer.                                                                                           *
+*                                                                                                                      *
+*    * Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the       *
+*      following disclaimer in the documentation and/or other materials provided with the distribution.                *
+*                                                                                                                      *
+*    * Neither the name of the author nor the names of any contributors may be used to endorse or promote products     *
+*      derived from this software without specific prior written permission.                                           *
+*                                                                                                                      *
+* THIS SOFTWARE IS PROVIDED BY THE AUTHORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED   *
+* TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL *
+* THE AUTHORS BE HELD LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES        *
+* (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR       *
+* BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT *
+* (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE       *
+* POSSIBILITY OF SUCH DAMAGE.                                                                                          *
+*                                                                                                                      *
+***********************************************************************************************************************/
+
+
+/**
+	@file
+	@brief Declaration of TraceBuffer
+ */
+#ifndef TraceBuffer_h
+#define TraceBuffer_h
+
+/*
+	Event tracing is compiled out unless STATICNET_TRACE is defined in staticnet-config.h. If it is, the application
+	must provide the trace buffer:
+
+		TraceBuffer g_trace;
+
+	Events are written into a fixed size ring which always holds the most recent TRACE_BUFFER_SIZE entries. Nothing is
+	formatted on the target: to look at a trace, dump the raw bytes of g_trace (e.g. with "dump binary value" in gdb)
+	and feed them to tools/TraceDecoder.
+ */
+#ifdef STATICNET_TRACE
+
+#include "CycleCounter.h"
+
+//Default of 256 entries (4 kB) in the trace ring
+#ifndef TRACE_BUFFER_SIZE
+#define TRACE_BUFFER_SIZE 256
+#endif
+
+static_assert( (TRACE_BUFFER_SIZE & (TRACE_BUFFER_SIZE - 1)) == 0, "TRACE_BUFFER_SIZE must be a power of two");
+
+///@brief Magic number at the start of a TraceBuffer ("SNTR" in a little endian dump)
+#define TRACE_MAGIC 0x52544e53
+
+/**
+	@brief Types of event which can be traced
+
+	Values are part of the dump format, add new ones at the end.
+ */
+enum TraceEvent
+{
+	TRACE_NONE,						//Empty slot
+	TRACE_TCP_SEGMENT_SENT,			//id = remote port, arg0 = sequence number, arg1 = length | (flags << 16)
+	TRACE_TCP_SEGMENT_RECEIVED,		//id = remote port, arg0 = sequence number, arg1 = length | (flags << 16)
+	TRACE_TCP_RETRANSMIT,			//id = remote port, arg0 = sequence number, arg1 = length
+	TRACE_TCP_DUP_ACK,				//id = remote port, arg0 = ACK number, arg1 = window
+	TRACE_SSH_PACKET_DECRYPTED,		//id = connection ID, arg0 = message type, arg1 = packet length
+	TRACE_SFTP_REQUEST,				//id = connection ID, arg0 = request type, arg1 = request length
+	TRACE_FRAME_ALLOC_FAIL			//id = ethertype
+};
+
+/**
+	@brief A single entry in the trace ring
+ */
+class TraceEntry
+{
+public:
+	///@brief Cycle counter value when the event was logged
+	uint32_t	m_timestamp;
+
+	///@brief The TraceEvent
+	uint8_t		m_event;
+
+	///@brief Padding, always zero
+	uint8_t		m_reserved;
+
+	///@brief Event specific identifier (port number, connection ID, etc)
+	uint16_t	m_id;
+
+	///@brief Event specific arguments
+	uint32_t	m_arg0;
+	uint32_t	m_arg1;
+};
+
+static_assert(sizeof(TraceEntry) == 16, "TraceEntry must be 16 bytes");
+
+/**
+	@brief Fixed size ring of binary trace events
+
+	Logging an event is one atomic increment to claim a slot plus a handful of stores, so it's cheap enough to leave
+	on in production and is safe to call from interrupt handlers as well as the main loop. An entry being written at the
+	moment the buffer is dumped may be torn; the rest of the trace is unaffected.
+
+	The header fields describe the buffer so the decoder doesn't need to know how the firmware was configured.
+ */
+class TraceBuffer
+{
+public:
+	TraceBuffer()
+	: m_magic(TRACE_MAGIC)
+	, m_size(TRACE_BUFFER_SIZE)
+	, m_entrySize(sizeof(TraceEntry))
+	, m_head(0)
+	{
+		EnableCycleCounter();
+		Clear();
+	}
+
+	///@brief Empties the trace
+	void Clear()
+	{
+		for(auto& e : m_entries)
+		{
+			e.m_timestamp = 0;
+			e.m_event = TRACE_NONE;
+			e.m_reserved = 0;
+			e.m_id = 0;
+			e.m_arg0 = 0;
+			e.m_arg1 = 0;
+		}
+		m_head = 0;
+	}
+
+	///@brief Appends an event to the trace, overwriting the oldest one
+	void Log(TraceEvent event, uint16_t id, uint32_t arg0, uint32_t arg1)
+	{
+		auto& e = m_entries[__atomic_fetch_add(&m_head, 1, __ATOMIC_RELAXED) & (TRACE_BUFFER_SIZE - 1)];
+		e.m_timestamp = GetCycleCount();
+		e.m_event = event;
+		e.m_id = id;
+		e.m_arg0 = arg0;
+		e.m_arg1 = arg1;
+	}
+
+	///@brief Total number of events logged since the last Clear() (wraps)
+	uint32_t GetCount() const
+	{ return m_head; }
+
+	///@brief Returns an entry by raw index (0 is the oldest slot only if the ring hasn't wrapped)
+	const TraceEntry& GetEntry(uint32_t i) const
+	{ return m_entries[i & (TRACE_BUFFER_SIZE - 1)]; }
+
+protected:
+
+	///@brief Always TRACE_MAGIC
+	uint32_t	m_magic;
+
+	///@brief Number of entries in the ring
+	uint16_t	m_size;
+
+	///@brief Size of a single entry, in bytes
+	uint16_t	m_entrySize;
+
+	///@brief Number of events logged; the next one goes into slot (m_head % m_size)
+	uint32_t	m_head;
+
+	///@brief The ring itself
+	TraceEntry	m_entries[TRACE_BUFFER_SIZE];
+};
+
+extern TraceBuffer g_trace;
+
+#define TRACE_EVENT(event, id, arg0, arg1) g_trace.Log(event, id, arg0, arg1)
+
+#else
+
+#define TRACE_EVENT(event, id, arg0, arg1)
+
+#endif
+
+#endif